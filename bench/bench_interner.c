@@ -0,0 +1,207 @@
+#include "hbk_bench.h"
+
+#include "hbk_hasmap.h"
+#include "hbk_internal.h"
+#include "hbk_interner.h"
+
+/// Contention on the interner: every thread interns its own stream of identifiers drawn from the
+/// same vocabulary, with the Zipf(1) frequencies identifiers have in real code, so most lookups hit
+/// a handful of hot strings. The sharded interner is measured against the design it replaced,
+/// one mutex around a hash map, from 1 to 32 threads.
+
+#define BENCH_VOCABULARY_SIZE 50000
+#define BENCH_LOOKUP_COUNT    1000000
+#define BENCH_MAX_THREADS     32
+
+typedef struct bench_words {
+    hbk_string_view words[BENCH_VOCABULARY_SIZE];
+    /// @brief Indices into `words`, one stream per thread.
+    int32_t* streams[BENCH_MAX_THREADS];
+} bench_words;
+
+/// @brief The interner as it was before sharding: every lookup takes the lock.
+typedef struct bench_locked_interner {
+    hbk_os_mutex mutex;
+    hbk_hashmap map;
+    hbk_vector(hbk_string_view) strings;
+    hbk_arena* arena;
+} bench_locked_interner;
+
+typedef struct bench_thread {
+    hbk_os_thread thread;
+    bench_words* words;
+    int32_t* stream;
+    bench_locked_interner* locked;
+    hbk_interner* sharded;
+    hbk_interner_local local;
+} bench_thread;
+
+static void bench_run_locked(void* argument) {
+    bench_thread* thread = argument;
+    bench_locked_interner* interner = thread->locked;
+    for (int64_t i = 0; i < BENCH_LOOKUP_COUNT; i++) {
+        hbk_string_view word = thread->words->words[thread->stream[i]];
+        uint64_t hash = hbk_hash_bytes(word.data, word.count);
+
+        hbk_os_mutex_lock(&interner->mutex);
+        int64_t index;
+        if (!hbk_hashmap_get(&interner->map, word, hash, &index)) {
+            char* data = hbk_arena_alloc(interner->arena, (size_t)word.count + 1);
+            memcpy(data, word.data, (size_t)word.count);
+            data[word.count] = 0;
+            hbk_string_view copy = {data, word.count};
+
+            index = hbk_vector_count(interner->strings);
+            hbk_vector_push(interner->strings, copy);
+            hbk_hashmap_set(&interner->map, copy, hash, index);
+        }
+
+        hbk_os_mutex_unlock(&interner->mutex);
+    }
+}
+
+static void bench_run_sharded(void* argument) {
+    bench_thread* thread = argument;
+    for (int64_t i = 0; i < BENCH_LOOKUP_COUNT; i++) {
+        hbk_string_view word = thread->words->words[thread->stream[i]];
+        (void)hbk_interner_intern(thread->sharded, &thread->local, word.data, word.count);
+    }
+}
+
+/// @brief Interns every thread's stream once, and returns the seconds it took.
+static double bench_run(bench_words* words, int64_t thread_count, bool sharded) {
+    bench_locked_interner locked = {};
+    hbk_memory_account account = {};
+    hbk_interner* interner = NULL;
+    if (sharded) {
+        hbk_memory_account_init(&account, hbk_default_allocator(), NULL);
+        interner = hbk_interner_create(&account);
+    } else {
+        hbk_os_mutex_init(&locked.mutex);
+        hbk_hashmap_init(&locked.map, NULL);
+        locked.arena = hbk_arena_create();
+    }
+
+    bench_thread threads[BENCH_MAX_THREADS] = {};
+    for (int64_t i = 0; i < thread_count; i++) {
+        threads[i] = (bench_thread){
+            .words = words,
+            .stream = words->streams[i],
+            .locked = &locked,
+            .sharded = interner,
+            .local = {.arena = sharded ? hbk_arena_create() : NULL},
+        };
+    }
+
+    double start = hbk_bench_seconds();
+    for (int64_t i = 0; i < thread_count; i++) {
+        if (!hbk_os_thread_start(&threads[i].thread, sharded ? bench_run_sharded : bench_run_locked, &threads[i])) {
+            fprintf(stderr, "Could not start benchmark thread %lld.\n", (long long)i);
+            exit(1);
+        }
+    }
+
+    for (int64_t i = 0; i < thread_count; i++) {
+        hbk_os_thread_join(&threads[i].thread);
+    }
+
+    double elapsed = hbk_bench_seconds() - start;
+
+    if (sharded) {
+        hbk_interner_destroy(interner);
+        for (int64_t i = 0; i < thread_count; i++) {
+            hbk_arena_destroy(threads[i].local.arena);
+        }
+    } else {
+        hbk_hashmap_destroy(&locked.map);
+        hbk_vector_free(locked.strings);
+        hbk_arena_destroy(locked.arena);
+        hbk_os_mutex_destroy(&locked.mutex);
+    }
+
+    return elapsed;
+}
+
+/// @brief Makes up identifiers of 2 to 40 characters, mostly short ones, each unique thanks to its index.
+static void bench_generate_words(bench_words* words, hbk_bench_random* random) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    for (int64_t i = 0; i < BENCH_VOCABULARY_SIZE; i++) {
+        int64_t length = 2;
+        while (length < 40 && hbk_bench_random_unit(random) < 0.85) {
+            length++;
+        }
+
+        hbk_string word = NULL;
+        for (int64_t j = 0; j < length; j++) {
+            /// Identifiers can't start with a digit.
+            char c = alphabet[hbk_bench_random_below(random, j == 0 ? 53 : 63)];
+            hbk_vector_push(word, c);
+        }
+
+        hbk_string_append_format(&word, "%lld", (long long)i);
+        words->words[i] = hbk_string_as_view(word);
+    }
+
+    /// Zipf(1): the word of rank k turns up in proportion to 1/k.
+    double* cumulative = malloc(sizeof(double) * BENCH_VOCABULARY_SIZE);
+    double sum = 0;
+    for (int64_t i = 0; i < BENCH_VOCABULARY_SIZE; i++) {
+        sum += 1.0 / (double)(i + 1);
+        cumulative[i] = sum;
+    }
+
+    for (int64_t t = 0; t < BENCH_MAX_THREADS; t++) {
+        words->streams[t] = malloc(sizeof(int32_t) * BENCH_LOOKUP_COUNT);
+        for (int64_t i = 0; i < BENCH_LOOKUP_COUNT; i++) {
+            double u = hbk_bench_random_unit(random) * sum;
+            int64_t low = 0;
+            int64_t high = BENCH_VOCABULARY_SIZE - 1;
+            while (low < high) {
+                int64_t middle = (low + high) / 2;
+                if (cumulative[middle] < u) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+
+            words->streams[t][i] = (int32_t)low;
+        }
+    }
+
+    free(cumulative);
+}
+
+int main(void) {
+    static bench_words words;
+    hbk_bench_random random = {.state = 23};
+    bench_generate_words(&words, &random);
+
+    printf("bench_interner: %d lookups per thread from %d words, Zipf(1), %lld processors, best of %d\n", BENCH_LOOKUP_COUNT, BENCH_VOCABULARY_SIZE, (long long)hbk_os_processor_count(), HBK_BENCH_REPETITIONS);
+    printf("  threads   locked (Mlookups/s)   sharded (Mlookups/s)\n");
+    for (int64_t thread_count = 1; thread_count <= BENCH_MAX_THREADS; thread_count *= 2) {
+        double rates[2];
+        for (int64_t sharded = 0; sharded < 2; sharded++) {
+            double best = 1e30;
+            for (int64_t i = 0; i < HBK_BENCH_REPETITIONS; i++) {
+                double elapsed = bench_run(&words, thread_count, sharded);
+                if (elapsed < best) best = elapsed;
+            }
+
+            rates[sharded] = (double)(thread_count * BENCH_LOOKUP_COUNT) / best / 1e6;
+        }
+
+        printf("  %7lld   %19.1f   %20.1f\n", (long long)thread_count, rates[0], rates[1]);
+    }
+
+    for (int64_t i = 0; i < BENCH_VOCABULARY_SIZE; i++) {
+        hbk_string word = (hbk_string)words.words[i].data;
+        hbk_vector_free(word);
+    }
+
+    for (int64_t t = 0; t < BENCH_MAX_THREADS; t++) {
+        free(words.streams[t]);
+    }
+
+    return 0;
+}
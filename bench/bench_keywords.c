@@ -0,0 +1,49 @@
+#include "hbk_bench.h"
+
+/// Lexing throughput on a keyword-heavy source, against a control source where every keyword is
+/// an identifier of the same length. Keywords are classified with the perfect hash and never
+/// interned, so the keyword source should lex at least as fast as the control.
+
+#define BENCH_SOURCE_SIZE (24 * 1024 * 1024)
+
+/// @brief Lexes the source on one thread, and returns the best tokens per second.
+static double measure_lexing(hbk_state* state, hbk_source_id source_id, int64_t* out_token_count) {
+    double best = 1e30;
+    for (int64_t i = 0; i < HBK_BENCH_REPETITIONS; i++) {
+        double start = hbk_bench_seconds();
+        hbk_token_buffer tokens = hbk_lex_parallel(state, source_id, 1);
+        double elapsed = hbk_bench_seconds() - start;
+
+        *out_token_count = hbk_vector_count(tokens.kinds);
+        hbk_token_buffer_destroy(&tokens);
+        if (elapsed < best) best = elapsed;
+    }
+
+    return (double)*out_token_count / best;
+}
+
+int main(void) {
+    const char* names[] = {"keywords", "identifiers"};
+    hbk_bench_source_shape shapes[] = {HBK_BENCH_SOURCE_KEYWORDS, HBK_BENCH_SOURCE_IDENTIFIERS};
+    double rates[2];
+
+    printf("bench_keywords: lexing %d MiB on one thread, best of %d\n", BENCH_SOURCE_SIZE / (1024 * 1024), HBK_BENCH_REPETITIONS);
+    for (int64_t i = 0; i < 2; i++) {
+        /// The same seed for both, so the sources have the same words in the same places.
+        hbk_bench_random random = {.state = 3};
+        hbk_string text = hbk_bench_generate_source(&random, shapes[i], BENCH_SOURCE_SIZE);
+
+        hbk_state* state = hbk_state_create();
+        hbk_source_id source_id = hbk_state_add_source_from_memory(state, names[i], text, hbk_vector_count(text), HBK_SOURCE_BORROW);
+
+        int64_t token_count = 0;
+        rates[i] = measure_lexing(state, source_id, &token_count);
+        printf("  %-12s %10lld tokens  %7.1f Mtok/s\n", names[i], (long long)token_count, rates[i] / 1e6);
+
+        hbk_state_destroy(state);
+        hbk_vector_free(text);
+    }
+
+    printf("  keywords lex %.2fx as fast as identifiers\n", rates[0] / rates[1]);
+    return 0;
+}
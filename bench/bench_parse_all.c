@@ -0,0 +1,64 @@
+#include "hbk_bench.h"
+
+/// Scaling of `hbk_state_parse_all` over many small sources, like a CI run over a tree of scripts,
+/// from one thread up to one per processor. The sources are generated once and borrowed by a new
+/// state for every run, so each run lexes, parses and merges diagnostics for all of them.
+
+#define BENCH_SOURCE_COUNT 2000
+#define BENCH_SOURCE_SIZE  (16 * 1024)
+
+static double measure_parse_all(hbk_string* texts, int64_t thread_count) {
+    double best = 1e30;
+    for (int64_t i = 0; i < HBK_BENCH_REPETITIONS; i++) {
+        hbk_state* state = hbk_state_create();
+        for (int64_t j = 0; j < BENCH_SOURCE_COUNT; j++) {
+            char name[32];
+            snprintf(name, sizeof name, "source%lld.hibiku", (long long)j);
+            hbk_state_add_source_from_memory(state, name, texts[j], hbk_vector_count(texts[j]), HBK_SOURCE_BORROW);
+        }
+
+        double start = hbk_bench_seconds();
+        hbk_state_parse_all(state, thread_count);
+        double elapsed = hbk_bench_seconds() - start;
+
+        hbk_state_destroy(state);
+        if (elapsed < best) best = elapsed;
+    }
+
+    return best;
+}
+
+int main(void) {
+    hbk_bench_random random = {.state = 22};
+    hbk_string texts[BENCH_SOURCE_COUNT];
+    int64_t total_size = 0;
+    for (int64_t i = 0; i < BENCH_SOURCE_COUNT; i++) {
+        texts[i] = hbk_bench_generate_source(&random, HBK_BENCH_SOURCE_CODE, BENCH_SOURCE_SIZE);
+        total_size += hbk_vector_count(texts[i]);
+    }
+
+    int64_t processor_count = hbk_os_processor_count();
+    printf("bench_parse_all: %d sources, %.1f MiB, %lld processors, best of %d\n", BENCH_SOURCE_COUNT, (double)total_size / (1024 * 1024), (long long)processor_count, HBK_BENCH_REPETITIONS);
+
+    double single = 0;
+    for (int64_t thread_count = 1;; thread_count *= 2) {
+        /// Always end on exactly one thread per processor.
+        if (thread_count > processor_count) {
+            thread_count = processor_count;
+        }
+
+        double elapsed = measure_parse_all(texts, thread_count);
+        if (thread_count == 1) {
+            single = elapsed;
+        }
+
+        printf("  %3lld threads  %8.1f ms  %5.2fx\n", (long long)thread_count, elapsed * 1e3, single / elapsed);
+        if (thread_count == processor_count) break;
+    }
+
+    for (int64_t i = 0; i < BENCH_SOURCE_COUNT; i++) {
+        hbk_vector_free(texts[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "hbk_bench.h"
+
+/// Building the token buffer of a 10M-token source. First the three vectors on their own, filled
+/// the way `hbk_lex` fills them, growing as they go and then reserved up front, so the cost of
+/// growth shows separately from lexing. Then `hbk_lex` itself on a generated source of about the
+/// same number of tokens.
+
+#define BENCH_TOKEN_COUNT  10000000
+#define BENCH_SOURCE_SIZE  (40 * 1024 * 1024)
+
+/// @brief Fills a token buffer with `token_count` made-up tokens, one in three with a payload,
+/// and returns the seconds it took.
+static double fill_token_buffer(int64_t token_count, bool reserve) {
+    double start = hbk_bench_seconds();
+
+    hbk_token_buffer tokens = {};
+    if (reserve) {
+        hbk_vector_reserve_exact(tokens.kinds, token_count);
+        hbk_vector_reserve_exact(tokens.offsets, token_count);
+        hbk_vector_reserve_exact(tokens.payloads, token_count / 3 + 1);
+    }
+
+    for (int64_t i = 0; i < token_count; i++) {
+        hbk_vector_push(tokens.kinds, (uint8_t)(i & 127));
+        hbk_vector_push(tokens.offsets, (uint32_t)(i * 4));
+        if (i % 3 == 0) {
+            hbk_token_payload payload = {.length = (uint32_t)i, .symbol = (hbk_symbol)i, .integer_value = i};
+            hbk_vector_push(tokens.payloads, payload);
+        }
+    }
+
+    double elapsed = hbk_bench_seconds() - start;
+    hbk_token_buffer_destroy(&tokens);
+    return elapsed;
+}
+
+static void report(const char* name, double seconds, int64_t token_count) {
+    printf("  %-18s %8.1f ms  %6.2f ns/token\n", name, seconds * 1e3, seconds * 1e9 / (double)token_count);
+}
+
+int main(void) {
+    printf("bench_token_buffer: %d tokens, best of %d\n", BENCH_TOKEN_COUNT, HBK_BENCH_REPETITIONS);
+
+    const char* names[] = {"push, growing", "push, reserved"};
+    for (int64_t reserve = 0; reserve < 2; reserve++) {
+        double best = 1e30;
+        for (int64_t i = 0; i < HBK_BENCH_REPETITIONS; i++) {
+            double elapsed = fill_token_buffer(BENCH_TOKEN_COUNT, reserve);
+            if (elapsed < best) best = elapsed;
+        }
+
+        report(names[reserve], best, BENCH_TOKEN_COUNT);
+    }
+
+    hbk_bench_random random = {.state = 15};
+    hbk_string text = hbk_bench_generate_source(&random, HBK_BENCH_SOURCE_CODE, BENCH_SOURCE_SIZE);
+    hbk_state* state = hbk_state_create();
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "tokens", text, hbk_vector_count(text), HBK_SOURCE_BORROW);
+
+    double best = 1e30;
+    int64_t token_count = 0;
+    for (int64_t i = 0; i < HBK_BENCH_REPETITIONS; i++) {
+        double start = hbk_bench_seconds();
+        hbk_token_buffer tokens = hbk_lex_parallel(state, source_id, 1);
+        double elapsed = hbk_bench_seconds() - start;
+
+        token_count = hbk_vector_count(tokens.kinds);
+        hbk_token_buffer_destroy(&tokens);
+        if (elapsed < best) best = elapsed;
+    }
+
+    printf("  hbk_lex, %lld tokens from %lld MiB:\n", (long long)token_count, (long long)(hbk_vector_count(text) / (1024 * 1024)));
+    report("lex, one thread", best, token_count);
+
+    hbk_state_destroy(state);
+    hbk_vector_free(text);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#ifndef HBK_BENCH_H
+#define HBK_BENCH_H
+
+#include <hibiku.h>
+
+#include "hbk_lex.h"
+#include "hbk_os.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Each benchmark is its own program, built optimized and without asserts against the library
+/// sources by `make bench` (or `./nob bench`). They generate their inputs from a fixed seed,
+/// so runs on the same machine measure the same work, and print their results to stdout.
+
+/// @brief How many times each measurement is repeated. The fastest run is reported.
+#define HBK_BENCH_REPETITIONS 5
+
+/// @brief The time in seconds, only meaningful as the difference between two calls.
+static inline double hbk_bench_seconds() {
+    return (double)hbk_os_monotonic_nanoseconds() / 1e9;
+}
+
+/// @brief A small, seedable generator (splitmix64), so the inputs don't depend on the C library's `rand`.
+typedef struct hbk_bench_random {
+    uint64_t state;
+} hbk_bench_random;
+
+static inline uint64_t hbk_bench_random_next(hbk_bench_random* random) {
+    uint64_t z = (random->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/// @brief A number in [0, bound).
+static inline int64_t hbk_bench_random_below(hbk_bench_random* random, int64_t bound) {
+    return (int64_t)(hbk_bench_random_next(random) % (uint64_t)bound);
+}
+
+/// @brief A number in [0, 1).
+static inline double hbk_bench_random_unit(hbk_bench_random* random) {
+    return (double)(hbk_bench_random_next(random) >> 11) / (double)(1ull << 53);
+}
+
+static const char* hbk_bench_keywords[] = {
+#define X(N, S) S,
+    HBK_TOKEN_KW_KINDS(X)
+#undef X
+};
+
+#define HBK_BENCH_KEYWORD_COUNT ((int64_t)(sizeof hbk_bench_keywords / sizeof hbk_bench_keywords[0]))
+
+/// @brief Identifiers which share a length and first or last character with a keyword, so they
+/// make it past the cheap checks of the keyword table to the comparison at the end.
+static const char* hbk_bench_near_keywords[] = {
+    "andy", "of", "nut", "tree", "fuse", "nib", "impart", "fraction", "coast", "loyal",
+    "expert", "is", "eyes", "whole", "fir", "rerun", "strong", "ant", "bold", "valve",
+};
+
+#define HBK_BENCH_NEAR_KEYWORD_COUNT ((int64_t)(sizeof hbk_bench_near_keywords / sizeof hbk_bench_near_keywords[0]))
+
+typedef enum hbk_bench_source_shape {
+    /// @brief Lines of mostly keywords, with some identifiers that look like them. Only good for lexing.
+    HBK_BENCH_SOURCE_KEYWORDS,
+    /// @brief Ordinary declarations: functions, locals with expressions and exports, which parse cleanly.
+    HBK_BENCH_SOURCE_CODE,
+    /// @brief Like HBK_BENCH_SOURCE_KEYWORDS, but each keyword is swapped for an identifier of the
+    /// same length, so the two differ only in how their words are classified.
+    HBK_BENCH_SOURCE_IDENTIFIERS,
+} hbk_bench_source_shape;
+
+/// @brief Appends one line of the given shape, using `index` to keep the names unique.
+static inline void hbk_bench_append_line(hbk_string* text, hbk_bench_random* random, hbk_bench_source_shape shape, int64_t index) {
+    switch (shape) {
+        default: {
+            fprintf(stderr, "Unknown source shape %d.\n", (int)shape);
+            exit(1);
+        }
+
+        case HBK_BENCH_SOURCE_KEYWORDS:
+        case HBK_BENCH_SOURCE_IDENTIFIERS: {
+            int64_t word_count = 8 + hbk_bench_random_below(random, 8);
+            for (int64_t i = 0; i < word_count; i++) {
+                int64_t roll = hbk_bench_random_below(random, 10);
+                if (roll < 7) {
+                    const char* keyword = hbk_bench_keywords[hbk_bench_random_below(random, HBK_BENCH_KEYWORD_COUNT)];
+                    if (shape == HBK_BENCH_SOURCE_KEYWORDS) {
+                        hbk_string_append_cstr(text, keyword);
+                    } else {
+                        /// An upper case first letter never starts a keyword.
+                        hbk_string_append_format(text, "Q%s", keyword + 1);
+                    }
+                } else if (roll < 9) {
+                    hbk_string_append_cstr(text, hbk_bench_near_keywords[hbk_bench_random_below(random, HBK_BENCH_NEAR_KEYWORD_COUNT)]);
+                } else {
+                    hbk_string_append_format(text, "v%lld", (long long)hbk_bench_random_below(random, 1000));
+                }
+
+                hbk_string_append_cstr(text, i + 1 < word_count ? " " : ";\n");
+            }
+        } break;
+
+        case HBK_BENCH_SOURCE_CODE: {
+            long long n = (long long)index;
+            switch (hbk_bench_random_below(random, 5)) {
+                case 0: hbk_string_append_format(text, "function f%lld(a: int, b: int, c: int): int => a + b * c - %lld;\n", n, n); break;
+                case 1: hbk_string_append_format(text, "export function g%lld() => v%lld + %lld * 3;\n", n, n, n); break;
+                case 2: hbk_string_append_format(text, "local v%lld: int = %lld + v%lld * 2;\n", n, n, n); break;
+                case 3: hbk_string_append_format(text, "export x%lld = \"string number %lld\";\n", n, n); break;
+                case 4: hbk_string_append_format(text, "local flag%lld = true and false or v%lld == %lld; // flag\n", n, n, n); break;
+            }
+        } break;
+    }
+}
+
+/// @brief Generates at least `size` bytes of source text of the given shape, in whole lines.
+static inline hbk_string hbk_bench_generate_source(hbk_bench_random* random, hbk_bench_source_shape shape, int64_t size) {
+    hbk_string text = NULL;
+    hbk_vector_reserve_exact(text, size + 256);
+    for (int64_t index = 0; hbk_vector_count(text) < size; index++) {
+        hbk_bench_append_line(&text, random, shape, index);
+    }
+
+    return text;
+}
+
+#endif // !HBK_BENCH_H
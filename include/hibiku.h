@@ -40,6 +40,24 @@
 /// This includes the Patch version, so this string is in the form of "Hibiku X.Y.Z".
 #define HBK_VERSION_RELEASE HBK_VERSION "." HBK_STR(HBK_VERSION_PATCH)
 
+/// @brief A custom memory allocator, for hosts which want control over where the
+/// memory of a state comes from. See `hbk_state_create_with_allocator`.
+/// None of the callbacks are ever called with a size of zero or a NULL pointer to free.
+/// Failing an allocation by returning NULL is a fatal error and aborts the process.
+typedef struct hbk_allocator {
+    /// @brief Allocates `size` bytes, aligned for any type.
+    void* (*alloc)(void* user_data, size_t size);
+    /// @brief Resizes an allocation of `old_size` bytes to `new_size` bytes, keeping its contents.
+    void* (*realloc)(void* user_data, void* memory, size_t old_size, size_t new_size);
+    /// @brief Frees an allocation of `size` bytes.
+    void (*free)(void* user_data, void* memory, size_t size);
+    /// @brief Passed to every callback as-is.
+    void* user_data;
+} hbk_allocator;
+
+/// @brief The allocator which uses `malloc`, `realloc` and `free`.
+const hbk_allocator* hbk_default_allocator();
+
 /// A vector/list/dynamir array in Hibiku is represented simply as a pointer to
 /// the underlying type. This gives us type the ability to access the type info
 /// of the underlying type implicitly rather than requiring the user specify it
@@ -47,28 +65,51 @@
 /// introspection.
 /// Since all of the API for the vector type is implemented through C macros,
 /// we can use things like `sizeof(*vector)` to query the size of the underlying type.
+/// A NULL vector is empty, and gets its memory from the default allocator once something
+/// is added to it. To use a different allocator, set the vector up with `hbk_vector_init` first.
+/// Growing a vector does NOT zero the new elements, use `hbk_vector_set_count_zeroed` for that.
 #define hbk_vector(T) T*
 
 typedef struct hbk_vector_header {
+    /// @brief Where the vector's memory came from, and where it goes back to.
+    const hbk_allocator* allocator;
     int64_t count;
     int64_t capacity;
 } hbk_vector_header;
 
 void hbk_vector_ensure_capacity(void** vector_address, int64_t element_size, int64_t minimum_capacity);
+void hbk_vector_set_capacity_exact(void** vector_address, int64_t element_size, int64_t capacity);
+void hbk_vector_shrink(void** vector_address, int64_t element_size);
+void hbk_vector_append_elements(void** vector_address, int64_t element_size, const void* elements, int64_t count);
+void hbk_vector_set_count_and_zero(void** vector_address, int64_t element_size, int64_t count);
+void hbk_vector_init_with_allocator(void** vector_address, const hbk_allocator* allocator);
+void hbk_vector_release(void* vector, int64_t element_size);
 
 #define hbk_vector_get_header(V) ((hbk_vector_header*)(V)-1)
-#define hbk_vector_free(V) do { if (V) free(hbk_vector_get_header(V)); (V) = NULL; } while (0)
+/// @brief Sets up an empty (NULL) vector to take its memory from the given allocator.
+/// The allocator must outlive the vector.
+#define hbk_vector_init(V, A)    hbk_vector_init_with_allocator((void**)&(V), (A))
+#define hbk_vector_free(V)       do { if (V) hbk_vector_release((V), sizeof *(V)); (V) = NULL; } while (0)
 #define hbk_vector_count(V)      ((V) ? hbk_vector_get_header(V)->count : 0)
 #define hbk_vector_capacity(V)   ((V) ? hbk_vector_get_header(V)->capacity : 0)
 #define hbk_vector_set_count(V, C)                                  \
     do {                                                            \
         hbk_vector_ensure_capacity((void**)&(V), sizeof *(V), (C)); \
-        hbk_vector_get_header(V)->count = (C);                      \
+        if (V) hbk_vector_get_header(V)->count = (C);               \
     } while (0)
 #define hbk_vector_set_capacity(V, C)                                  \
     do {                                                            \
         hbk_vector_ensure_capacity((void**)&(V), sizeof *(V), (C)); \
     } while (0)
+/// @brief Like `hbk_vector_set_count`, but any elements added are zeroed.
+#define hbk_vector_set_count_zeroed(V, C) hbk_vector_set_count_and_zero((void**)&(V), sizeof *(V), (C))
+/// @brief Makes room for at least `C` elements in total without rounding up, for when
+/// the final size is known. Never shrinks the vector.
+#define hbk_vector_reserve_exact(V, C)    hbk_vector_set_capacity_exact((void**)&(V), sizeof *(V), (C))
+/// @brief Gives back any capacity beyond the vector's count.
+#define hbk_vector_shrink_to_fit(V)       hbk_vector_shrink((void**)&(V), sizeof *(V))
+/// @brief Copies `N` elements from the array `P` onto the end of the vector, growing it at most once.
+#define hbk_vector_append_n(V, P, N)      hbk_vector_append_elements((void**)&(V), sizeof *(V), (P), (N))
 #define hbk_vector_push(V, E)                                                           \
     do {                                                                                \
         hbk_vector_ensure_capacity((void**)&(V), sizeof *(V), hbk_vector_count(V) + 1); \
@@ -90,6 +131,16 @@ typedef struct hbk_string_view {
 #define HBK_SV_EXPAND(SV) (int)(SV).count, (SV).data
 
 typedef int64_t hbk_source_id;
+
+/// @brief A handle to an interned string.
+/// Symbols are dense indices into the interner of the state that created them,
+/// so two symbols from the same state are equal exactly when their strings are.
+/// Use `hbk_state_symbol_view` to get the text back.
+typedef uint32_t hbk_symbol;
+
+/// @brief The symbol of the empty string. Every state interns it first,
+/// so zero-initialized symbols are always valid.
+#define HBK_SYMBOL_EMPTY ((hbk_symbol)0)
 typedef struct hbk_state hbk_state;
 
 typedef struct hbk_location {
@@ -114,29 +165,288 @@ struct hbk_diagnostic {
     hbk_location location;
     hbk_string_view message;
     hbk_vector(hbk_diagnostic*) related_diagnostics;
+    /// @brief Whether `hbk_diagnostic_commit` has been called for this diagnostic, see `hbk_diagnostic_begin`.
+    bool is_committed;
+    /// @brief The allocator of the state which created this diagnostic.
+    /// Most diagnostics never get any related ones, so their vector is only created on demand.
+    const hbk_allocator* allocator;
 };
 
+/// @brief How `hbk_state_render_diagnostics_to_file` writes diagnostics.
+typedef enum hbk_diagnostic_format {
+    /// @brief For people: `name:line:column: kind: message`, then the source line with the location underlined.
+    HBK_DIAGNOSTIC_FORMAT_TEXT,
+    /// @brief One JSON object per line, with the fields
+    /// `kind`, `source_id`, `source`, `offset`, `length`, `line`, `column`, `message` and `related`.
+    /// `related` is an array of objects with the same fields, except `related`.
+    /// Bytes of the message which aren't valid UTF-8 are written as U+FFFD.
+    HBK_DIAGNOSTIC_FORMAT_JSON,
+    /// @brief A stream of binary records, see `hbk_diagnostic_write_binary_header`.
+    HBK_DIAGNOSTIC_FORMAT_BINARY,
+} hbk_diagnostic_format;
+
+/// @brief Called with each diagnostic as soon as it is committed, see `hbk_state_set_diagnostic_sink`.
+/// The diagnostic stays valid for as long as the state does.
+typedef void (*hbk_diagnostic_sink)(hbk_state* state, hbk_diagnostic* diag, void* user_data);
+
+/// @brief Statistics about the string interner of a state, to check that it behaves.
+/// With a healthy table, `probe_count / lookup_count` stays close to 1 no matter
+/// how many strings have been interned.
+typedef struct hbk_interner_stats {
+    /// @brief The number of unique strings interned.
+    int64_t entry_count;
+    /// @brief The number of slots in the backing hash tables, one per shard.
+    int64_t capacity;
+    /// @brief The number of times a string was looked up for interning.
+    int64_t lookup_count;
+    /// @brief The number of lookups which found an existing string.
+    int64_t hit_count;
+    /// @brief The number of hash table slots inspected across all lookups, including the lookups needed for insertion.
+    int64_t probe_count;
+    /// @brief The ratio of occupied slots to total slots in the backing hash tables.
+    double load_factor;
+} hbk_interner_stats;
+
+/// @brief A position in a source as people count it. Both start at 1, and columns count bytes.
+typedef struct hbk_line_column {
+    int64_t line;
+    int64_t column;
+} hbk_line_column;
+
+/// @brief The categories a state sorts its memory into for `hbk_state_get_memory_stats`,
+/// along with the name each one is reported under.
+#define HBK_MEMORY_CATEGORIES(X)                                            \
+    X(STATE, "state")             /* the state structure itself */          \
+    X(SOURCES, "sources")         /* source records and the text they own */ \
+    X(STRINGS, "strings")         /* interned strings and the interner */   \
+    X(DIAGNOSTICS, "diagnostics") /* the list of diagnostics */             \
+    X(LOCATIONS, "locations")     /* locations too big to pack */           \
+    X(MISC, "misc")               /* the general purpose arena */           \
+    X(TOKENS, "tokens")           /* token buffers, while parsing */        \
+    X(SYNTAX, "syntax")           /* syntax trees and the parser */
+
+typedef enum hbk_memory_category {
+#define X(N, S) HBK_MEMORY_##N,
+    HBK_MEMORY_CATEGORIES(X)
+#undef X
+    HBK_MEMORY_CATEGORY_COUNT,
+} hbk_memory_category;
+
+/// @brief How much memory one category of things owned by a state takes up, in bytes.
+typedef struct hbk_memory_usage {
+    /// @brief Memory currently held, either from the allocator or committed from the OS.
+    /// Address space that arenas have reserved but not yet committed doesn't count.
+    int64_t reserved_bytes;
+    /// @brief Memory actually handed out. Vectors count their whole capacity as used.
+    int64_t used_bytes;
+    /// @brief Memory held by arenas which can never be handed out: alignment padding,
+    /// and the unused tails of blocks which were too full for the next allocation.
+    int64_t wasted_bytes;
+    /// @brief The highest `reserved_bytes` has ever been.
+    int64_t peak_reserved_bytes;
+    /// @brief The highest `used_bytes` has ever been.
+    int64_t peak_used_bytes;
+} hbk_memory_usage;
+
+/// @brief Where the memory of a state goes. Memory-mapped source files are not included,
+/// they belong to the OS's file cache rather than to the state.
+typedef struct hbk_memory_stats {
+    hbk_memory_usage categories[HBK_MEMORY_CATEGORY_COUNT];
+    /// @brief All of the categories together. Its peaks are the peaks of the combined usage,
+    /// which can be lower than the sum of each category's peak.
+    hbk_memory_usage total;
+} hbk_memory_stats;
+
+/// @brief The phases a state times for `hbk_state_get_instrumentation_stats`, along with the name each one
+/// is reported under. None of them include each other, so they can be added up.
+#define HBK_PASSES(X)                                                                       \
+    X(READ, "read")               /* mapping or reading source files */                     \
+    X(LEX, "lex")                 /* turning source text into tokens ahead of parsing */    \
+    X(PARSE, "parse")             /* turning tokens into syntax trees, lexing as it goes */ \
+    X(PRINT, "print")             /* printing syntax trees */                               \
+    X(DIAGNOSTICS, "diagnostics") /* rendering diagnostics */
+
+typedef enum hbk_pass {
+#define X(N, S) HBK_PASS_##N,
+    HBK_PASSES(X)
+#undef X
+    HBK_PASS_COUNT,
+} hbk_pass;
+
+/// @brief The things a state counts for `hbk_state_get_instrumentation_stats`, along with the name each one is reported under.
+#define HBK_COUNTERS(X)                                                                             \
+    X(SOURCE_BYTES, "source bytes")     /* bytes of source text read or mapped from files */        \
+    X(TOKENS, "tokens")                 /* tokens lexed */                                          \
+    X(LEX_CHUNKS, "lex chunks")         /* chunks of single sources lexed in parallel */            \
+    X(RELEXED_CHUNKS, "relexed chunks") /* lex chunks lexed again, having started inside a token */ \
+    X(SYNTAX_NODES, "syntax nodes")     /* nodes in all syntax trees */                             \
+    X(INTERN_HITS, "intern hits")       /* lookups which found an already interned string */        \
+    X(INTERN_MISSES, "intern misses")   /* lookups which had to intern a new string */              \
+    X(ARENA_BYTES, "arena bytes")       /* bytes currently allocated from the state's arenas */     \
+    X(DIAGNOSTICS, "diagnostics")       /* diagnostics created, not counting duplicates */
+
+typedef enum hbk_counter {
+#define X(N, S) HBK_COUNTER_##N,
+    HBK_COUNTERS(X)
+#undef X
+    HBK_COUNTER_COUNT,
+} hbk_counter;
+
+/// @brief How often a pass ran, and how long it took altogether.
+typedef struct hbk_pass_stats {
+    int64_t run_count;
+    int64_t total_nanoseconds;
+} hbk_pass_stats;
+
+typedef struct hbk_instrumentation_stats {
+    hbk_pass_stats passes[HBK_PASS_COUNT];
+    int64_t counters[HBK_COUNTER_COUNT];
+} hbk_instrumentation_stats;
+
+/// @brief How a state should treat the memory passed to `hbk_state_add_source_from_memory`.
+typedef enum hbk_source_ownership {
+    /// @brief The state makes its own copy of the data. The caller is free to do anything with it afterwards.
+    HBK_SOURCE_COPY,
+    /// @brief The state uses the caller's memory directly, without copying it.
+    /// The caller must keep it alive and unchanged until the state is destroyed,
+    /// and `data[length]` must be a readable NUL byte.
+    HBK_SOURCE_BORROW,
+    /// @brief Like HBK_SOURCE_BORROW, but the state takes over the memory and frees it with `free`
+    /// when it is destroyed. `data[length]` must be a readable NUL byte.
+    HBK_SOURCE_TAKE_OWNERSHIP,
+} hbk_source_ownership;
+
 hbk_string_view hbk_cstring_as_view(const char* string);
 hbk_string_view hbk_string_as_view(hbk_string string);
 
+/// Strings built with these functions are always NUL-terminated, even though the
+/// terminator isn't part of their count. Prefer the non-format functions when
+/// building up a lot of output, they never go through `printf`.
 void hbk_string_append_format(hbk_string* string, const char* format, ...);
 void hbk_string_append_formatv(hbk_string* string, const char* format, va_list v);
+void hbk_string_append_sv(hbk_string* string, hbk_string_view sv);
+void hbk_string_append_cstr(hbk_string* string, const char* cstr);
+/// @brief Appends the decimal digits of `value`, with a leading '-' if it's negative.
+void hbk_string_append_int(hbk_string* string, int64_t value);
 
 hbk_state* hbk_state_create();
+/// @brief Creates a state which gets all of its memory from the given allocator, which is copied.
+/// That includes every vector and arena the state owns, its syntax trees and diagnostics.
+/// The exceptions are memory-mapped source files (see `hbk_state_set_enable_mmap`), and
+/// text given to the state with HBK_SOURCE_TAKE_OWNERSHIP, which is still freed with `free`.
+hbk_state* hbk_state_create_with_allocator(const hbk_allocator* allocator);
 void hbk_state_destroy(hbk_state* state);
 void hbk_state_set_enable_color(hbk_state* state, bool use_color);
+/// @brief Selects the format `hbk_state_render_diagnostics_to_file` writes in, text by default.
+void hbk_state_set_diagnostic_format(hbk_state* state, hbk_diagnostic_format format);
+/// @brief Controls whether source files are memory-mapped rather than read into memory.
+/// This is on by default wherever `mmap` is available. Files which can't be mapped,
+/// such as pipes, are always read.
+void hbk_state_set_enable_mmap(hbk_state* state, bool use_mmap);
+/// @brief Registers the file at the given path as a source, or returns the existing id if it was already added.
+/// Adding a source only loads its text, call `hbk_state_parse_source` to parse it.
 hbk_source_id hbk_state_add_source_from_file(hbk_state* state, const char* file_path);
+/// @brief Registers `length` bytes at `data` as a source with the given name, without touching the filesystem.
+/// Adding a source only loads its text, call `hbk_state_parse_source` to parse it.
+hbk_source_id hbk_state_add_source_from_memory(hbk_state* state, const char* name, const char* data, int64_t length, hbk_source_ownership ownership);
+/// @brief Parses the given source, if it hasn't been parsed already. Any errors are reported as diagnostics.
+void hbk_state_parse_source(hbk_state* state, hbk_source_id source_id);
+/// @brief Parses every source which hasn't been parsed yet, on up to `thread_count` threads.
+/// 0 means one thread per processor, and 1 parses them one after the other on the calling thread.
+/// Threads left over when there are fewer sources than threads go to lexing large sources in chunks.
+///
+/// Each thread keeps the diagnostics of the sources it parses to itself, and once they are all
+/// done those are published (to the sink or the list) in source order, on the calling thread.
+/// The diagnostics, where the error limit cuts them off, and the syntax trees are the same whatever
+/// the thread count. Threads don't stop at the error limit by themselves, so the source which reaches
+/// it and the ones after it are parsed again on the calling thread, as they would be with one thread.
+///
+/// With more than one thread, the state's allocator is called from all of them, so it must be thread-safe.
+void hbk_state_parse_all(hbk_state* state, int64_t thread_count);
+/// @brief Parses the given source if needed, then writes a debug view of its syntax tree to the file.
+void hbk_state_print_source_syntax_to_file(hbk_state* state, hbk_source_id source_id, FILE* file);
 hbk_string_view hbk_state_get_source_name(hbk_state* state, hbk_source_id source_id);
 hbk_string_view hbk_state_get_source_text(hbk_state* state, hbk_source_id source_id);
+/// @brief Finds the line and column of the start of the location.
+/// The first time this is called for a source, it builds an index of where its lines start,
+/// which makes every lookup after that a binary search rather than a scan of the text.
+hbk_line_column hbk_state_location_to_line_column(hbk_state* state, hbk_location location);
 void hbk_state_render_diagnostics_to_file(hbk_state* state, FILE* file);
+/// @brief Streams diagnostics to `sink` as they are committed, instead of keeping them for
+/// `hbk_state_render_diagnostics_to_file`. Pass NULL to go back to keeping them.
+/// Each diagnostic reaches the sink once, with its related diagnostics, which never reach it on their own.
+void hbk_state_set_diagnostic_sink(hbk_state* state, hbk_diagnostic_sink sink, void* user_data);
+/// @brief Stops lexing and parsing once this many errors have been reported, 0 (the default) means no limit.
+/// Reaching the limit reports one last fatal diagnostic, after which any new diagnostics are dropped
+/// and the diagnostic functions return NULL.
+void hbk_state_set_max_errors(hbk_state* state, int64_t max_errors);
+bool hbk_state_has_reached_error_limit(hbk_state* state);
+hbk_interner_stats hbk_state_get_interner_stats(hbk_state* state);
+hbk_memory_stats hbk_state_get_memory_stats(hbk_state* state);
+const char* hbk_memory_category_name(hbk_memory_category category);
+/// @brief Whether the library was built with instrumentation, see HBK_INSTRUMENTATION in the build.
+/// Without it, `hbk_state_get_instrumentation_stats` only ever returns zeroes.
+bool hbk_instrumentation_is_enabled();
+hbk_instrumentation_stats hbk_state_get_instrumentation_stats(hbk_state* state);
+/// @brief Starts recording when each pass begins and ends, on every thread which works for the state,
+/// for `hbk_state_write_trace_to_file`. Each thread keeps the last 65536 events.
+/// @return false if instrumentation was compiled out, in which case nothing will be recorded.
+bool hbk_state_start_trace(hbk_state* state);
+/// @brief Writes the recorded trace as Chrome Trace Event JSON, which Perfetto (ui.perfetto.dev)
+/// and chrome://tracing can show as a timeline. No passes may be running while this writes.
+/// @return false if no trace was started.
+bool hbk_state_write_trace_to_file(hbk_state* state, FILE* file);
+const char* hbk_pass_name(hbk_pass pass);
+const char* hbk_counter_name(hbk_counter counter);
+hbk_string_view hbk_state_symbol_view(hbk_state* state, hbk_symbol symbol);
 
 hbk_location hbk_location_create(hbk_source_id source_id, int64_t offset, int64_t length);
 
+/// Diagnostics with the same kind, location and message as an earlier one are only reported once,
+/// and creating one again just returns the earlier diagnostic.
+/// The create functions commit the diagnostic straight away, see `hbk_diagnostic_commit`.
 hbk_diagnostic* hbk_diagnostic_create(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* message);
 hbk_diagnostic* hbk_diagnostic_create_format(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, ...);
 hbk_diagnostic* hbk_diagnostic_create_formatv(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, va_list v);
+/// @brief Creates a diagnostic like `hbk_diagnostic_create`, but doesn't commit it yet, so that related
+/// diagnostics can be attached to it first. This always makes a new diagnostic: duplicates are only
+/// looked for when it is committed. Related diagnostics are made with these functions too:
+///
+///     hbk_diagnostic* diag = hbk_diagnostic_begin(state, HBK_DIAG_ERROR, location, "Redefinition of 'x'.");
+///     hbk_diagnostic_add_related(diag, hbk_diagnostic_begin(state, HBK_DIAG_INFO, previous_location, "Defined here."));
+///     hbk_diagnostic_commit(state, diag);
+hbk_diagnostic* hbk_diagnostic_begin(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* message);
+hbk_diagnostic* hbk_diagnostic_begin_format(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, ...);
+hbk_diagnostic* hbk_diagnostic_begin_formatv(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, va_list v);
+/// @brief Publishes the diagnostic, along with the related diagnostics attached to it by then: it goes to
+/// the sink, or the list for `hbk_state_render_diagnostics_to_file`, and counts towards the error limit.
+/// If an identical diagnostic was committed before, this one is dropped, along with its related diagnostics.
+/// Committing a diagnostic again, or a related diagnostic on its own, does nothing.
+void hbk_diagnostic_commit(hbk_state* state, hbk_diagnostic* diag);
+/// @brief Attaches `related` to `diag`, and makes its kind HBK_DIAG_RELATED. The related diagnostic
+/// must come from `hbk_diagnostic_begin` and never be committed itself. It should be attached before
+/// `diag` is committed, otherwise a sink has already seen `diag` without it.
 void hbk_diagnostic_add_related(hbk_diagnostic* diag, hbk_diagnostic* related);
 
 void hbk_diagnostic_render_to_string(hbk_state* state, hbk_diagnostic* diag, hbk_string* string);
+/// @brief The name of the kind as it appears in rendered diagnostics, e.g. "error" or "note".
+const char* hbk_diagnostic_kind_name(hbk_diagnostic_kind kind);
+/// @brief Writes the diagnostic and its related diagnostics straight to the file, in the given format.
+/// Binary records still need `hbk_diagnostic_write_binary_header` at the start of the stream.
+void hbk_diagnostic_write_to_file(hbk_state* state, hbk_diagnostic* diag, hbk_diagnostic_format format, FILE* file);
+/// @brief Writes the 8 bytes a binary diagnostic stream starts with: the magic "HBKD", then the
+/// version as a 32-bit integer, currently 1.
+///
+/// All integers in the stream are little-endian. Each record after the header is laid out as
+///
+///   u32 size of the rest of the record, including its related records
+///   u8  kind (`hbk_diagnostic_kind`)
+///   u8  padding, 3 bytes of zeroes
+///   u32 number of related records
+///   i64 source id, offset, length, line, column
+///   u32 message length, followed by that many bytes of message
+///
+/// and then its related records, laid out the same way (without related records of their own).
+void hbk_diagnostic_write_binary_header(FILE* file);
 
 #endif // !HIBIKU_H
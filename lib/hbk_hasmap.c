@@ -0,0 +1,158 @@
+#include "hbk_hasmap.h"
+#include "hbk_internal.h"
+
+#include <string.h>
+
+#define HBK_HASHMAP_MIN_CAPACITY 64
+
+uint64_t hbk_hash_bytes(const char* data, int64_t length) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (int64_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+void hbk_hashmap_init(hbk_hashmap* map, const hbk_allocator* allocator) {
+    HBK_ASSERT(map != NULL, "Invalid hash map pointer");
+    *map = (hbk_hashmap){
+        .allocator = allocator,
+    };
+}
+
+void hbk_hashmap_destroy(hbk_hashmap* map) {
+    if (map == NULL) return;
+    hbk_vector_free(map->slots);
+    *map = (hbk_hashmap){0};
+}
+
+/// @brief Finds the slot for the given key: either the slot which contains it,
+/// or the empty slot where it would be inserted.
+/// The map must have at least one empty slot, which the load factor guarantees.
+static hbk_hashmap_slot* hbk_hashmap_find_slot(hbk_hashmap* map, hbk_string_view key, uint64_t hash) {
+    int64_t capacity = hbk_vector_count(map->slots);
+    HBK_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0, "hash map capacity must be a power of two");
+
+    map->lookup_count++;
+
+    uint64_t mask = (uint64_t)capacity - 1;
+    for (uint64_t index = hash & mask;; index = (index + 1) & mask) {
+        map->probe_count++;
+
+        hbk_hashmap_slot* slot = &map->slots[index];
+        if (slot->key.data == NULL) {
+            return slot;
+        }
+
+        if (slot->hash == hash && slot->key.count == key.count && 0 == memcmp(slot->key.data, key.data, (size_t)key.count)) {
+            return slot;
+        }
+    }
+}
+
+static void hbk_hashmap_grow(hbk_hashmap* map) {
+    hbk_vector(hbk_hashmap_slot) old_slots = map->slots;
+    int64_t old_capacity = hbk_vector_count(old_slots);
+    int64_t new_capacity = old_capacity == 0 ? HBK_HASHMAP_MIN_CAPACITY : old_capacity * 2;
+
+    map->slots = NULL;
+    hbk_vector_init(map->slots, map->allocator != NULL ? map->allocator : hbk_default_allocator());
+    hbk_vector_reserve_exact(map->slots, new_capacity);
+    hbk_vector_set_count_zeroed(map->slots, new_capacity);
+
+    /// Every key in the old table is already unique, so re-inserting only has to find
+    /// an empty slot. The cached hash means we never touch the key bytes here.
+    uint64_t mask = (uint64_t)new_capacity - 1;
+    for (int64_t i = 0; i < old_capacity; i++) {
+        hbk_hashmap_slot old_slot = old_slots[i];
+        if (old_slot.key.data == NULL) {
+            continue;
+        }
+
+        uint64_t index = old_slot.hash & mask;
+        while (map->slots[index].key.data != NULL) {
+            index = (index + 1) & mask;
+        }
+
+        map->slots[index] = old_slot;
+    }
+
+    hbk_vector_free(old_slots);
+}
+
+bool hbk_hashmap_get(hbk_hashmap* map, hbk_string_view key, uint64_t hash, int64_t* out_value) {
+    HBK_ASSERT(map != NULL, "Invalid hash map pointer");
+
+    if (map->count == 0) {
+        return false;
+    }
+
+    hbk_hashmap_slot* slot = hbk_hashmap_find_slot(map, key, hash);
+    if (slot->key.data == NULL) {
+        return false;
+    }
+
+    if (out_value != NULL) {
+        *out_value = slot->value;
+    }
+
+    return true;
+}
+
+void hbk_hashmap_set(hbk_hashmap* map, hbk_string_view key, uint64_t hash, int64_t value) {
+    HBK_ASSERT(map != NULL, "Invalid hash map pointer");
+    HBK_ASSERT(key.data != NULL, "Hash map keys must not have NULL data");
+
+    /// Keep the load factor at or below 3/4. Linear probing degrades quickly past that.
+    int64_t capacity = hbk_vector_count(map->slots);
+    if ((map->count + 1) * 4 > capacity * 3) {
+        hbk_hashmap_grow(map);
+    }
+
+    hbk_hashmap_slot* slot = hbk_hashmap_find_slot(map, key, hash);
+    if (slot->key.data == NULL) {
+        slot->hash = hash;
+        slot->key = key;
+        map->count++;
+    }
+
+    slot->value = value;
+}
+
+bool hbk_hashmap_try_insert(hbk_hashmap* map, hbk_string_view key, uint64_t hash, int64_t value, int64_t* out_value) {
+    HBK_ASSERT(map != NULL, "Invalid hash map pointer");
+    HBK_ASSERT(key.data != NULL, "Hash map keys must not have NULL data");
+
+    int64_t capacity = hbk_vector_count(map->slots);
+    if ((map->count + 1) * 4 > capacity * 3) {
+        hbk_hashmap_grow(map);
+    }
+
+    hbk_hashmap_slot* slot = hbk_hashmap_find_slot(map, key, hash);
+    if (slot->key.data != NULL) {
+        if (out_value != NULL) {
+            *out_value = slot->value;
+        }
+
+        return false;
+    }
+
+    slot->hash = hash;
+    slot->key = key;
+    slot->value = value;
+    map->count++;
+    return true;
+}
+
+double hbk_hashmap_load_factor(hbk_hashmap* map) {
+    HBK_ASSERT(map != NULL, "Invalid hash map pointer");
+
+    int64_t capacity = hbk_vector_count(map->slots);
+    if (capacity == 0) {
+        return 0.0;
+    }
+
+    return (double)map->count / (double)capacity;
+}
@@ -0,0 +1,57 @@
+#ifndef HBK_HASMAP_H
+#define HBK_HASMAP_H
+
+#include <hibiku.h>
+#include <stdint.h>
+
+/// @brief Computes a 64-bit FNV-1a hash of the given bytes.
+/// FNV-1a is not the fastest hash around, but it is tiny, easy to understand
+/// and distributes short identifier-like keys well enough for our needs.
+uint64_t hbk_hash_bytes(const char* data, int64_t length);
+
+/// @brief A single slot in an open-addressing hash map.
+/// A slot is empty when its key data is NULL.
+typedef struct hbk_hashmap_slot {
+    /// @brief The cached hash of the key, so we only compare key bytes
+    /// when the hashes are already equal, and so that growing the map
+    /// never needs to re-hash any keys.
+    uint64_t hash;
+    /// @brief The key for this slot. The map does not own the key data,
+    /// the caller must make sure it outlives the map (interned strings do).
+    hbk_string_view key;
+    int64_t value;
+} hbk_hashmap_slot;
+
+/// @brief An open-addressing (linear probing) hash map from string keys to integer values.
+/// Entries can only be inserted, never removed, which keeps probing trivial.
+typedef struct hbk_hashmap {
+    /// @brief Where the slots are allocated from. NULL means the default allocator.
+    const hbk_allocator* allocator;
+    hbk_vector(hbk_hashmap_slot) slots;
+    /// @brief The number of occupied slots.
+    int64_t count;
+    /// @brief The total number of lookups performed on this map, including the ones done for insertion.
+    int64_t lookup_count;
+    /// @brief The total number of slots inspected across all lookups.
+    /// `probe_count / lookup_count` is the average probe length, and should stay close to 1.
+    int64_t probe_count;
+} hbk_hashmap;
+
+/// @brief Prepares an empty map which allocates its slots from the given allocator.
+/// A zero-initialized map is also valid, and uses the default allocator.
+void hbk_hashmap_init(hbk_hashmap* map, const hbk_allocator* allocator);
+void hbk_hashmap_destroy(hbk_hashmap* map);
+
+/// @brief Looks up the value for the given key, whose hash must have been computed with `hbk_hash_bytes`.
+/// @return true if the key was found and `out_value` was written, false otherwise.
+bool hbk_hashmap_get(hbk_hashmap* map, hbk_string_view key, uint64_t hash, int64_t* out_value);
+/// @brief Inserts the key with the given value, or replaces the value if the key already exists.
+void hbk_hashmap_set(hbk_hashmap* map, hbk_string_view key, uint64_t hash, int64_t value);
+/// @brief Inserts the key with the given value, unless the key already exists, in a single lookup.
+/// @return true if the key was inserted, false if it already existed, in which case its value is written to `out_value`.
+bool hbk_hashmap_try_insert(hbk_hashmap* map, hbk_string_view key, uint64_t hash, int64_t value, int64_t* out_value);
+
+/// @brief The ratio of occupied slots to total slots, in the range [0, 1).
+double hbk_hashmap_load_factor(hbk_hashmap* map);
+
+#endif // !HBK_HASMAP_H
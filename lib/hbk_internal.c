@@ -1,8 +1,166 @@
 #include "hbk_internal.h"
+#include "hbk_os.h"
 
 #include <stdarg.h>
 #include <stdalign.h>
 #include <stddef.h>
+#include <string.h>
+
+/// Where the OS can remap pages, allocations at least this big get pages of their own.
+/// Growing a big vector then moves page table entries around instead of copying it.
+/// We're always told the size of an allocation, so we can tell the two kinds apart later.
+#define HBK_LARGE_ALLOCATION_SIZE ((size_t)1 << 20)
+
+static bool hbk_is_large_allocation(size_t size) {
+    return HBK_OS_HAS_MREMAP && size >= HBK_LARGE_ALLOCATION_SIZE;
+}
+
+static void* hbk_default_alloc(void* user_data, size_t size) {
+    if (hbk_is_large_allocation(size)) {
+        return hbk_os_allocate_pages(size);
+    }
+
+    return malloc(size);
+}
+
+static void hbk_default_free(void* user_data, void* memory, size_t size) {
+    if (hbk_is_large_allocation(size)) {
+        hbk_os_free_pages(memory, size);
+        return;
+    }
+
+    free(memory);
+}
+
+static void* hbk_default_realloc(void* user_data, void* memory, size_t old_size, size_t new_size) {
+    bool was_large = hbk_is_large_allocation(old_size);
+    bool is_large = hbk_is_large_allocation(new_size);
+
+    if (!was_large && !is_large) {
+        return realloc(memory, new_size);
+    }
+
+    if (was_large && is_large) {
+        return hbk_os_reallocate_pages(memory, old_size, new_size);
+    }
+
+    void* new_memory = hbk_default_alloc(user_data, new_size);
+    if (new_memory == NULL) {
+        return NULL;
+    }
+
+    memcpy(new_memory, memory, old_size < new_size ? old_size : new_size);
+    hbk_default_free(user_data, memory, old_size);
+    return new_memory;
+}
+
+static const hbk_allocator default_allocator = {
+    .alloc = hbk_default_alloc,
+    .realloc = hbk_default_realloc,
+    .free = hbk_default_free,
+};
+
+const hbk_allocator* hbk_default_allocator() {
+    return &default_allocator;
+}
+
+void* hbk_allocator_alloc(const hbk_allocator* allocator, size_t size) {
+    HBK_ASSERT(allocator != NULL, "Invalid allocator pointer");
+    HBK_ASSERT(size > 0, "Allocators are never asked for zero bytes");
+
+    void* memory = allocator->alloc(allocator->user_data, size);
+    if (memory == NULL) {
+        HBK_ICE(memory != NULL, "Out of memory, failed to allocate %zu bytes", size);
+    }
+
+    return memory;
+}
+
+void* hbk_allocator_realloc(const hbk_allocator* allocator, void* memory, size_t old_size, size_t new_size) {
+    HBK_ASSERT(allocator != NULL, "Invalid allocator pointer");
+    HBK_ASSERT(memory != NULL && new_size > 0, "Use hbk_allocator_alloc and hbk_allocator_free to allocate and free");
+
+    void* new_memory = allocator->realloc(allocator->user_data, memory, old_size, new_size);
+    if (new_memory == NULL) {
+        HBK_ICE(new_memory != NULL, "Out of memory, failed to reallocate %zu bytes", new_size);
+    }
+
+    return new_memory;
+}
+
+void hbk_allocator_free(const hbk_allocator* allocator, void* memory, size_t size) {
+    HBK_ASSERT(allocator != NULL, "Invalid allocator pointer");
+    if (memory == NULL) return;
+    allocator->free(allocator->user_data, memory, size);
+}
+
+static void* hbk_accounting_alloc(void* user_data, size_t size) {
+    hbk_memory_account* account = user_data;
+    void* memory = account->backing->alloc(account->backing->user_data, size);
+    if (memory != NULL) {
+        hbk_memory_account_add(account, (int64_t)size, (int64_t)size, 0);
+    }
+
+    return memory;
+}
+
+static void* hbk_accounting_realloc(void* user_data, void* memory, size_t old_size, size_t new_size) {
+    hbk_memory_account* account = user_data;
+    void* new_memory = account->backing->realloc(account->backing->user_data, memory, old_size, new_size);
+    if (new_memory != NULL) {
+        int64_t delta = (int64_t)new_size - (int64_t)old_size;
+        hbk_memory_account_add(account, delta, delta, 0);
+    }
+
+    return new_memory;
+}
+
+static void hbk_accounting_free(void* user_data, void* memory, size_t size) {
+    hbk_memory_account* account = user_data;
+    account->backing->free(account->backing->user_data, memory, size);
+    hbk_memory_account_add(account, -(int64_t)size, -(int64_t)size, 0);
+}
+
+void hbk_memory_account_init(hbk_memory_account* account, const hbk_allocator* backing, hbk_memory_account* parent) {
+    HBK_ASSERT(account != NULL, "Invalid memory account pointer");
+    HBK_ASSERT(backing != NULL, "Invalid allocator pointer");
+    *account = (hbk_memory_account){
+        .backing = backing,
+        .parent = parent,
+        .allocator = {
+            .alloc = hbk_accounting_alloc,
+            .realloc = hbk_accounting_realloc,
+            .free = hbk_accounting_free,
+            .user_data = account,
+        },
+    };
+}
+
+void hbk_memory_account_add(hbk_memory_account* account, int64_t reserved_bytes, int64_t used_bytes, int64_t wasted_bytes) {
+    hbk_os_mutex* mutex = account->mutex;
+    if (mutex != NULL) {
+        hbk_os_mutex_lock(mutex);
+    }
+
+    for (; account != NULL; account = account->parent) {
+        hbk_memory_usage* usage = &account->usage;
+        usage->reserved_bytes += reserved_bytes;
+        usage->used_bytes += used_bytes;
+        usage->wasted_bytes += wasted_bytes;
+
+        if (usage->reserved_bytes > usage->peak_reserved_bytes) {
+            usage->peak_reserved_bytes = usage->reserved_bytes;
+        }
+
+        if (usage->used_bytes > usage->peak_used_bytes) {
+            usage->peak_used_bytes = usage->used_bytes;
+        }
+    }
+
+    if (mutex != NULL) {
+        hbk_os_mutex_unlock(mutex);
+    }
+}
 
 [[noreturn]]
 void hbk_internal_error(hbk_error_kind kind, const char* file_name, int line_number, const char* assert_expression, const char* format, ...) {
@@ -34,7 +192,17 @@ void hbk_internal_error(hbk_error_kind kind, const char* file_name, int line_num
     exit(1);
 }
 
+/// Arenas which ask for it reserve address space up front and commit it as they grow,
+/// so allocating is just a pointer bump and there's no limit on allocation size.
+/// Commits double in size, starting from a page and going up to this much at once,
+/// so small arenas stay small and big ones rarely call into the OS.
+#define HBK_ARENA_MAX_COMMIT_STEP ((size_t)64 << 20)
+
+/// Arenas which don't reserve, or can't (or run out), use blocks.
 #define HBK_ARENA_BLOCK_CAPACITY (1024*64)
+/// Allocations bigger than this get a chunk all to themselves, so that they never
+/// cause the rest of the current block to go to waste.
+#define HBK_ARENA_DEDICATED_THRESHOLD (HBK_ARENA_BLOCK_CAPACITY / 4)
 
 typedef struct hbk_arena_block {
     void* memory;
@@ -43,51 +211,175 @@ typedef struct hbk_arena_block {
 } hbk_arena_block;
 
 struct hbk_arena {
+    const hbk_allocator* allocator;
+    /// @brief Where to report memory use, or NULL.
+    hbk_memory_account* account;
+    /// @brief The bytes asked for since the last reset, not counting padding.
+    size_t used_bytes;
+    /// @brief Alignment padding plus the tails of blocks which were left for a new one.
+    size_t wasted_bytes;
+
+    /// @brief The reserved address range, or NULL if the arena only uses blocks.
+    char* reserve_base;
+    size_t reserve_size;
+    size_t committed_size;
+    size_t total_allocated;
+    /// @brief Set once the reservation can't satisfy an allocation, after which
+    /// everything comes from blocks instead.
+    bool reserve_exhausted;
+
+    /// @brief The fallback blocks. Only the first `blocks_in_use` hold allocations,
+    /// and the last of those is the one being allocated from. The rest are left over
+    /// from before a rewind or reset, and get reused before any new block is made.
     hbk_vector(hbk_arena_block) blocks;
+    int64_t blocks_in_use;
+    /// @brief Allocations too big for a block, each in their own chunk of memory.
+    hbk_vector(hbk_arena_block) dedicated_chunks;
 };
 
-void hbk_arena_add_block(hbk_arena* arena) {
-    void* memory = calloc(HBK_ARENA_BLOCK_CAPACITY, 1);
-    hbk_arena_block block = {
-        .memory = memory,
-        .memory_capacity = HBK_ARENA_BLOCK_CAPACITY,
+static size_t hbk_align_up(size_t value, size_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+static void hbk_arena_account(hbk_arena* arena, int64_t reserved_bytes, int64_t used_bytes, int64_t wasted_bytes) {
+    if (arena->account != NULL) {
+        hbk_memory_account_add(arena->account, reserved_bytes, used_bytes, wasted_bytes);
+    }
+}
+
+static void hbk_arena_init(hbk_arena* arena, const hbk_allocator* allocator, hbk_memory_account* account, size_t reserve_size) {
+    *arena = (hbk_arena){
+        .allocator = allocator,
+        .account = account,
     };
-    hbk_vector_push(arena->blocks, block);
+
+    /// NULL vectors already use the default allocator. Leaving them be means the scratch
+    /// arenas don't hold any memory until they are used.
+    if (allocator != hbk_default_allocator()) {
+        hbk_vector_init(arena->blocks, allocator);
+        hbk_vector_init(arena->dedicated_chunks, allocator);
+    }
+
+    if (reserve_size != 0 && allocator->alloc == hbk_default_alloc) {
+        reserve_size = hbk_align_up(reserve_size, hbk_os_page_size());
+        arena->reserve_base = hbk_os_reserve(reserve_size);
+        if (arena->reserve_base != NULL) {
+            arena->reserve_size = reserve_size;
+        }
+    }
 }
 
 hbk_arena* hbk_arena_create() {
-    hbk_arena* arena = calloc(1, sizeof *arena);
-    HBK_ASSERT(arena != NULL, "Buy more ram");
-    hbk_arena_add_block(arena);
+    return hbk_arena_create_with_allocator(hbk_default_allocator(), NULL, 0);
+}
+
+hbk_arena* hbk_arena_create_with_allocator(const hbk_allocator* allocator, hbk_memory_account* account, size_t reserve_size) {
+    HBK_ASSERT(allocator != NULL, "Invalid allocator pointer");
+    hbk_arena* arena = hbk_allocator_alloc(allocator, sizeof *arena);
+    hbk_arena_init(arena, allocator, account, reserve_size);
     return arena;
 }
 
-void hbk_arena_destroy(hbk_arena* arena) {
-    if (arena == NULL) return;
+/// @brief Gives back everything the arena holds, but not the arena itself.
+static void hbk_arena_deinit(hbk_arena* arena) {
+    const hbk_allocator* allocator = arena->allocator;
+    size_t reserved_bytes = arena->committed_size;
+
     for (int64_t i = 0; i < hbk_vector_count(arena->blocks); i++) {
-        free(arena->blocks[i].memory);
+        reserved_bytes += arena->blocks[i].memory_capacity;
+        hbk_allocator_free(allocator, arena->blocks[i].memory, arena->blocks[i].memory_capacity);
         arena->blocks[i].memory = NULL;
     }
 
+    for (int64_t i = 0; i < hbk_vector_count(arena->dedicated_chunks); i++) {
+        reserved_bytes += arena->dedicated_chunks[i].memory_capacity;
+        hbk_allocator_free(allocator, arena->dedicated_chunks[i].memory, arena->dedicated_chunks[i].memory_capacity);
+    }
+
+    hbk_arena_account(arena, -(int64_t)reserved_bytes, -(int64_t)arena->used_bytes, -(int64_t)arena->wasted_bytes);
+
     hbk_vector_free(arena->blocks);
-    free(arena);
+    hbk_vector_free(arena->dedicated_chunks);
+    hbk_os_release(arena->reserve_base, arena->reserve_size);
+    *arena = (hbk_arena){0};
 }
 
-void* hbk_arena_alloc(hbk_arena* arena, size_t count) {
-    HBK_ASSERT(count <= HBK_ARENA_BLOCK_CAPACITY, "Attempted to allocate something WAY too big, please don't");
+void hbk_arena_destroy(hbk_arena* arena) {
+    if (arena == NULL) return;
+    const hbk_allocator* allocator = arena->allocator;
+    hbk_arena_deinit(arena);
+    hbk_allocator_free(allocator, arena, sizeof *arena);
+}
+
+static void* hbk_arena_alloc_reserved(hbk_arena* arena, size_t count) {
+    if (count > arena->reserve_size - arena->total_allocated) {
+        return NULL;
+    }
 
-    // TODO(local): vector_back?
-    hbk_arena_block* block = &arena->blocks[hbk_vector_count(arena->blocks) - 1];
-    HBK_ASSERT(block != NULL, "what");
+    size_t new_total_allocated = arena->total_allocated + count;
+    if (new_total_allocated > arena->committed_size) {
+        size_t commit_step = arena->committed_size == 0 ? hbk_os_page_size() : arena->committed_size;
+        if (commit_step > HBK_ARENA_MAX_COMMIT_STEP) {
+            commit_step = HBK_ARENA_MAX_COMMIT_STEP;
+        }
 
-    // align the count
-    size_t align = alignof(max_align_t);
-    count += (align - (count % align)) % align;
+        size_t new_committed_size = arena->committed_size + commit_step;
+        if (new_committed_size < new_total_allocated) {
+            new_committed_size = hbk_align_up(new_total_allocated, hbk_os_page_size());
+        }
+
+        if (new_committed_size > arena->reserve_size) {
+            new_committed_size = arena->reserve_size;
+        }
+
+        if (!hbk_os_commit(arena->reserve_base + arena->committed_size, new_committed_size - arena->committed_size)) {
+            return NULL;
+        }
+
+        hbk_arena_account(arena, (int64_t)(new_committed_size - arena->committed_size), 0, 0);
+        arena->committed_size = new_committed_size;
+    }
+
+    void* result = arena->reserve_base + arena->total_allocated;
+    arena->total_allocated = new_total_allocated;
+
+    return result;
+}
+
+static void* hbk_arena_alloc_from_blocks(hbk_arena* arena, size_t count) {
+    if (count > HBK_ARENA_DEDICATED_THRESHOLD) {
+        hbk_arena_block chunk = {
+            .memory = hbk_allocator_alloc(arena->allocator, count),
+            .memory_capacity = count,
+            .total_allocated = count,
+        };
+
+        hbk_vector_push(arena->dedicated_chunks, chunk);
+        hbk_arena_account(arena, (int64_t)count, 0, 0);
+        return chunk.memory;
+    }
+
+    hbk_arena_block* block = arena->blocks_in_use > 0 ? &arena->blocks[arena->blocks_in_use - 1] : NULL;
 
-    if (count > block->memory_capacity - block->total_allocated) {
-        hbk_arena_add_block(arena);
-        block = &arena->blocks[hbk_vector_count(arena->blocks) - 1];
-        HBK_ASSERT(block != NULL, "what");
+    if (block == NULL || count > block->memory_capacity - block->total_allocated) {
+        if (block != NULL) {
+            size_t tail = block->memory_capacity - block->total_allocated;
+            arena->wasted_bytes += tail;
+            hbk_arena_account(arena, 0, 0, (int64_t)tail);
+        }
+
+        if (arena->blocks_in_use == hbk_vector_count(arena->blocks)) {
+            hbk_arena_block new_block = {
+                .memory = hbk_allocator_alloc(arena->allocator, HBK_ARENA_BLOCK_CAPACITY),
+                .memory_capacity = HBK_ARENA_BLOCK_CAPACITY,
+            };
+
+            hbk_vector_push(arena->blocks, new_block);
+            hbk_arena_account(arena, HBK_ARENA_BLOCK_CAPACITY, 0, 0);
+        }
+
+        block = &arena->blocks[arena->blocks_in_use++];
+        block->total_allocated = 0;
     }
 
     void* result = (char*)block->memory + block->total_allocated;
@@ -95,3 +387,274 @@ void* hbk_arena_alloc(hbk_arena* arena, size_t count) {
 
     return result;
 }
+
+void* hbk_arena_alloc(hbk_arena* arena, size_t count) {
+    HBK_ASSERT(arena != NULL, "Invalid arena pointer");
+
+    // align the count
+    size_t requested_count = count;
+    count = hbk_align_up(count, alignof(max_align_t));
+
+    arena->used_bytes += requested_count;
+    arena->wasted_bytes += count - requested_count;
+    hbk_arena_account(arena, 0, (int64_t)requested_count, (int64_t)(count - requested_count));
+
+    if (arena->reserve_base != NULL && !arena->reserve_exhausted) {
+        void* result = hbk_arena_alloc_reserved(arena, count);
+        if (result != NULL) {
+            return result;
+        }
+
+        arena->reserve_exhausted = true;
+    }
+
+    return hbk_arena_alloc_from_blocks(arena, count);
+}
+
+hbk_arena_savepoint hbk_arena_mark(hbk_arena* arena) {
+    HBK_ASSERT(arena != NULL, "Invalid arena pointer");
+    return (hbk_arena_savepoint){
+        .reserve_allocated = arena->total_allocated,
+        .reserve_exhausted = arena->reserve_exhausted,
+        .blocks_in_use = arena->blocks_in_use,
+        .block_allocated = arena->blocks_in_use > 0 ? arena->blocks[arena->blocks_in_use - 1].total_allocated : 0,
+        .dedicated_chunk_count = hbk_vector_count(arena->dedicated_chunks),
+        .used_bytes = arena->used_bytes,
+        .wasted_bytes = arena->wasted_bytes,
+    };
+}
+
+void hbk_arena_rewind(hbk_arena* arena, hbk_arena_savepoint savepoint) {
+    HBK_ASSERT(arena != NULL, "Invalid arena pointer");
+    HBK_ASSERT(savepoint.reserve_allocated <= arena->total_allocated, "Arena savepoint is ahead of the arena");
+    HBK_ASSERT(savepoint.blocks_in_use <= arena->blocks_in_use, "Arena savepoint is ahead of the arena");
+    HBK_ASSERT(savepoint.dedicated_chunk_count <= hbk_vector_count(arena->dedicated_chunks), "Arena savepoint is ahead of the arena");
+
+    /// Committed pages and blocks are kept around, the next allocations will reuse them.
+    arena->total_allocated = savepoint.reserve_allocated;
+    arena->reserve_exhausted = savepoint.reserve_exhausted;
+
+    arena->blocks_in_use = savepoint.blocks_in_use;
+    if (arena->blocks_in_use > 0) {
+        arena->blocks[arena->blocks_in_use - 1].total_allocated = savepoint.block_allocated;
+    }
+
+    size_t freed_bytes = 0;
+    for (int64_t i = savepoint.dedicated_chunk_count; i < hbk_vector_count(arena->dedicated_chunks); i++) {
+        freed_bytes += arena->dedicated_chunks[i].memory_capacity;
+        hbk_allocator_free(arena->allocator, arena->dedicated_chunks[i].memory, arena->dedicated_chunks[i].memory_capacity);
+    }
+
+    hbk_vector_set_count(arena->dedicated_chunks, savepoint.dedicated_chunk_count);
+
+    hbk_arena_account(
+        arena,
+        -(int64_t)freed_bytes,
+        (int64_t)savepoint.used_bytes - (int64_t)arena->used_bytes,
+        (int64_t)savepoint.wasted_bytes - (int64_t)arena->wasted_bytes
+    );
+
+    arena->used_bytes = savepoint.used_bytes;
+    arena->wasted_bytes = savepoint.wasted_bytes;
+}
+
+void hbk_arena_reset(hbk_arena* arena) {
+    hbk_arena_rewind(arena, (hbk_arena_savepoint){0});
+}
+
+size_t hbk_arena_used_bytes(hbk_arena* arena) {
+    HBK_ASSERT(arena != NULL, "Invalid arena pointer");
+    return arena->used_bytes;
+}
+
+#define HBK_SCRATCH_ARENA_COUNT 2
+
+/// Scratch arenas are per thread, so they never need any locking. They are set up the
+/// first time a thread asks for one and given back when the thread exits, so the worker
+/// threads of every `hbk_parallel_for` don't leave their reservations behind.
+static _Thread_local hbk_arena hbk_scratch_arenas[HBK_SCRATCH_ARENA_COUNT];
+static _Thread_local bool hbk_scratch_arenas_initialized;
+
+static hbk_os_once hbk_scratch_thread_exit_once = HBK_OS_ONCE_INIT;
+static hbk_os_thread_exit hbk_scratch_thread_exit;
+static bool hbk_scratch_thread_exit_ready;
+
+static void hbk_scratch_arenas_deinit(void* value) {
+    hbk_arena* arenas = value;
+    for (int64_t i = 0; i < HBK_SCRATCH_ARENA_COUNT; i++) {
+        hbk_arena_deinit(&arenas[i]);
+    }
+
+    /// Another thread exit destructor might still want one.
+    hbk_scratch_arenas_initialized = false;
+}
+
+static void hbk_scratch_thread_exit_init() {
+    hbk_scratch_thread_exit_ready = hbk_os_thread_exit_init(&hbk_scratch_thread_exit, hbk_scratch_arenas_deinit);
+}
+
+hbk_scratch hbk_scratch_begin(hbk_arena* const* conflicts, int64_t conflict_count) {
+    HBK_ASSERT(conflict_count == 0 || conflicts != NULL, "Invalid conflicts pointer");
+
+    if (!hbk_scratch_arenas_initialized) {
+        for (int64_t i = 0; i < HBK_SCRATCH_ARENA_COUNT; i++) {
+            hbk_arena_init(&hbk_scratch_arenas[i], hbk_default_allocator(), NULL, HBK_ARENA_RESERVE_SIZE);
+        }
+
+        hbk_scratch_arenas_initialized = true;
+
+        hbk_os_once_call(&hbk_scratch_thread_exit_once, hbk_scratch_thread_exit_init);
+        if (hbk_scratch_thread_exit_ready) {
+            hbk_os_thread_exit_register(&hbk_scratch_thread_exit, hbk_scratch_arenas);
+        }
+    }
+
+    for (int64_t i = 0; i < HBK_SCRATCH_ARENA_COUNT; i++) {
+        hbk_arena* arena = &hbk_scratch_arenas[i];
+
+        bool is_conflicting = false;
+        for (int64_t j = 0; j < conflict_count; j++) {
+            if (conflicts[j] == arena) {
+                is_conflicting = true;
+                break;
+            }
+        }
+
+        if (!is_conflicting) {
+            return (hbk_scratch){
+                .arena = arena,
+                .savepoint = hbk_arena_mark(arena),
+            };
+        }
+    }
+
+    HBK_ICE(false, "Every scratch arena conflicts, there are only %d of them", HBK_SCRATCH_ARENA_COUNT);
+    return (hbk_scratch){0};
+}
+
+void hbk_scratch_end(hbk_scratch scratch) {
+    HBK_ASSERT(scratch.arena != NULL, "Invalid scratch arena");
+    hbk_arena_rewind(scratch.arena, scratch.savepoint);
+}
+
+void hbk_file_writer_flush(hbk_file_writer* writer) {
+    if (writer->count > 0) {
+        fwrite(writer->buffer, 1, (size_t)writer->count, writer->file);
+        writer->count = 0;
+    }
+}
+
+void hbk_file_writer_write(hbk_file_writer* writer, const void* data, int64_t length) {
+    if (writer->count + length > (int64_t)sizeof writer->buffer) {
+        hbk_file_writer_flush(writer);
+        if (length > (int64_t)sizeof writer->buffer) {
+            fwrite(data, 1, (size_t)length, writer->file);
+            return;
+        }
+    }
+
+    memcpy(writer->buffer + writer->count, data, (size_t)length);
+    writer->count += length;
+}
+
+void hbk_file_writer_write_cstr(hbk_file_writer* writer, const char* cstr) {
+    hbk_file_writer_write(writer, cstr, (int64_t)strlen(cstr));
+}
+
+void hbk_file_writer_write_int(hbk_file_writer* writer, int64_t value) {
+    /// Same as `hbk_string_append_int`: digits backwards, with an unsigned magnitude.
+    char digits[21];
+    int64_t digit_count = 0;
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+    do {
+        digits[sizeof digits - 1 - digit_count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        digits[sizeof digits - 1 - digit_count++] = '-';
+    }
+
+    hbk_file_writer_write(writer, digits + sizeof digits - digit_count, digit_count);
+}
+
+/// @brief The length of the well-formed UTF-8 sequence at the start of `data`, or 0 if there isn't one.
+static int64_t hbk_utf8_sequence_length(const uint8_t* data, int64_t length) {
+    int64_t sequence_length = 0;
+    uint32_t minimum = 0;
+    if (data[0] >= 0xC2 && data[0] <= 0xDF) {
+        sequence_length = 2, minimum = 0x80;
+    } else if ((data[0] & 0xF0) == 0xE0) {
+        sequence_length = 3, minimum = 0x800;
+    } else if (data[0] >= 0xF0 && data[0] <= 0xF4) {
+        sequence_length = 4, minimum = 0x10000;
+    } else {
+        return 0;
+    }
+
+    if (sequence_length > length) {
+        return 0;
+    }
+
+    uint32_t codepoint = data[0] & (0x7F >> sequence_length);
+    for (int64_t i = 1; i < sequence_length; i++) {
+        if ((data[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+
+        codepoint = (codepoint << 6) | (data[i] & 0x3F);
+    }
+
+    if (codepoint < minimum || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+        return 0;
+    }
+
+    return sequence_length;
+}
+
+void hbk_file_writer_write_json_string(hbk_file_writer* writer, hbk_string_view string) {
+    static const char hex_digits[] = "0123456789abcdef";
+
+    hbk_file_writer_write(writer, "\"", 1);
+
+    /// Runs of characters which don't need escaping are written in one go.
+    const uint8_t* data = (const uint8_t*)string.data;
+    int64_t run_start = 0;
+    for (int64_t i = 0; i < string.count;) {
+        uint8_t c = data[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            i++;
+            continue;
+        }
+
+        if (c >= 0x80) {
+            int64_t sequence_length = hbk_utf8_sequence_length(data + i, string.count - i);
+            if (sequence_length > 0) {
+                i += sequence_length;
+                continue;
+            }
+        }
+
+        hbk_file_writer_write(writer, data + run_start, i - run_start);
+        switch (c) {
+            case '"': hbk_file_writer_write(writer, "\\\"", 2); break;
+            case '\\': hbk_file_writer_write(writer, "\\\\", 2); break;
+            case '\n': hbk_file_writer_write(writer, "\\n", 2); break;
+            case '\r': hbk_file_writer_write(writer, "\\r", 2); break;
+            case '\t': hbk_file_writer_write(writer, "\\t", 2); break;
+            default: {
+                if (c >= 0x80) {
+                    hbk_file_writer_write(writer, "\\ufffd", 6);
+                } else {
+                    char escape[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xF]};
+                    hbk_file_writer_write(writer, escape, sizeof escape);
+                }
+            } break;
+        }
+
+        run_start = ++i;
+    }
+
+    hbk_file_writer_write(writer, data + run_start, string.count - run_start);
+    hbk_file_writer_write(writer, "\"", 1);
+}
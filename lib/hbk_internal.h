@@ -25,6 +25,38 @@ typedef enum hbk_error_kind {
 #define HBK_TODO(message) hbk_internal_error(HBK_ERROR_TODO, __FILE__, __LINE__, NULL, "" message "")
 #define HBK_UNREACHABLE hbk_internal_error(HBK_ERROR_UNREACHABLE, __FILE__, __LINE__, NULL, NULL)
 
+/// Instrumentation follows the asserts: it's on unless NDEBUG is defined, but either way
+/// it can be forced with -DHBK_INSTRUMENTATION=0 or 1. Turned off, the macros below expand
+/// to nothing, arguments and all, so release builds don't pay for a single clock read.
+#ifndef HBK_INSTRUMENTATION
+#    ifdef NDEBUG
+#        define HBK_INSTRUMENTATION 0
+#    else
+#        define HBK_INSTRUMENTATION 1
+#    endif
+#endif
+
+#if HBK_INSTRUMENTATION
+/// @brief Starts timing a pass (a `hbk_pass` without the HBK_PASS_ prefix) until the matching HBK_PASS_END in the same scope.
+/// If the state is recording a trace, the pass shows up in it too, with `detail` (a `hbk_string_view`
+/// which outlives the state, like a source name) saying what it worked on.
+#    define HBK_PASS_BEGIN(state, pass, detail) int64_t hbk_pass_start_##pass = hbk_state_begin_pass((state), HBK_PASS_##pass, (detail))
+#    define HBK_PASS_END(state, pass)           hbk_state_end_pass((state), HBK_PASS_##pass, hbk_pass_start_##pass)
+/// @brief Counts a run of a pass which was timed piecemeal rather than as one span, like lexing
+/// tokens as the parser asks for them. It doesn't show up in a trace.
+#    define HBK_PASS_ADD(state, pass, nanoseconds) hbk_state_add_pass_run((state), HBK_PASS_##pass, (nanoseconds))
+/// @brief Leaves time counted for another pass out of a pass begun with HBK_PASS_BEGIN in the same scope.
+#    define HBK_PASS_EXCLUDE(pass, nanoseconds) (hbk_pass_start_##pass += (nanoseconds))
+/// @brief Adds to a counter (a `hbk_counter` without the HBK_COUNTER_ prefix).
+#    define HBK_COUNTER_ADD(state, counter, amount) hbk_state_add_to_counter((state), HBK_COUNTER_##counter, (amount))
+#else
+#    define HBK_PASS_BEGIN(state, pass, detail)     do { } while (0)
+#    define HBK_PASS_END(state, pass)               do { } while (0)
+#    define HBK_PASS_ADD(state, pass, nanoseconds)  do { } while (0)
+#    define HBK_PASS_EXCLUDE(pass, nanoseconds)     do { } while (0)
+#    define HBK_COUNTER_ADD(state, counter, amount) do { } while (0)
+#endif
+
 #define ANSI_COLOR_RESET             "\x1b[0m"
 #define ANSI_COLOR_BLACK             "\x1b[30m"
 #define ANSI_COLOR_RED               "\x1b[31m"
@@ -70,6 +102,71 @@ void hbk_internal_error(hbk_error_kind kind, const char* file_name, int line_num
 
 typedef struct hbk_arena hbk_arena;
 
+/// @brief Allocates from the allocator, treating failure as fatal. Never returns NULL.
+void* hbk_allocator_alloc(const hbk_allocator* allocator, size_t size);
+/// @brief Resizes an allocation from the allocator, treating failure as fatal. Never returns NULL.
+void* hbk_allocator_realloc(const hbk_allocator* allocator, void* memory, size_t old_size, size_t new_size);
+void hbk_allocator_free(const hbk_allocator* allocator, void* memory, size_t size);
+
+/// @brief Keeps count of the memory used by one category of things, see `hbk_memory_usage`.
+/// An account must not be moved once it is initialized, its allocator points back at it.
+typedef struct hbk_memory_account {
+    hbk_memory_usage usage;
+    /// @brief Where memory really comes from.
+    const hbk_allocator* backing;
+    /// @brief Every change is also added to the parent, if there is one, to keep a running total.
+    struct hbk_memory_account* parent;
+    /// @brief Forwards to `backing`, counting everything allocated through it as both reserved and used.
+    hbk_allocator allocator;
+    /// @brief Taken around every change while several threads may be allocating, NULL otherwise.
+    /// Only the account a change starts at is checked, so all accounts of a state share one.
+    struct hbk_os_mutex* mutex;
+} hbk_memory_account;
+
+void hbk_memory_account_init(hbk_memory_account* account, const hbk_allocator* backing, hbk_memory_account* parent);
+/// @brief Adds the given amounts (which may be negative) to the account and its parents, updating their peaks.
+void hbk_memory_account_add(hbk_memory_account* account, int64_t reserved_bytes, int64_t used_bytes, int64_t wasted_bytes);
+
+/// @brief The allocator that everything owned by the state should get its memory from.
+/// Memory allocated from this directly is not counted in any category, so prefer
+/// `hbk_state_get_category_allocator` for anything but arena blocks.
+const hbk_allocator* hbk_state_get_allocator(hbk_state* state);
+/// @brief An allocator which gets its memory from the state's, counting it under the given category.
+const hbk_allocator* hbk_state_get_category_allocator(hbk_state* state, hbk_memory_category category);
+/// @brief The account for the given category, for arenas to report their memory to.
+hbk_memory_account* hbk_state_get_memory_account(hbk_state* state, hbk_memory_category category);
+
+/// @brief Makes the memory accounts, instrumentation and location overflows safe to use from several
+/// threads, until `hbk_state_end_threads`. Only the calling thread may create diagnostics or intern in between.
+void hbk_state_begin_threads(hbk_state* state);
+void hbk_state_end_threads(hbk_state* state);
+/// @brief How many threads a single source may be lexed on, see `hbk_lexer`.
+int64_t hbk_state_get_lex_thread_count(hbk_state* state);
+
+/// @brief Use the HBK_PASS_ macros rather than calling these directly.
+/// @return The time the pass started, to hand back to `hbk_state_end_pass`.
+int64_t hbk_state_begin_pass(hbk_state* state, hbk_pass pass, hbk_string_view detail);
+void hbk_state_end_pass(hbk_state* state, hbk_pass pass, int64_t start_nanoseconds);
+void hbk_state_add_pass_run(hbk_state* state, hbk_pass pass, int64_t nanoseconds);
+void hbk_state_add_to_counter(hbk_state* state, hbk_counter counter, int64_t amount);
+
+/// @brief A source location packed into 64 bits, for storing in tokens and syntax nodes.
+/// `hbk_location` is three 64-bit integers, which is a lot to carry around in every token.
+/// Almost every real location fits in much less, so the common case is packed as:
+///
+///     bit 63     : 0
+///     bits 44-62 : source id (19 bits)
+///     bits 12-43 : offset (32 bits)
+///     bits 0-11  : length (12 bits)
+///
+/// Locations which don't fit (huge files, long tokens or spans, lots of sources) are
+/// stored in a side table in the state instead, and packed as bit 63 set plus the
+/// index into that table. Use `hbk_state_unpack_location` to get the full location back.
+typedef uint64_t hbk_packed_location;
+
+hbk_packed_location hbk_state_pack_location(hbk_state* state, hbk_location location);
+hbk_location hbk_state_unpack_location(hbk_state* state, hbk_packed_location packed_location);
+
 /// @brief "Intern"s the data of the given string. To intern a string,
 /// the state creates a copy of it that it owns and returns to you a view.
 /// This way, all instances of that string can point to the same memory.
@@ -85,9 +182,81 @@ hbk_string_view hbk_state_intern_string_view(hbk_state* state, hbk_string_view s
 /// This way, all instances of that string can point to the same memory.
 /// An interned string is immutable.
 hbk_string_view hbk_state_intern_cstring(hbk_state* state, const char* string);
+/// @brief "Intern"s the data of the given string, returning the symbol for it
+/// rather than a view. Symbols can be compared for equality directly.
+hbk_symbol hbk_state_intern_symbol(hbk_state* state, hbk_string_view sv);
 
+/// @brief The address space a long-lived arena reserves, see `hbk_arena_create_with_allocator`.
+#ifndef HBK_ARENA_RESERVE_SIZE
+#    define HBK_ARENA_RESERVE_SIZE ((size_t)16 << 30)
+#endif
+
+/// @brief Creates an arena which gets its memory, in blocks, from the default allocator.
 hbk_arena* hbk_arena_create();
+/// @brief Creates an arena which gets all of its memory, in blocks, from the given allocator.
+/// The allocator must outlive the arena. If `account` isn't NULL, the arena reports all of its
+/// memory use to it, and it must outlive the arena too.
+/// A non-zero `reserve_size` (usually HBK_ARENA_RESERVE_SIZE) asks the arena to reserve that much
+/// address space up front instead, and commit it as it grows, so it never has to chain blocks.
+/// That is for the few arenas which live long and grow big: a process only has room for a few
+/// thousand reservations. It is ignored for custom allocators, which are there to control where
+/// memory comes from, so the arena won't reserve virtual memory behind their back.
+hbk_arena* hbk_arena_create_with_allocator(const hbk_allocator* allocator, hbk_memory_account* account, size_t reserve_size);
 void hbk_arena_destroy(hbk_arena* arena);
+/// @brief Allocates `count` bytes from the arena, aligned for any type.
+/// There is no upper limit on `count`. The memory is NOT zeroed.
 void* hbk_arena_alloc(hbk_arena* arena, size_t count);
 
+/// @brief A position in an arena's allocations, which the arena can be rewound to.
+typedef struct hbk_arena_savepoint {
+    size_t reserve_allocated;
+    bool reserve_exhausted;
+    int64_t blocks_in_use;
+    size_t block_allocated;
+    int64_t dedicated_chunk_count;
+    size_t used_bytes;
+    size_t wasted_bytes;
+} hbk_arena_savepoint;
+
+/// @brief Records the arena's current position.
+hbk_arena_savepoint hbk_arena_mark(hbk_arena* arena);
+/// @brief Frees everything allocated since `savepoint` was marked. The memory is kept
+/// for the arena to reuse, except for oversized allocations, which are freed outright.
+/// Savepoints must be rewound in the reverse order they were marked in.
+void hbk_arena_rewind(hbk_arena* arena, hbk_arena_savepoint savepoint);
+/// @brief Frees everything allocated from the arena, keeping its memory for reuse.
+void hbk_arena_reset(hbk_arena* arena);
+/// @brief The bytes currently allocated from the arena, not counting padding.
+size_t hbk_arena_used_bytes(hbk_arena* arena);
+
+/// @brief A temporary arena for the current thread, see `hbk_scratch_begin`.
+typedef struct hbk_scratch {
+    hbk_arena* arena;
+    hbk_arena_savepoint savepoint;
+} hbk_scratch;
+
+/// @brief Borrows one of the current thread's scratch arenas for temporary allocations,
+/// which are all freed again by `hbk_scratch_end`.
+/// If you are also allocating into an arena you were given, which might itself be a
+/// scratch arena, pass it in `conflicts` so you get a different one. Otherwise rewinding
+/// your scratch would free the caller's allocations too.
+hbk_scratch hbk_scratch_begin(hbk_arena* const* conflicts, int64_t conflict_count);
+void hbk_scratch_end(hbk_scratch scratch);
+
+/// @brief A small buffer in front of a FILE, so records go out in a few big writes rather than
+/// a call per field or character, without building them up in an `hbk_string` first.
+/// Start with `(hbk_file_writer){.file = file}` and call `hbk_file_writer_flush` when done.
+typedef struct hbk_file_writer {
+    FILE* file;
+    int64_t count;
+    char buffer[8192];
+} hbk_file_writer;
+
+void hbk_file_writer_flush(hbk_file_writer* writer);
+void hbk_file_writer_write(hbk_file_writer* writer, const void* data, int64_t length);
+void hbk_file_writer_write_cstr(hbk_file_writer* writer, const char* cstr);
+void hbk_file_writer_write_int(hbk_file_writer* writer, int64_t value);
+/// @brief Writes the string as a quoted JSON string. Bytes which aren't valid UTF-8 are written as U+FFFD.
+void hbk_file_writer_write_json_string(hbk_file_writer* writer, hbk_string_view string);
+
 #endif // !HBK_API_H
@@ -0,0 +1,281 @@
+#include "hbk_hasmap.h"
+#include "hbk_internal.h"
+#include "hbk_interner.h"
+#include "hbk_os.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+/// Enough shards that threads adding strings rarely want the same one at the same time.
+#define HBK_INTERNER_SHARD_BITS 6
+#define HBK_INTERNER_SHARD_COUNT (1 << HBK_INTERNER_SHARD_BITS)
+
+#define HBK_INTERNER_MIN_TABLE_CAPACITY 64
+
+/// The first segment of entries holds this many, and every one after holds twice as many as the
+/// one before, so a 32-bit symbol always lands in one of the first HBK_INTERNER_SEGMENT_COUNT.
+#define HBK_INTERNER_FIRST_SEGMENT_BITS 10
+#define HBK_INTERNER_SEGMENT_COUNT      (32 - HBK_INTERNER_FIRST_SEGMENT_BITS + 1)
+
+/// @brief An interned string, with its hash cached alongside it.
+typedef struct hbk_interner_entry {
+    hbk_string_view view;
+    uint64_t hash;
+} hbk_interner_entry;
+
+typedef struct hbk_interner_table hbk_interner_table;
+struct hbk_interner_table {
+    /// @brief The table this one replaced, which is kept for readers that may still be probing it.
+    hbk_interner_table* replaced;
+    uint64_t capacity;
+    /// @brief 0 for an empty slot, otherwise the top half of the string's hash in the high 32 bits
+    /// and its symbol plus one in the low 32 bits. Comparing the hashes first means strings are
+    /// only compared when they're very likely to be equal.
+    _Atomic uint64_t slots[];
+};
+
+typedef struct hbk_interner_shard {
+    _Atomic(hbk_interner_table*) table;
+    /// @brief The number of strings in `table`. Only read and written with `mutex` held.
+    int64_t count;
+    /// @brief Held while a string is being added, or the table replaced.
+    hbk_os_mutex mutex;
+} hbk_interner_shard;
+
+struct hbk_interner {
+    hbk_memory_account* account;
+    /// @brief The number of symbols handed out.
+    _Atomic uint32_t count;
+    _Atomic(hbk_interner_entry*) segments[HBK_INTERNER_SEGMENT_COUNT];
+    hbk_interner_shard shards[HBK_INTERNER_SHARD_COUNT];
+};
+
+static size_t hbk_interner_table_size(uint64_t capacity) {
+    return sizeof(hbk_interner_table) + sizeof(_Atomic uint64_t) * capacity;
+}
+
+static int64_t hbk_interner_segment_capacity(int64_t segment) {
+    return (int64_t)1 << (HBK_INTERNER_FIRST_SEGMENT_BITS + segment);
+}
+
+static int64_t hbk_interner_segment_of(hbk_symbol symbol, int64_t* out_offset) {
+    uint64_t group = ((uint64_t)symbol >> HBK_INTERNER_FIRST_SEGMENT_BITS) + 1;
+    int64_t segment = 63 - __builtin_clzll(group);
+    *out_offset = (int64_t)symbol - ((((int64_t)1 << segment) - 1) << HBK_INTERNER_FIRST_SEGMENT_BITS);
+    return segment;
+}
+
+hbk_interner* hbk_interner_create(hbk_memory_account* account) {
+    HBK_ASSERT(account != NULL, "Invalid memory account pointer");
+
+    hbk_interner* interner = hbk_allocator_alloc(&account->allocator, sizeof *interner);
+    *interner = (hbk_interner){
+        .account = account,
+    };
+
+    for (int64_t i = 0; i < HBK_INTERNER_SHARD_COUNT; i++) {
+        hbk_os_mutex_init(&interner->shards[i].mutex);
+    }
+
+    return interner;
+}
+
+void hbk_interner_destroy(hbk_interner* interner) {
+    if (interner == NULL) return;
+    const hbk_allocator* allocator = &interner->account->allocator;
+
+    for (int64_t i = 0; i < HBK_INTERNER_SHARD_COUNT; i++) {
+        hbk_interner_shard* shard = &interner->shards[i];
+        hbk_interner_table* table = atomic_load(&shard->table);
+        while (table != NULL) {
+            hbk_interner_table* replaced = table->replaced;
+            hbk_allocator_free(allocator, table, hbk_interner_table_size(table->capacity));
+            table = replaced;
+        }
+
+        hbk_os_mutex_destroy(&shard->mutex);
+    }
+
+    for (int64_t i = 0; i < HBK_INTERNER_SEGMENT_COUNT; i++) {
+        hbk_interner_entry* segment = atomic_load(&interner->segments[i]);
+        hbk_allocator_free(allocator, segment, sizeof *segment * (size_t)hbk_interner_segment_capacity(i));
+    }
+
+    hbk_allocator_free(allocator, interner, sizeof *interner);
+}
+
+static hbk_interner_entry* hbk_interner_get_entry(hbk_interner* interner, hbk_symbol symbol) {
+    int64_t offset = 0;
+    int64_t segment = hbk_interner_segment_of(symbol, &offset);
+    hbk_interner_entry* entries = atomic_load_explicit(&interner->segments[segment], memory_order_acquire);
+    HBK_ASSERT(entries != NULL, "Invalid symbol");
+    return &entries[offset];
+}
+
+/// @brief Like `hbk_interner_get_entry`, but creates the segment if it isn't there yet.
+/// Writers in two shards can get there at the same time, in which case the one which loses
+/// the race throws its segment away.
+static hbk_interner_entry* hbk_interner_create_entry(hbk_interner* interner, hbk_symbol symbol) {
+    int64_t offset = 0;
+    int64_t segment = hbk_interner_segment_of(symbol, &offset);
+    hbk_interner_entry* entries = atomic_load_explicit(&interner->segments[segment], memory_order_acquire);
+    if (entries == NULL) {
+        size_t size = sizeof *entries * (size_t)hbk_interner_segment_capacity(segment);
+        hbk_interner_entry* new_entries = hbk_allocator_alloc(&interner->account->allocator, size);
+        if (atomic_compare_exchange_strong_explicit(&interner->segments[segment], &entries, new_entries, memory_order_acq_rel, memory_order_acquire)) {
+            entries = new_entries;
+        } else {
+            hbk_allocator_free(&interner->account->allocator, new_entries, size);
+        }
+    }
+
+    return &entries[offset];
+}
+
+/// @brief Probes the table for the string, without locking.
+/// @return The value of the string's slot, or 0 if it isn't there, in which case `out_slot` is the
+/// empty slot where it would go. The value has to be used as it is: reading the slot again with
+/// anything weaker than an acquire could see a string some other thread has only just added.
+static uint64_t hbk_interner_find(hbk_interner* interner, hbk_interner_table* table, const char* string, int64_t length, uint64_t hash, hbk_interner_local* local, _Atomic uint64_t** out_slot) {
+    *out_slot = NULL;
+    if (table == NULL) {
+        return 0;
+    }
+
+    uint64_t tag = hash >> 32;
+    uint64_t mask = table->capacity - 1;
+    for (uint64_t index = hash & mask;; index = (index + 1) & mask) {
+        local->probe_count++;
+
+        _Atomic uint64_t* slot = &table->slots[index];
+        uint64_t value = atomic_load_explicit(slot, memory_order_acquire);
+        if (value == 0) {
+            *out_slot = slot;
+            return 0;
+        }
+
+        if (value >> 32 == tag) {
+            hbk_interner_entry* entry = hbk_interner_get_entry(interner, (hbk_symbol)(value & 0xFFFFFFFF) - 1);
+            if (entry->hash == hash && entry->view.count == length && 0 == memcmp(entry->view.data, string, (size_t)length)) {
+                return value;
+            }
+        }
+    }
+}
+
+/// @brief Moves the shard over to a table twice the size. The shard must be locked.
+static hbk_interner_table* hbk_interner_grow(hbk_interner* interner, hbk_interner_shard* shard, hbk_interner_table* table) {
+    uint64_t capacity = table == NULL ? HBK_INTERNER_MIN_TABLE_CAPACITY : table->capacity * 2;
+    hbk_interner_table* new_table = hbk_allocator_alloc(&interner->account->allocator, hbk_interner_table_size(capacity));
+    new_table->replaced = table;
+    new_table->capacity = capacity;
+    for (uint64_t i = 0; i < capacity; i++) {
+        atomic_init(&new_table->slots[i], 0);
+    }
+
+    /// Nobody can see the new table yet, and every string in the old one is unique,
+    /// so moving them over only needs an empty slot for each.
+    uint64_t mask = capacity - 1;
+    for (uint64_t i = 0; table != NULL && i < table->capacity; i++) {
+        uint64_t value = atomic_load_explicit(&table->slots[i], memory_order_relaxed);
+        if (value == 0) {
+            continue;
+        }
+
+        hbk_interner_entry* entry = hbk_interner_get_entry(interner, (hbk_symbol)(value & 0xFFFFFFFF) - 1);
+        uint64_t index = entry->hash & mask;
+        while (atomic_load_explicit(&new_table->slots[index], memory_order_relaxed) != 0) {
+            index = (index + 1) & mask;
+        }
+
+        atomic_store_explicit(&new_table->slots[index], value, memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&shard->table, new_table, memory_order_release);
+    return new_table;
+}
+
+hbk_symbol hbk_interner_intern(hbk_interner* interner, hbk_interner_local* local, const char* string, int64_t length) {
+    HBK_ASSERT(interner != NULL, "Invalid interner pointer");
+    HBK_ASSERT(local != NULL && local->arena != NULL, "Invalid interner local pointer");
+    HBK_ASSERT(length >= 0, "Invalid string length");
+
+    /// An empty `hbk_string` is just a NULL vector, but slots need real data to compare against.
+    if (string == NULL) {
+        HBK_ASSERT(length == 0, "NULL string data with a non-zero length");
+        string = "";
+    }
+
+    uint64_t hash = hbk_hash_bytes(string, length);
+    hbk_interner_shard* shard = &interner->shards[hash >> (64 - HBK_INTERNER_SHARD_BITS)];
+    local->lookup_count++;
+
+    hbk_interner_table* table = atomic_load_explicit(&shard->table, memory_order_acquire);
+    _Atomic uint64_t* slot = NULL;
+    uint64_t value = hbk_interner_find(interner, table, string, length, hash, local, &slot);
+    if (value != 0) {
+        local->hit_count++;
+        return (hbk_symbol)(value & 0xFFFFFFFF) - 1;
+    }
+
+    /// Another thread may have added the string, or replaced the table, since we looked.
+    hbk_os_mutex_lock(&shard->mutex);
+
+    table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    value = hbk_interner_find(interner, table, string, length, hash, local, &slot);
+    if (value != 0) {
+        hbk_os_mutex_unlock(&shard->mutex);
+        local->hit_count++;
+        return (hbk_symbol)(value & 0xFFFFFFFF) - 1;
+    }
+
+    /// Keep the load factor at or below 3/4, like `hbk_hashmap` does.
+    if (table == NULL || (shard->count + 1) * 4 > (int64_t)table->capacity * 3) {
+        table = hbk_interner_grow(interner, shard, table);
+        (void)hbk_interner_find(interner, table, string, length, hash, local, &slot);
+    }
+
+    uint32_t symbol = atomic_fetch_add_explicit(&interner->count, 1, memory_order_relaxed);
+    HBK_ASSERT(symbol < UINT32_MAX, "Too many interned strings for a 32-bit symbol");
+
+    char* data = hbk_arena_alloc(local->arena, (size_t)length + 1);
+    memcpy(data, string, (size_t)length);
+    data[length] = 0;
+
+    *hbk_interner_create_entry(interner, symbol) = (hbk_interner_entry){
+        .view = {data, length},
+        .hash = hash,
+    };
+
+    /// The entry has to be complete before anyone can find the slot.
+    atomic_store_explicit(slot, (hash >> 32 << 32) | ((uint64_t)symbol + 1), memory_order_release);
+    shard->count++;
+
+    hbk_os_mutex_unlock(&shard->mutex);
+    return symbol;
+}
+
+hbk_string_view hbk_interner_view(hbk_interner* interner, hbk_symbol symbol) {
+    HBK_ASSERT(interner != NULL, "Invalid interner pointer");
+    HBK_ASSERT(symbol < atomic_load_explicit(&interner->count, memory_order_relaxed), "Invalid symbol");
+    return hbk_interner_get_entry(interner, symbol)->view;
+}
+
+int64_t hbk_interner_count(hbk_interner* interner) {
+    HBK_ASSERT(interner != NULL, "Invalid interner pointer");
+    return atomic_load_explicit(&interner->count, memory_order_relaxed);
+}
+
+int64_t hbk_interner_capacity(hbk_interner* interner) {
+    HBK_ASSERT(interner != NULL, "Invalid interner pointer");
+
+    int64_t capacity = 0;
+    for (int64_t i = 0; i < HBK_INTERNER_SHARD_COUNT; i++) {
+        hbk_interner_table* table = atomic_load_explicit(&interner->shards[i].table, memory_order_acquire);
+        if (table != NULL) {
+            capacity += (int64_t)table->capacity;
+        }
+    }
+
+    return capacity;
+}
@@ -0,0 +1,51 @@
+#ifndef HBK_INTERNER_H
+#define HBK_INTERNER_H
+
+#include "hbk_internal.h"
+
+#include <hibiku.h>
+#include <stdint.h>
+
+/// A string interner which any number of threads can use at once.
+///
+/// Strings are spread over shards by their hash, and each shard has its own open-addressing
+/// table. Looking a string up never takes a lock: writers publish a slot with a release store
+/// only once the string it points to is complete, so readers just probe. That covers the common
+/// case, an identifier which has been seen before, without a single shared write. Adding a string
+/// locks only its shard. A table which has been outgrown is kept until the interner is destroyed,
+/// since a reader may still be probing it.
+///
+/// Symbols are handed out densely from 0, and the strings they stand for live in segments
+/// which never move, so looking up a symbol's string doesn't lock either.
+
+typedef struct hbk_interner hbk_interner;
+
+/// @brief What a thread brings along to the interner: where the bytes of new strings go, and
+/// its own counts, so that threads never write to shared counters. Only one thread may use it at a time.
+typedef struct hbk_interner_local {
+    hbk_arena* arena;
+    /// @brief The number of strings looked up.
+    int64_t lookup_count;
+    /// @brief The number of lookups which found an existing string.
+    int64_t hit_count;
+    /// @brief The number of table slots inspected, including those inspected to insert a string.
+    int64_t probe_count;
+} hbk_interner_local;
+
+/// @brief Creates an empty interner, which allocates its tables through the account.
+hbk_interner* hbk_interner_create(hbk_memory_account* account);
+void hbk_interner_destroy(hbk_interner* interner);
+
+/// @brief Returns the symbol for the string, adding a copy of it to `local->arena` if it's new.
+/// The copy is NUL-terminated, and stays where it is for as long as the arena does.
+hbk_symbol hbk_interner_intern(hbk_interner* interner, hbk_interner_local* local, const char* string, int64_t length);
+/// @brief The string a symbol stands for. Any thread which has the symbol can call this.
+hbk_string_view hbk_interner_view(hbk_interner* interner, hbk_symbol symbol);
+
+/// @brief The number of unique strings interned.
+int64_t hbk_interner_count(hbk_interner* interner);
+/// @brief The number of slots in all of the shards' current tables.
+/// Like the count, this is only exact while no other thread is interning.
+int64_t hbk_interner_capacity(hbk_interner* interner);
+
+#endif // !HBK_INTERNER_H
@@ -1,8 +1,26 @@
+#include "hbk_hasmap.h"
 #include "hbk_lex.h"
+#include "hbk_os.h"
+#include "hbk_parallel.h"
+#include "hbk_scan.h"
 
+#include <stdarg.h>
 #include <stddef.h>
 #include <string.h>
 
+/// @brief A NUL-terminated spelling for every single character token kind, two bytes apart.
+static bool single_character_spellings_initialized = false;
+static char single_character_spellings[256 * 2] = {};
+
+static void hbk_single_character_spellings_init() {
+    if (single_character_spellings_initialized) return;
+    for (int i = 0; i < 256; i++) {
+        single_character_spellings[i * 2] = (char)i;
+    }
+
+    single_character_spellings_initialized = true;
+}
+
 const char* hbk_token_kind_to_cstring(hbk_token_kind kind) {
     switch (kind) {
         case HBK_TOKEN_INVALID: return "INVALID";
@@ -14,44 +32,159 @@ const char* hbk_token_kind_to_cstring(hbk_token_kind kind) {
 #undef TK
 
         default: {
-            HBK_ASSERT(kind > 0 && kind < 256, "Invalid/unknown hbk_token_kind, cannot stringify it");
+            HBK_ASSERT(kind > 0 && kind < __HBK_TOKEN_MULTIBYTE_START__, "Invalid/unknown hbk_token_kind, cannot stringify it");
+            hbk_single_character_spellings_init();
+            return &single_character_spellings[(int)kind * 2];
+        }
+    }
+}
 
-            static bool characters_initialized = false;
-            static char characters[256 * 2] = {};
+/// @brief The length of each token kind with a fixed spelling, or 0 for kinds without one.
+static const uint8_t token_kind_lengths[256] = {
+#define TK(N, ...) [HBK_TOKEN_##N] = sizeof("" __VA_ARGS__) - 1,
+    HBK_TOKEN_KINDS(TK)
+#undef TK
+};
 
-            if (!characters_initialized) {
-                characters_initialized = true;
-                for (int i = 0; i < 256; i++) {
-                    characters[i * 2] = (char)i;
-                }
-            }
+bool hbk_token_kind_has_payload(hbk_token_kind kind) {
+    switch (kind) {
+        default: return false;
 
-            return &characters[(int)kind * 2];
-        }
+        case HBK_TOKEN_INVALID:
+        case HBK_TOKEN_IDENTIFIER:
+        case HBK_TOKEN_STRING_LITERAL:
+        case HBK_TOKEN_CHARACTER_LITERAL:
+        case HBK_TOKEN_INTEGER_LITERAL: return true;
+    }
+}
+
+static int64_t hbk_token_kind_length(hbk_token_kind kind) {
+    HBK_ASSERT(!hbk_token_kind_has_payload(kind), "Tokens with a payload store their own length");
+
+    /// Everything below the multibyte start is a single ASCII character.
+    if (kind < __HBK_TOKEN_MULTIBYTE_START__) {
+        return 1;
     }
+
+    HBK_ASSERT(token_kind_lengths[kind] != 0, "Token kind has no fixed length");
+    return token_kind_lengths[kind];
 }
 
 typedef struct keyword_info {
     hbk_token_kind kind;
     const char* keyword_image;
+    int64_t keyword_length;
 } keyword_info;
 
 static keyword_info keyword_infos[] = {
-#define KW(N, I) {HBK_TOKEN_##N, I},
+#define KW(N, I) {HBK_TOKEN_##N, I, sizeof(I) - 1},
     HBK_TOKEN_KW_KINDS(KW)
 #undef KW
-        {0, NULL}
+        {0, NULL, 0}
 };
 
-typedef struct hbk_lexer {
-    hbk_state* state;
-    hbk_source_id source_id;
+/// The number of slots in the keyword hash table. Must be a power of two.
+#define HBK_KEYWORD_TABLE_SIZE 64
+
+/// @brief A perfect hash table for keyword lookup, built once from `keyword_infos`.
+/// The hash only looks at the length and the first and last characters of a word,
+/// and we search for a multiplier which gives every keyword its own slot. That way
+/// classifying an identifier is a single hash, a length check and one memcmp.
+static struct {
+    bool initialized;
+    uint32_t multiplier;
+    int64_t min_length;
+    int64_t max_length;
+    /// @brief One plus the index into `keyword_infos` for each slot, or 0 if the slot is empty.
+    uint8_t slots[HBK_KEYWORD_TABLE_SIZE];
+} keyword_table;
+
+static uint32_t hbk_keyword_hash(uint32_t multiplier, const char* text, int64_t length) {
+    uint32_t first = (uint8_t)text[0];
+    uint32_t last = (uint8_t)text[length - 1];
+    return (first + last * multiplier + (uint32_t)length * 2) & (HBK_KEYWORD_TABLE_SIZE - 1);
+}
+
+static void hbk_keyword_table_init() {
+    if (keyword_table.initialized) return;
+
+    keyword_table.min_length = INT64_MAX;
+    for (int64_t i = 0; keyword_infos[i].kind != 0; i++) {
+        if (keyword_infos[i].keyword_length < keyword_table.min_length) keyword_table.min_length = keyword_infos[i].keyword_length;
+        if (keyword_infos[i].keyword_length > keyword_table.max_length) keyword_table.max_length = keyword_infos[i].keyword_length;
+    }
+
+    for (uint32_t multiplier = 1; multiplier < 256; multiplier++) {
+        memset(keyword_table.slots, 0, sizeof keyword_table.slots);
+
+        bool is_perfect = true;
+        for (int64_t i = 0; keyword_infos[i].kind != 0 && is_perfect; i++) {
+            uint32_t hash = hbk_keyword_hash(multiplier, keyword_infos[i].keyword_image, keyword_infos[i].keyword_length);
+            if (keyword_table.slots[hash] != 0) {
+                is_perfect = false;
+            } else {
+                keyword_table.slots[hash] = (uint8_t)(i + 1);
+            }
+        }
+
+        if (is_perfect) {
+            keyword_table.multiplier = multiplier;
+            keyword_table.initialized = true;
+            return;
+        }
+    }
+
+    HBK_ICE(false, "Could not find a perfect hash for the keyword table, try increasing HBK_KEYWORD_TABLE_SIZE");
+}
+
+/// @brief Returns the keyword token kind for the given word, or HBK_TOKEN_IDENTIFIER if it is not a keyword.
+static hbk_token_kind hbk_keyword_kind(hbk_string_view text) {
+    HBK_ASSERT(keyword_table.initialized, "The keyword table must be initialized before lexing");
+
+    if (text.count < keyword_table.min_length || text.count > keyword_table.max_length) {
+        return HBK_TOKEN_IDENTIFIER;
+    }
+
+    uint8_t slot = keyword_table.slots[hbk_keyword_hash(keyword_table.multiplier, text.data, text.count)];
+    if (slot == 0) {
+        return HBK_TOKEN_IDENTIFIER;
+    }
+
+    keyword_info* info = &keyword_infos[slot - 1];
+    if (info->keyword_length != text.count || 0 != memcmp(info->keyword_image, text.data, (size_t)text.count)) {
+        return HBK_TOKEN_IDENTIFIER;
+    }
 
-    /// @brief The source text being read by the lexer.
-    hbk_string_view text;
-    /// @brief The current character index within the source text.
-    int64_t position;
-} hbk_lexer;
+    return info->kind;
+}
+
+/// @brief A part of the source text which is lexed on its own, see `hbk_lexer`.
+struct hbk_lex_chunk {
+    /// @brief The chunk is lexed from `begin` until a token would start at or after `end`.
+    /// Tokens, comments and literals can run on past `end`.
+    int64_t begin;
+    int64_t end;
+    hbk_token_buffer tokens;
+    hbk_vector(hbk_lex_deferred_diagnostic) diagnostics;
+    /// @brief Where the lexer stopped: the first position at or after `end` that a token could start at.
+    int64_t exit_position;
+
+    /// @brief The tokens in [first_token, token_end) are the ones lexing the whole text from the
+    /// start would have produced, and their payloads are [first_payload, payload_end).
+    int64_t first_token;
+    int64_t token_end;
+    int64_t first_payload;
+    int64_t payload_end;
+    /// @brief The diagnostics from `first_diagnostic` on are the ones which go with the kept tokens.
+    int64_t first_diagnostic;
+    /// @brief The strings interned by the kept tokens, in the order they first appear. Until the
+    /// chunks are put together, a token's symbol is an index in here.
+    hbk_vector(hbk_string_view) strings;
+    hbk_vector(hbk_symbol) symbols;
+    /// @brief Where the kept tokens and payloads go in the combined buffer.
+    int64_t output_token;
+    int64_t output_payload;
+};
 
 /// @brief Return the character at the current position of this lexer.
 /// @return The current character if not at the end of the file, otherwise 0.
@@ -101,6 +234,34 @@ static hbk_string_view hbk_lexer_view_from_location(hbk_lexer* l, hbk_location l
     };
 }
 
+static void hbk_lexer_error(hbk_lexer* l, hbk_location location, const char* format, ...) {
+    va_list v;
+    va_start(v, format);
+
+    if (l->chunk == NULL) {
+        (void)hbk_diagnostic_create_formatv(l->state, HBK_DIAG_ERROR, location, format, v);
+    } else {
+        hbk_lex_deferred_diagnostic diag = {
+            .step_position = l->step_position,
+            .token_count = l->step_token_count,
+            .kind = HBK_DIAG_ERROR,
+            .location = location,
+        };
+
+        hbk_vector_init(diag.message, hbk_state_get_category_allocator(l->state, HBK_MEMORY_DIAGNOSTICS));
+        hbk_string_append_formatv(&diag.message, format, v);
+        hbk_vector_push(l->chunk->diagnostics, diag);
+    }
+
+    va_end(v);
+}
+
+/// @brief Chunks leave their symbols to be interned once it's known which tokens are kept.
+static hbk_symbol hbk_lexer_intern(hbk_lexer* l, hbk_string_view sv) {
+    if (l->chunk != NULL) return HBK_SYMBOL_EMPTY;
+    return hbk_state_intern_symbol(l->state, sv);
+}
+
 static bool is_identifier_start(int c) {
     /// We know the ranges of ASCII values for these characters, and they are continuous.
     /// 'a' is always the first lowercase letter, and 'z' is always the last. This is
@@ -111,28 +272,29 @@ static bool is_identifier_start(int c) {
     return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c >= 256;
 }
 
-static bool is_identifier_part(int c) {
-    /// The same as identifier start, but including digits.
-    /// Identifiers cannot start with numbers, but they may contain them.
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 256;
-}
-
 static bool is_digit(int c) {
     return (c >= '0' && c <= '9');
 }
 
-static bool is_space(int c) {
-    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v';
-}
-
 static void hbk_lexer_skip_whitespace(hbk_lexer* l) {
+    /// The whitespace and comment scanning here goes through the hbk_scan kernels,
+    /// which look at many bytes at once rather than advancing one at a time.
     while (!hbk_lexer_is_eof(l)) {
-        if (is_space(hbk_lexer_current_char(l))) {
-            hbk_lexer_advance(l);
-        } else if (hbk_lexer_current_char(l) == '/' && hbk_lexer_peek_char(l) == '/') {
-            while (!hbk_lexer_is_eof(l) && hbk_lexer_current_char(l) != '\n') {
-                hbk_lexer_advance(l);
-            }
+        /// Most whitespace between tokens is a single space, which isn't worth a kernel call.
+        /// The source text is always NUL-terminated, so looking one byte ahead is fine.
+        const char* current = l->text.data + l->position;
+        if (current[0] == ' ' && current[1] != ' ' && current[1] != '\t' && current[1] != '\n' && current[1] != '\r' && current[1] != '\v') {
+            l->position++;
+            continue;
+        }
+
+        l->position = hbk_scan_skip_whitespace(l->text.data, l->position, l->text.count);
+        if (hbk_lexer_is_eof(l)) {
+            break;
+        }
+
+        if (hbk_lexer_current_char(l) == '/' && hbk_lexer_peek_char(l) == '/') {
+            l->position = hbk_scan_find_byte(l->text.data, l->position, l->text.count, '\n');
         } else if (hbk_lexer_current_char(l) == '/' && hbk_lexer_peek_char(l) == '*') {
             // TODO(local): track multiple locations for each open, so we can report unclosed
             // bloc comments more accurately if there are multiple.
@@ -152,6 +314,15 @@ static void hbk_lexer_skip_whitespace(hbk_lexer* l) {
             int last_char = 0;
 
             while (nesting > 0 && !hbk_lexer_is_eof(l)) {
+                /// Only '*' and '/' can open or close a comment, so skip straight to the next one.
+                /// Anything we skip over is neither, so it resets the tracked character.
+                int64_t delimiter_position = hbk_scan_find_either(l->text.data, l->position, l->text.count, '*', '/');
+                if (delimiter_position != l->position) {
+                    l->position = delimiter_position;
+                    last_char = 0;
+                    continue;
+                }
+
                 int curr_char = hbk_lexer_current_char(l);
                 /// if the last character was * and the current is /, then we're closing one
                 /// of the nested comments.
@@ -176,7 +347,7 @@ static void hbk_lexer_skip_whitespace(hbk_lexer* l) {
             /// properly close some of the block comments. Report an error letting the user
             /// know that something went wrong somewhere.
             if (nesting > 0) {
-                (void)hbk_diagnostic_create_format(l->state, HBK_DIAG_ERROR, start_location, "Unfinished block comment.");
+                hbk_lexer_error(l, start_location, "Unfinished block comment.");
             }
         } else {
             break;
@@ -359,39 +530,36 @@ static hbk_token hbk_lexer_read_token(hbk_lexer* l) {
 
             hbk_lexer_advance(l);
 
-            int nchars = 0;
-            hbk_string string_data = NULL;
-
-            while (!hbk_lexer_is_eof(l) && hbk_lexer_current_char(l) != delim) {
-                char c = hbk_lexer_current_char(l);
-                hbk_lexer_advance(l);
+            /// We don't support escape sequences yet, so the contents of the literal
+            /// are exactly the source text up to the closing delimiter.
+            int64_t contents_start = l->position;
+            l->position = hbk_scan_find_byte(l->text.data, l->position, l->text.count, delim);
 
-                if (is_char_lit) {
-                    if (nchars == 0) {
-                        token.integer_value = c;
-                    }
-                } else {
-                    hbk_vector_push(string_data, (char)c);
-                }
+            int64_t nchars = l->position - contents_start;
+            token.location.length += nchars;
 
-                token.location.length++;
-                nchars++;
+            if (is_char_lit && nchars > 0) {
+                token.integer_value = l->text.data[contents_start];
             }
 
             if (hbk_lexer_current_char(l) != delim) {
-                (void)hbk_diagnostic_create_format(l->state, HBK_DIAG_ERROR, token.location, "Unfinished %s literal.", is_char_lit ? "character" : "string");
+                hbk_lexer_error(l, token.location, "Unfinished %s literal.", is_char_lit ? "character" : "string");
             } else {
                 hbk_lexer_advance(l);
                 token.location.length++;
             }
 
             if (is_char_lit) {
-                if (nchars != 0) {
-                    (void)hbk_diagnostic_create_format(l->state, HBK_DIAG_ERROR, token.location, "Character literals must contain exactly one character.");
+                if (nchars != 1) {
+                    hbk_lexer_error(l, token.location, "Character literals must contain exactly one character.");
                 }
             } else {
-                token.string_value = hbk_state_intern_string(l->state, string_data);
-                hbk_vector_free(string_data);
+                hbk_string_view contents = {
+                    .data = l->text.data + contents_start,
+                    .count = nchars,
+                };
+
+                token.symbol = hbk_lexer_intern(l, contents);
             }
 
             token.kind = is_char_lit ? HBK_TOKEN_CHARACTER_LITERAL : HBK_TOKEN_STRING_LITERAL;
@@ -399,25 +567,16 @@ static hbk_token hbk_lexer_read_token(hbk_lexer* l) {
 
         default: {
             if (is_identifier_start(hbk_lexer_current_char(l))) {
-                token.location.length = 0;
-                while (is_identifier_part(hbk_lexer_current_char(l))) {
-                    hbk_lexer_advance(l);
-                    token.location.length++;
-                }
-
-                token.kind = HBK_TOKEN_IDENTIFIER;
-                token.string_value = hbk_state_intern_string_view(l->state, hbk_lexer_view_from_location(l, token.location));
-
-                for (int64_t i = 0; keyword_infos[i].kind != 0 && token.kind == HBK_TOKEN_IDENTIFIER; i++) {
-                    size_t keyword_length = strlen(keyword_infos[i].keyword_image);
-                    if (token.string_value.count < (int64_t)keyword_length) {
-                        continue;
-                    }
-
-                    if (0 == strncmp(keyword_infos[i].keyword_image, token.string_value.data, token.string_value.count)) {
-                        token.kind = keyword_infos[i].kind;
-                        token.string_value = (hbk_string_view){};
-                    }
+                int64_t identifier_start = l->position;
+                l->position = hbk_scan_skip_identifier(l->text.data, l->position, l->text.count);
+                token.location.length = l->position - identifier_start;
+
+                /// Keywords are classified straight from the source text, so they never
+                /// have to go through the interner at all.
+                hbk_string_view identifier_text = hbk_lexer_view_from_location(l, token.location);
+                token.kind = hbk_keyword_kind(identifier_text);
+                if (token.kind == HBK_TOKEN_IDENTIFIER) {
+                    token.symbol = hbk_lexer_intern(l, identifier_text);
                 }
             } else if (is_digit(hbk_lexer_current_char(l))) {
                 token.location.length = 0;
@@ -434,35 +593,579 @@ static hbk_token hbk_lexer_read_token(hbk_lexer* l) {
 
                 token.kind = HBK_TOKEN_INTEGER_LITERAL;
             } else {
-                (void)hbk_diagnostic_create_format(l->state, HBK_DIAG_ERROR, token.location, "Invalid character '%c' in source text.", hbk_lexer_current_char(l));
-                token.string_value = hbk_state_intern_string_view(l->state, hbk_lexer_view_from_location(l, token.location));
+                hbk_lexer_error(l, token.location, "Invalid character '%c' in source text.", hbk_lexer_current_char(l));
+                token.symbol = hbk_lexer_intern(l, hbk_lexer_view_from_location(l, token.location));
                 hbk_lexer_advance(l);
             }
         } break;
     }
 
+    /// Multi-character operators don't update the length as they go, so make sure
+    /// every token covers exactly the characters we consumed for it.
+    token.location.length = l->position - token.location.offset;
     return token;
 }
 
-hbk_vector(hbk_token) hbk_lex(hbk_state* state, hbk_source_id source_id) {
+static void hbk_lex_init_once() {
+    hbk_keyword_table_init();
+    hbk_scan_init();
+    hbk_single_character_spellings_init();
+}
+
+void hbk_lex_init() {
+    /// The tables are plain statics, so the first lexer on any thread builds them, and
+    /// every other one waits for that before it reads them.
+    static hbk_os_once once = HBK_OS_ONCE_INIT;
+    hbk_os_once_call(&once, hbk_lex_init_once);
+}
+
+/// @brief Reads the next token from the text, along with the whitespace after it.
+/// @return false at the lexer's end, or once the error limit has been reached.
+static bool hbk_lexer_lex_token(hbk_lexer* l, hbk_token* out_token) {
+    if (!l->has_started) {
+        l->has_started = true;
+        l->step_position = l->position;
+        l->step_token_count = 0;
+        hbk_lexer_skip_whitespace(l);
+    }
+
+    if (l->position >= l->end || hbk_state_has_reached_error_limit(l->state)) {
+        return false;
+    }
+
+    l->step_position = l->position;
+    l->step_token_count = l->token_count + 1;
+    *out_token = hbk_lexer_read_token(l);
+
+    /// Whatever is wrong in the whitespace after a token is reported before the limit is checked
+    /// again, so it belongs with the token.
+    l->step_position = l->position;
+    hbk_lexer_skip_whitespace(l);
+
+    l->token_count++;
+    return true;
+}
+
+/// @brief Creates the held back diagnostics which come before the lexer has read `token_count` tokens.
+static void hbk_lexer_create_deferred_diagnostics(hbk_lexer* l, int64_t token_count) {
+    for (; l->diagnostic_index < hbk_vector_count(l->diagnostics); l->diagnostic_index++) {
+        hbk_lex_deferred_diagnostic* diag = &l->diagnostics[l->diagnostic_index];
+        if (diag->token_count > token_count) break;
+        (void)hbk_diagnostic_create(l->state, diag->kind, diag->location, diag->message);
+    }
+}
+
+/// @brief Reads the next token lexed ahead of time, at the same point `hbk_lexer_lex_token` would have lexed it.
+static bool hbk_lexer_read_prelexed_token(hbk_lexer* l, hbk_token* out_token) {
+    if (!l->has_started) {
+        l->has_started = true;
+        hbk_lexer_create_deferred_diagnostics(l, 0);
+    }
+
+    if (l->token_count >= hbk_token_buffer_count(&l->tokens) || hbk_state_has_reached_error_limit(l->state)) {
+        return false;
+    }
+
+    hbk_lexer_create_deferred_diagnostics(l, l->token_count + 1);
+    *out_token = hbk_token_buffer_get(&l->tokens, l->token_count, l->payload_index);
+    if (hbk_token_kind_has_payload(out_token->kind)) {
+        l->payload_index++;
+    }
+
+    l->token_count++;
+    return true;
+}
+
+static void hbk_token_buffer_init(hbk_state* state, hbk_token_buffer* buffer, hbk_source_id source_id) {
+    const hbk_allocator* allocator = hbk_state_get_category_allocator(state, HBK_MEMORY_TOKENS);
+
+    *buffer = (hbk_token_buffer){
+        .source_id = source_id,
+    };
+
+    hbk_vector_init(buffer->kinds, allocator);
+    hbk_vector_init(buffer->offsets, allocator);
+    hbk_vector_init(buffer->payloads, allocator);
+}
+
+static void hbk_token_buffer_push(hbk_token_buffer* buffer, hbk_token token) {
+    hbk_vector_push(buffer->kinds, (uint8_t)token.kind);
+    hbk_vector_push(buffer->offsets, (uint32_t)token.location.offset);
+
+    if (hbk_token_kind_has_payload(token.kind)) {
+        hbk_token_payload payload = {
+            .length = (uint32_t)token.location.length,
+            .symbol = token.symbol,
+            .integer_value = token.integer_value,
+        };
+
+        hbk_vector_push(buffer->payloads, payload);
+    } else {
+        HBK_ASSERT(token.location.length == hbk_token_kind_length(token.kind), "Token length does not match its kind");
+    }
+}
+
+/// Below this, a chunk isn't worth a thread: the tokens it saves lexing are outweighed
+/// by handing it out and putting the results back together.
+#ifndef HBK_LEX_MIN_CHUNK_SIZE
+#    define HBK_LEX_MIN_CHUNK_SIZE (256 * 1024)
+#endif
+
+/// More chunks than threads, so a thread which gets an easy one can steal from the others.
+#define HBK_LEX_CHUNKS_PER_THREAD 4
+
+typedef struct hbk_lex_parallel_context {
+    /// @brief The lexer the chunks are lexed for, which gets the combined tokens.
+    hbk_lexer* lexer;
+    hbk_vector(hbk_lex_chunk) chunks;
+} hbk_lex_parallel_context;
+
+static void hbk_lex_chunk_reset(hbk_state* state, hbk_lex_chunk* chunk, hbk_source_id source_id) {
+    hbk_token_buffer_destroy(&chunk->tokens);
+    hbk_token_buffer_init(state, &chunk->tokens, source_id);
+
+    for (int64_t i = 0; i < hbk_vector_count(chunk->diagnostics); i++) {
+        hbk_vector_free(chunk->diagnostics[i].message);
+    }
+
+    hbk_vector_set_count(chunk->diagnostics, 0);
+}
+
+static void hbk_lex_chunk_run(hbk_lex_parallel_context* context, hbk_lex_chunk* chunk, int64_t position) {
     hbk_lexer lexer = {
+        .state = context->lexer->state,
+        .source_id = context->lexer->source_id,
+        .text = context->lexer->text,
+        .position = position,
+        .end = chunk->end,
+        .chunk = chunk,
+    };
+
+    hbk_token token;
+    while (hbk_lexer_lex_token(&lexer, &token)) {
+        hbk_token_buffer_push(&chunk->tokens, token);
+    }
+
+    chunk->exit_position = lexer.position;
+}
+
+static void hbk_lex_chunk_task(void* context, int64_t worker_index, int64_t task_index) {
+    (void)worker_index;
+    hbk_lex_parallel_context* lex_context = context;
+    hbk_lex_chunk* chunk = &lex_context->chunks[task_index];
+    hbk_lex_chunk_run(lex_context, chunk, chunk->begin);
+}
+
+/// @brief The index of the chunk's token at `offset`, or -1 if no token starts there.
+static int64_t hbk_lex_chunk_find_token(hbk_lex_chunk* chunk, int64_t offset) {
+    int64_t low = 0;
+    int64_t high = hbk_vector_count(chunk->tokens.offsets);
+    while (low < high) {
+        int64_t middle = low + (high - low) / 2;
+        if (chunk->tokens.offsets[middle] < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < hbk_vector_count(chunk->tokens.offsets) && chunk->tokens.offsets[low] == offset) {
+        return low;
+    }
+
+    return -1;
+}
+
+/// @brief Works out which of each chunk's tokens and diagnostics are right.
+///
+/// Lexing is only ever in one of two places: reading a token, or skipping whitespace and comments
+/// between them. After skipping, it's at a position a token starts at, and from there on it does
+/// exactly what it would have done however it got there. So a chunk's tokens are right from the
+/// first one that starts where the chunk before it really stopped. If the chunk started inside a
+/// string literal or block comment and never lines up with the real tokens, it's lexed again
+/// from where the chunk before it stopped. (Line comments can't be started inside of, since
+/// chunks start at the beginning of a line.)
+static void hbk_lex_fix_up_chunks(hbk_lex_parallel_context* context) {
+    hbk_state* state = context->lexer->state;
+    int64_t position = 0;
+
+    for (int64_t i = 0; i < hbk_vector_count(context->chunks); i++) {
+        hbk_lex_chunk* chunk = &context->chunks[i];
+        int64_t token_count = hbk_vector_count(chunk->tokens.kinds);
+
+        /// A comment or literal from an earlier chunk can cover this one completely.
+        if (position >= chunk->end) {
+            chunk->first_token = token_count;
+            chunk->token_end = token_count;
+            chunk->first_diagnostic = hbk_vector_count(chunk->diagnostics);
+            continue;
+        }
+
+        chunk->first_token = 0;
+        if (position != chunk->begin) {
+            int64_t first_token = hbk_lex_chunk_find_token(chunk, position);
+            if (first_token >= 0) {
+                chunk->first_token = first_token;
+            } else if (chunk->exit_position == position) {
+                chunk->first_token = token_count;
+            } else {
+                HBK_COUNTER_ADD(state, RELEXED_CHUNKS, 1);
+                hbk_lex_chunk_reset(state, chunk, context->lexer->source_id);
+                hbk_lex_chunk_run(context, chunk, position);
+            }
+        }
+
+        chunk->token_end = hbk_vector_count(chunk->tokens.kinds);
+
+        /// Everything lexed before `position` was a guess which didn't pan out, and is dropped.
+        chunk->first_diagnostic = 0;
+        while (chunk->first_diagnostic < hbk_vector_count(chunk->diagnostics) && chunk->diagnostics[chunk->first_diagnostic].step_position < position) {
+            chunk->first_diagnostic++;
+        }
+
+        position = chunk->exit_position;
+    }
+}
+
+static bool hbk_token_kind_is_interned(hbk_token_kind kind) {
+    return kind == HBK_TOKEN_IDENTIFIER || kind == HBK_TOKEN_STRING_LITERAL || kind == HBK_TOKEN_INVALID;
+}
+
+/// @brief The text `hbk_lexer_read_token` interns for a token, worked out again from where it is.
+static hbk_string_view hbk_token_interned_text(hbk_string_view text, hbk_token_kind kind, int64_t offset, int64_t length) {
+    if (kind != HBK_TOKEN_STRING_LITERAL) {
+        return (hbk_string_view){.data = text.data + offset, .count = length};
+    }
+
+    /// The contents can't contain the delimiter, so if the last character is one the literal was closed.
+    bool is_closed = length >= 2 && text.data[offset + length - 1] == '"';
+    return (hbk_string_view){.data = text.data + offset + 1, .count = length - (is_closed ? 2 : 1)};
+}
+
+/// @brief Gives each of the chunk's strings a number in the order they first appear in its kept tokens.
+/// Interning the chunks' strings in chunk order afterwards then hands out the same symbols as lexing serially.
+static void hbk_lex_collect_strings_task(void* context, int64_t worker_index, int64_t task_index) {
+    (void)worker_index;
+    hbk_lex_parallel_context* lex_context = context;
+    hbk_state* state = lex_context->lexer->state;
+    hbk_lex_chunk* chunk = &lex_context->chunks[task_index];
+    hbk_token_buffer* tokens = &chunk->tokens;
+
+    hbk_hashmap strings_map;
+    hbk_hashmap_init(&strings_map, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+    hbk_vector_init(chunk->strings, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+
+    int64_t payload_index = 0;
+    for (int64_t i = 0; i < chunk->token_end; i++) {
+        if (i == chunk->first_token) {
+            chunk->first_payload = payload_index;
+        }
+
+        hbk_token_kind kind = (hbk_token_kind)tokens->kinds[i];
+        if (!hbk_token_kind_has_payload(kind)) continue;
+
+        hbk_token_payload* payload = &tokens->payloads[payload_index++];
+        if (i < chunk->first_token || !hbk_token_kind_is_interned(kind)) continue;
+
+        hbk_string_view string = hbk_token_interned_text(lex_context->lexer->text, kind, tokens->offsets[i], payload->length);
+        int64_t string_index = hbk_vector_count(chunk->strings);
+        if (hbk_hashmap_try_insert(&strings_map, string, hbk_hash_bytes(string.data, string.count), string_index, &string_index)) {
+            hbk_vector_push(chunk->strings, string);
+        }
+
+        payload->symbol = (hbk_symbol)string_index;
+    }
+
+    if (chunk->first_token == chunk->token_end) {
+        chunk->first_payload = payload_index;
+    }
+
+    chunk->payload_end = payload_index;
+    hbk_hashmap_destroy(&strings_map);
+}
+
+static void hbk_lex_copy_chunk_task(void* context, int64_t worker_index, int64_t task_index) {
+    (void)worker_index;
+    hbk_lex_parallel_context* lex_context = context;
+    hbk_lex_chunk* chunk = &lex_context->chunks[task_index];
+    hbk_token_buffer* tokens = &chunk->tokens;
+    hbk_token_buffer* output = &lex_context->lexer->tokens;
+
+    int64_t token_count = chunk->token_end - chunk->first_token;
+    if (token_count > 0) {
+        memcpy(output->kinds + chunk->output_token, tokens->kinds + chunk->first_token, (size_t)token_count * sizeof *tokens->kinds);
+        memcpy(output->offsets + chunk->output_token, tokens->offsets + chunk->first_token, (size_t)token_count * sizeof *tokens->offsets);
+    }
+
+    int64_t payload_index = chunk->output_payload;
+    for (int64_t i = chunk->first_token; i < chunk->token_end; i++) {
+        hbk_token_kind kind = (hbk_token_kind)tokens->kinds[i];
+        if (!hbk_token_kind_has_payload(kind)) continue;
+
+        hbk_token_payload payload = tokens->payloads[chunk->first_payload + payload_index - chunk->output_payload];
+        if (hbk_token_kind_is_interned(kind)) {
+            payload.symbol = chunk->symbols[payload.symbol];
+        }
+
+        output->payloads[payload_index++] = payload;
+    }
+}
+
+/// @brief Lexes the whole source ahead of time in chunks, see `hbk_lexer`.
+/// @return false if the source is too small to be worth it, having done nothing.
+static bool hbk_lexer_lex_chunks(hbk_lexer* l, int64_t thread_count) {
+    hbk_state* state = l->state;
+    int64_t chunk_count = thread_count * HBK_LEX_CHUNKS_PER_THREAD;
+    if (chunk_count > l->text.count / HBK_LEX_MIN_CHUNK_SIZE) {
+        chunk_count = l->text.count / HBK_LEX_MIN_CHUNK_SIZE;
+    }
+
+    /// Past the error limit there's nothing to lex, and lexing as it goes already knows that.
+    if (chunk_count <= 1 || hbk_state_has_reached_error_limit(state)) {
+        return false;
+    }
+
+    HBK_PASS_BEGIN(state, LEX, hbk_state_get_source_name(state, l->source_id));
+
+    hbk_lex_parallel_context context = {
+        .lexer = l,
+    };
+
+    /// Chunks start at the beginning of a line, where a token is most likely to start.
+    hbk_vector_init(context.chunks, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+    int64_t begin = 0;
+    for (int64_t i = 1; i <= chunk_count && begin < l->text.count; i++) {
+        int64_t end = l->text.count;
+        if (i < chunk_count) {
+            end = hbk_scan_find_byte(l->text.data, l->text.count * i / chunk_count, l->text.count, '\n');
+            end = end < l->text.count ? end + 1 : end;
+        }
+
+        if (end <= begin) continue;
+
+        hbk_lex_chunk chunk = {
+            .begin = begin,
+            .end = end,
+        };
+
+        hbk_token_buffer_init(state, &chunk.tokens, l->source_id);
+        hbk_vector_init(chunk.diagnostics, hbk_state_get_category_allocator(state, HBK_MEMORY_DIAGNOSTICS));
+        hbk_vector_push(context.chunks, chunk);
+        begin = end;
+    }
+
+    chunk_count = hbk_vector_count(context.chunks);
+    HBK_COUNTER_ADD(state, LEX_CHUNKS, chunk_count);
+
+    hbk_state_begin_threads(state);
+    hbk_parallel_for(chunk_count, thread_count, hbk_lex_chunk_task, &context);
+    hbk_state_end_threads(state);
+
+    hbk_lex_fix_up_chunks(&context);
+
+    hbk_state_begin_threads(state);
+    hbk_parallel_for(chunk_count, thread_count, hbk_lex_collect_strings_task, &context);
+    hbk_state_end_threads(state);
+
+    hbk_vector_init(l->diagnostics, hbk_state_get_category_allocator(state, HBK_MEMORY_DIAGNOSTICS));
+
+    int64_t output_token = 0;
+    int64_t output_payload = 0;
+    for (int64_t i = 0; i < chunk_count; i++) {
+        hbk_lex_chunk* chunk = &context.chunks[i];
+        chunk->output_token = output_token;
+        chunk->output_payload = output_payload;
+        output_token += chunk->token_end - chunk->first_token;
+        output_payload += chunk->payload_end - chunk->first_payload;
+
+        hbk_vector_init(chunk->symbols, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+        for (int64_t j = 0; j < hbk_vector_count(chunk->strings); j++) {
+            hbk_vector_push(chunk->symbols, hbk_state_intern_symbol(state, chunk->strings[j]));
+        }
+
+        /// The kept diagnostics move over to the lexer, counting tokens from the start of the source.
+        for (int64_t j = 0; j < hbk_vector_count(chunk->diagnostics); j++) {
+            hbk_lex_deferred_diagnostic diag = chunk->diagnostics[j];
+            if (j < chunk->first_diagnostic) {
+                hbk_vector_free(diag.message);
+                continue;
+            }
+
+            diag.token_count += chunk->output_token - chunk->first_token;
+            hbk_vector_push(l->diagnostics, diag);
+        }
+
+        hbk_vector_set_count(chunk->diagnostics, 0);
+    }
+
+    hbk_token_buffer_init(state, &l->tokens, l->source_id);
+    hbk_vector_set_count(l->tokens.kinds, output_token);
+    hbk_vector_set_count(l->tokens.offsets, output_token);
+    hbk_vector_set_count(l->tokens.payloads, output_payload);
+
+    hbk_state_begin_threads(state);
+    hbk_parallel_for(chunk_count, thread_count, hbk_lex_copy_chunk_task, &context);
+    hbk_state_end_threads(state);
+
+    for (int64_t i = 0; i < chunk_count; i++) {
+        hbk_lex_chunk* chunk = &context.chunks[i];
+        hbk_token_buffer_destroy(&chunk->tokens);
+        hbk_vector_free(chunk->diagnostics);
+        hbk_vector_free(chunk->strings);
+        hbk_vector_free(chunk->symbols);
+    }
+
+    hbk_vector_free(context.chunks);
+
+    HBK_PASS_END(state, LEX);
+    HBK_COUNTER_ADD(state, TOKENS, output_token);
+
+    return true;
+}
+
+void hbk_lexer_init(hbk_lexer* l, hbk_state* state, hbk_source_id source_id, int64_t thread_count) {
+    HBK_ASSERT(l != NULL, "Invalid lexer pointer");
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(thread_count >= 0, "The thread count can't be negative");
+
+    hbk_lex_init();
+
+    *l = (hbk_lexer){
         .state = state,
         .source_id = source_id,
+        .text = hbk_state_get_source_text(state, source_id),
     };
 
-    lexer.text = hbk_state_get_source_text(state, source_id);
-    HBK_ASSERT(lexer.text.data != NULL, "Invalid lexer source text");
-    HBK_ASSERT(lexer.text.data[lexer.text.count] == 0, "Invalid lexer source text (not NUL-terminated)");
+    HBK_ASSERT(l->text.data != NULL, "Invalid lexer source text");
+    HBK_ASSERT(l->text.data[l->text.count] == 0, "Invalid lexer source text (not NUL-terminated)");
+    l->end = l->text.count;
+
+    /// Token offsets are 32 bits, so a bigger source gets an error and no tokens at all.
+    if (l->text.count > UINT32_MAX) {
+        hbk_lexer_error(l, hbk_location_create(source_id, 0, 0), "Source is too big: %lld bytes, but sources can be at most 4 GiB.", (long long)l->text.count);
+        l->text.count = 0;
+        l->end = 0;
+        return;
+    }
+
+    if (thread_count == 0) {
+        thread_count = hbk_os_processor_count();
+    }
+
+    if (thread_count > 1) {
+        l->is_prelexed = hbk_lexer_lex_chunks(l, thread_count);
+    }
+}
 
-    hbk_vector(hbk_token) tokens = NULL;
+void hbk_lexer_destroy(hbk_lexer* l) {
+    if (l == NULL) return;
 
-    hbk_lexer_skip_whitespace(&lexer);
-    while (!hbk_lexer_is_eof(&lexer)) {
-        hbk_token token = hbk_lexer_read_token(&lexer);
-        hbk_lexer_skip_whitespace(&lexer);
+    /// Tokens lexed ahead of time were counted and timed then.
+    if (!l->is_prelexed) {
+        HBK_PASS_ADD(l->state, LEX, l->lex_nanoseconds);
+        HBK_COUNTER_ADD(l->state, TOKENS, l->token_count);
+    }
 
-        hbk_vector_push(tokens, token);
+    hbk_token_buffer_destroy(&l->tokens);
+    for (int64_t i = 0; i < hbk_vector_count(l->diagnostics); i++) {
+        hbk_vector_free(l->diagnostics[i].message);
     }
 
-    return tokens;
+    hbk_vector_free(l->diagnostics);
+}
+
+hbk_token hbk_lexer_peek(hbk_lexer* l, int64_t offset) {
+    HBK_ASSERT(l != NULL, "Invalid lexer pointer");
+    HBK_ASSERT(offset >= 0 && offset < HBK_LEXER_LOOKAHEAD, "The lexer can only peek a few tokens ahead");
+
+    while (l->lookahead_count <= offset) {
+        hbk_token token;
+        bool has_token;
+        if (l->is_prelexed) {
+            has_token = hbk_lexer_read_prelexed_token(l, &token);
+        } else {
+#if HBK_INSTRUMENTATION
+            int64_t start = hbk_os_monotonic_nanoseconds();
+            has_token = hbk_lexer_lex_token(l, &token);
+            l->lex_nanoseconds += hbk_os_monotonic_nanoseconds() - start;
+#else
+            has_token = hbk_lexer_lex_token(l, &token);
+#endif
+        }
+        if (!has_token) {
+            token = (hbk_token){
+                .kind = HBK_TOKEN_EOF,
+                .location = hbk_location_create(l->source_id, l->text.count, 0),
+            };
+        }
+
+        l->lookahead[(l->lookahead_start + l->lookahead_count) & (HBK_LEXER_LOOKAHEAD - 1)] = token;
+        l->lookahead_count++;
+    }
+
+    return l->lookahead[(l->lookahead_start + offset) & (HBK_LEXER_LOOKAHEAD - 1)];
+}
+
+hbk_token hbk_lexer_next(hbk_lexer* l) {
+    hbk_token token = hbk_lexer_peek(l, 0);
+    l->lookahead_start = (l->lookahead_start + 1) & (HBK_LEXER_LOOKAHEAD - 1);
+    l->lookahead_count--;
+    return token;
+}
+
+hbk_token_buffer hbk_lex_parallel(hbk_state* state, hbk_source_id source_id, int64_t thread_count) {
+    hbk_lexer lexer;
+    hbk_lexer_init(&lexer, state, source_id, thread_count);
+
+    hbk_token_buffer buffer;
+    hbk_token_buffer_init(state, &buffer, source_id);
+
+    /// The lexer times itself as one LEX run, whether it lexed ahead of time or lexes as it goes,
+    /// so copying the tokens out isn't timed again.
+    hbk_token token = hbk_lexer_next(&lexer);
+    for (; token.kind != HBK_TOKEN_EOF; token = hbk_lexer_next(&lexer)) {
+        hbk_token_buffer_push(&buffer, token);
+    }
+
+    hbk_lexer_destroy(&lexer);
+    return buffer;
+}
+
+hbk_token_buffer hbk_lex(hbk_state* state, hbk_source_id source_id) {
+    return hbk_lex_parallel(state, source_id, hbk_state_get_lex_thread_count(state));
+}
+
+void hbk_token_buffer_destroy(hbk_token_buffer* buffer) {
+    if (buffer == NULL) return;
+    hbk_vector_free(buffer->kinds);
+    hbk_vector_free(buffer->offsets);
+    hbk_vector_free(buffer->payloads);
+}
+
+int64_t hbk_token_buffer_count(hbk_token_buffer* buffer) {
+    HBK_ASSERT(buffer != NULL, "Invalid token buffer pointer");
+    return hbk_vector_count(buffer->kinds);
+}
+
+hbk_token hbk_token_buffer_get(hbk_token_buffer* buffer, int64_t index, int64_t payload_index) {
+    HBK_ASSERT(buffer != NULL, "Invalid token buffer pointer");
+    HBK_ASSERT(index >= 0 && index < hbk_vector_count(buffer->kinds), "Token index out of range");
+
+    hbk_token token = {
+        .kind = (hbk_token_kind)buffer->kinds[index],
+    };
+
+    int64_t length = 0;
+    if (hbk_token_kind_has_payload(token.kind)) {
+        HBK_ASSERT(payload_index >= 0 && payload_index < hbk_vector_count(buffer->payloads), "Token payload index out of range");
+        hbk_token_payload payload = buffer->payloads[payload_index];
+        length = payload.length;
+        token.symbol = payload.symbol;
+        token.integer_value = payload.integer_value;
+    } else {
+        length = hbk_token_kind_length(token.kind);
+    }
+
+    token.location = hbk_location_create(buffer->source_id, buffer->offsets[index], length);
+    return token;
 }
@@ -31,55 +31,181 @@
     X(BOOL, "bool")           \
     X(FLOAT, "float")
 
-#define HBK_TOKEN_KINDS(X) \
-    X(PLUSPLUS)            \
-    X(MINUSMINUS)          \
-    X(LESSLESS)            \
-    X(GREATERGREATER)      \
-    X(EQUALEQUAL)          \
-    X(BANGEQUAL)           \
-    X(PLUSEQUAL)           \
-    X(MINUSEQUAL)          \
-    X(SLASHEQUAL)          \
-    X(STAREQUAL)           \
-    X(PERCENTEQUAL)        \
-    X(LESSEQUAL)           \
-    X(GREATEREQUAL)        \
-    X(AMPERSANDEQUAL)      \
-    X(PIPEEQUAL)           \
-    X(TILDEEQUAL)          \
-    X(LESSLESSEQUAL)       \
-    X(GREATERGREATEREQUAL) \
-    X(EQUALGREATER)        \
-    X(STRING_LITERAL)      \
-    X(CHARACTER_LITERAL)   \
-    X(INTEGER_LITERAL)     \
-    X(IDENTIFIER)          \
+/// Token kinds with a fixed spelling have it as their second argument.
+/// The ones without can be any length, and carry a payload in the token buffer.
+#define HBK_TOKEN_KINDS(X)              \
+    X(PLUSPLUS, "++")                   \
+    X(MINUSMINUS, "--")                 \
+    X(LESSLESS, "<<")                   \
+    X(GREATERGREATER, ">>")             \
+    X(EQUALEQUAL, "==")                 \
+    X(BANGEQUAL, "!=")                  \
+    X(PLUSEQUAL, "+=")                  \
+    X(MINUSEQUAL, "-=")                 \
+    X(SLASHEQUAL, "/=")                 \
+    X(STAREQUAL, "*=")                  \
+    X(PERCENTEQUAL, "%=")               \
+    X(LESSEQUAL, "<=")                  \
+    X(GREATEREQUAL, ">=")               \
+    X(AMPERSANDEQUAL, "&=")             \
+    X(PIPEEQUAL, "|=")                  \
+    X(TILDEEQUAL, "~=")                 \
+    X(LESSLESSEQUAL, "<<=")             \
+    X(GREATERGREATEREQUAL, ">>=")       \
+    X(EQUALGREATER, "=>")               \
+    X(STRING_LITERAL)                   \
+    X(CHARACTER_LITERAL)                \
+    X(INTEGER_LITERAL)                  \
+    X(IDENTIFIER)                       \
     HBK_TOKEN_KW_KINDS(X)
 
 typedef enum hbk_token_kind {
     HBK_TOKEN_INVALID = 0,
     HBK_TOKEN_EOF = 1,
 
-    __HBK_TOKEN_MULTIBYTE_START__ = 255,
+    /// Single-character tokens use their ASCII value as their kind, and all of those
+    /// are below 127. Starting the rest from there keeps every kind within a byte.
+    __HBK_TOKEN_MULTIBYTE_START__ = 127,
 #define TK(N, ...) HBK_TOKEN_##N,
     HBK_TOKEN_KINDS(TK)
 #undef TK
+    __HBK_TOKEN_KIND_COUNT__,
 } hbk_token_kind;
 
+static_assert(__HBK_TOKEN_KIND_COUNT__ <= 256, "Token kinds must fit in a byte for hbk_token_buffer");
+
+/// @brief A single token, decoded from a `hbk_token_buffer`.
+/// Tokens are not stored like this, this is just the convenient form to work with.
 typedef struct hbk_token {
     hbk_token_kind kind;
+    /// @brief The interned text of identifiers and string literals.
+    hbk_symbol symbol;
     hbk_location location;
     int64_t integer_value;
-    hbk_string_view string_value;
 } hbk_token;
 
+/// @brief The extra data for tokens which need more than a kind and an offset:
+/// identifiers, literals and invalid characters.
+typedef struct hbk_token_payload {
+    /// @brief The length of the token in the source text.
+    uint32_t length;
+    hbk_symbol symbol;
+    int64_t integer_value;
+} hbk_token_payload;
+
+/// @brief The tokens of a source, stored as a structure of arrays.
+/// Most tokens are punctuation or keywords whose length follows from their kind,
+/// so each token only gets a byte for its kind and four for its offset. The tokens
+/// which carry a value also get a `hbk_token_payload`, in the order they appear.
+/// That means the payload index of a token is the number of payload-carrying tokens
+/// before it, which whatever reads the buffer keeps track of as it walks forward.
+typedef struct hbk_token_buffer {
+    hbk_source_id source_id;
+    hbk_vector(uint8_t) kinds;
+    hbk_vector(uint32_t) offsets;
+    hbk_vector(hbk_token_payload) payloads;
+} hbk_token_buffer;
+
 /// @brief Get a constant C string name for the token kind.
 const char* hbk_token_kind_to_cstring(hbk_token_kind kind);
 
-/// @brief Reads all of the tokens from the source text into a vector.
-/// For simplicity in implementing other parts of this compiler,
-/// we don't support reading individual tokens at a time.
-hbk_vector(hbk_token) hbk_lex(hbk_state* state, hbk_source_id source_id);
+/// @brief Returns true if tokens of this kind have an entry in `hbk_token_buffer.payloads`.
+bool hbk_token_kind_has_payload(hbk_token_kind kind);
+
+/// @brief Sets up the lexer's global tables, the first time it's called on any thread.
+/// `hbk_lexer_init` does this itself.
+void hbk_lex_init();
+
+/// @brief A diagnostic found while lexing ahead, which is only created once the lexer gets to it.
+typedef struct hbk_lex_deferred_diagnostic {
+    /// @brief Where the token, or the whitespace after one, that this came from started.
+    int64_t step_position;
+    /// @brief The number of tokens read once the lexer is past it, which is also the number which
+    /// are kept if it reaches the error limit.
+    int64_t token_count;
+    hbk_diagnostic_kind kind;
+    hbk_location location;
+    hbk_string message;
+} hbk_lex_deferred_diagnostic;
+
+/// @brief The most tokens `hbk_lexer_peek` can look ahead, plus one.
+#define HBK_LEXER_LOOKAHEAD 4
+static_assert((HBK_LEXER_LOOKAHEAD & (HBK_LEXER_LOOKAHEAD - 1)) == 0, "The lookahead ring is indexed with a mask");
+
+typedef struct hbk_lex_chunk hbk_lex_chunk;
+
+/// @brief Reads the tokens of a source one at a time, as they're asked for. Only the few tokens
+/// that have been peeked at are kept, so lexing takes the same little memory however big the source is.
+///
+/// A large source can instead be lexed ahead of time on several threads. The text is cut into
+/// chunks at line starts, and each is lexed on its own as if a token started there. That guess
+/// is wrong when the chunk starts inside a string literal or block comment, so the chunks are
+/// checked in order against where the one before them really ended, and any which never line
+/// up are lexed again. The identifiers and strings are interned once it's known which tokens are
+/// kept, in the order they appear, and diagnostics are held back until the lexer reaches their
+/// token, so the tokens, symbols and diagnostics are exactly those of lexing as it goes. The only
+/// difference is that past the error limit, the strings of tokens which are never read are interned too.
+typedef struct hbk_lexer {
+    hbk_state* state;
+    hbk_source_id source_id;
+
+    /// @brief The source text being read by the lexer.
+    hbk_string_view text;
+    /// @brief The current character index within the source text.
+    int64_t position;
+    /// @brief No token is started at or after this, which is the end of the text unless this is lexing a chunk.
+    int64_t end;
+    /// @brief The number of tokens read so far.
+    int64_t token_count;
+    /// @brief Set once the whitespace before the first token has been skipped.
+    bool has_started;
+    /// @brief The time spent lexing tokens as they were asked for, which is counted as a LEX run
+    /// when the lexer is destroyed. Only kept with HBK_INSTRUMENTATION.
+    int64_t lex_nanoseconds;
+
+    /// @brief Set while lexing a chunk. Nothing is interned and no diagnostics are created then,
+    /// since the chunk may turn out to have started in the middle of something.
+    hbk_lex_chunk* chunk;
+    /// @brief Where the token or whitespace being read started, and the number of tokens there will be
+    /// once it's read. This is what a deferred diagnostic needs to know to be placed again.
+    int64_t step_position;
+    int64_t step_token_count;
+
+    /// @brief Set when the source was lexed ahead of time, in which case tokens are read from
+    /// `tokens`, and `diagnostics` are created as the tokens they go with are read.
+    bool is_prelexed;
+    hbk_token_buffer tokens;
+    int64_t payload_index;
+    hbk_vector(hbk_lex_deferred_diagnostic) diagnostics;
+    int64_t diagnostic_index;
+
+    /// @brief The tokens which have been peeked at but not consumed yet, as a ring.
+    hbk_token lookahead[HBK_LEXER_LOOKAHEAD];
+    int64_t lookahead_start;
+    int64_t lookahead_count;
+} hbk_lexer;
+
+/// @brief Prepares to read the tokens of a source. Nothing is read yet, unless the source is big enough
+/// to be worth lexing ahead of time on up to `thread_count` threads (0 means one per processor).
+/// A source over 4 GiB is reported as an error, and reads as if it were empty.
+void hbk_lexer_init(hbk_lexer* l, hbk_state* state, hbk_source_id source_id, int64_t thread_count);
+void hbk_lexer_destroy(hbk_lexer* l);
+/// @brief Reads and consumes the next token. Past the end of the source, or once the error limit
+/// has been reached, this returns EOF tokens.
+hbk_token hbk_lexer_next(hbk_lexer* l);
+/// @brief Returns the token `offset` tokens ahead of the next one, without consuming anything.
+hbk_token hbk_lexer_peek(hbk_lexer* l, int64_t offset);
+
+/// @brief Reads all of the tokens from the source text into a token buffer, with `hbk_lexer_next`.
+/// This uses as many threads as the state has to spare, see `hbk_state_parse_all`.
+hbk_token_buffer hbk_lex(hbk_state* state, hbk_source_id source_id);
+/// @brief Like `hbk_lex`, but on up to `thread_count` threads (0 means one per processor).
+hbk_token_buffer hbk_lex_parallel(hbk_state* state, hbk_source_id source_id, int64_t thread_count);
+
+void hbk_token_buffer_destroy(hbk_token_buffer* buffer);
+int64_t hbk_token_buffer_count(hbk_token_buffer* buffer);
+/// @brief Decodes the token at `index`. If the token carries a payload, it is read
+/// from `payload_index`, which must be the number of payload-carrying tokens before it.
+hbk_token hbk_token_buffer_get(hbk_token_buffer* buffer, int64_t index, int64_t payload_index);
 
 #endif // !HKB_LEX_H
@@ -0,0 +1,380 @@
+/// MAP_ANONYMOUS and friends are not part of the POSIX version we ask for in
+/// the build flags, so opt in to the full set of platform definitions here.
+/// `mremap` is Linux only, and needs everything GNU.
+#define _DEFAULT_SOURCE
+#if defined(__linux__)
+#    define _GNU_SOURCE
+#endif
+
+#include "hbk_os.h"
+#include "hbk_internal.h"
+
+#if HBK_OS_HAS_MMAP
+#    include <fcntl.h>
+#    include <string.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#if HBK_OS_HAS_MMAP
+
+size_t hbk_os_page_size() {
+    /// Not cached, since states can be created on several threads at once, and it's cheap anyway.
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+bool hbk_os_map_file(const char* file_path, hbk_os_file_mapping* out_mapping) {
+    HBK_ASSERT(file_path != NULL, "Invalid file_path pointer");
+    HBK_ASSERT(out_mapping != NULL, "Invalid mapping pointer");
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat file_stat = {};
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t file_length = (size_t)file_stat.st_size;
+    size_t page_size = hbk_os_page_size();
+
+    /// Reserve enough zeroed, anonymous memory for the file plus at least one
+    /// extra byte, then map the file over the start of it. The kernel zero-fills
+    /// the rest of the last page of a file mapping, and if the file ends right on
+    /// a page boundary the byte after it falls into the anonymous page instead.
+    /// Either way, the text is NUL-terminated without copying a single byte.
+    size_t mapping_size = (file_length + 1 + page_size - 1) & ~(page_size - 1);
+    void* base = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    void* file_base = mmap(base, file_length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    close(fd);
+
+    if (file_base == MAP_FAILED) {
+        munmap(base, mapping_size);
+        return false;
+    }
+
+    HBK_ASSERT(file_base == base, "MAP_FIXED mapping ended up somewhere else");
+
+    /// The lexer reads the text front to back, so let the kernel read ahead aggressively.
+    posix_madvise(base, file_length, POSIX_MADV_SEQUENTIAL);
+
+    *out_mapping = (hbk_os_file_mapping){
+        .data = base,
+        .length = (int64_t)file_length,
+        .base = base,
+        .size = mapping_size,
+    };
+
+    HBK_ASSERT(out_mapping->data[out_mapping->length] == 0, "File mapping was not NUL-terminated");
+    return true;
+}
+
+void hbk_os_unmap_file(hbk_os_file_mapping* mapping) {
+    if (mapping == NULL || mapping->base == NULL) return;
+    munmap(mapping->base, mapping->size);
+    *mapping = (hbk_os_file_mapping){};
+}
+
+void* hbk_os_reserve(size_t size) {
+    HBK_ASSERT(size > 0 && size % hbk_os_page_size() == 0, "Reservations must be a non-zero number of pages");
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#    ifdef MAP_NORESERVE
+    /// Don't count the reservation against the commit limit, we're only after the addresses.
+    flags |= MAP_NORESERVE;
+#    endif
+
+    void* address = mmap(NULL, size, PROT_NONE, flags, -1, 0);
+    if (address == MAP_FAILED) {
+        return NULL;
+    }
+
+    return address;
+}
+
+bool hbk_os_commit(void* address, size_t size) {
+    HBK_ASSERT(address != NULL, "Invalid address pointer");
+    HBK_ASSERT((uintptr_t)address % hbk_os_page_size() == 0 && size % hbk_os_page_size() == 0, "Commits must be page-aligned");
+    return 0 == mprotect(address, size, PROT_READ | PROT_WRITE);
+}
+
+void hbk_os_release(void* address, size_t size) {
+    if (address == NULL) return;
+    munmap(address, size);
+}
+
+static size_t hbk_os_round_to_pages(size_t size) {
+    size_t page_size = hbk_os_page_size();
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+void* hbk_os_allocate_pages(size_t size) {
+    HBK_ASSERT(size > 0, "Can't allocate zero pages");
+
+    void* address = mmap(NULL, hbk_os_round_to_pages(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (address == MAP_FAILED) {
+        return NULL;
+    }
+
+    return address;
+}
+
+void* hbk_os_reallocate_pages(void* address, size_t old_size, size_t new_size) {
+    HBK_ASSERT(address != NULL, "Invalid address pointer");
+    HBK_ASSERT(new_size > 0, "Can't reallocate to zero pages");
+
+    old_size = hbk_os_round_to_pages(old_size);
+    new_size = hbk_os_round_to_pages(new_size);
+    if (old_size == new_size) {
+        return address;
+    }
+
+#    if HBK_OS_HAS_MREMAP
+    void* new_address = mremap(address, old_size, new_size, MREMAP_MAYMOVE);
+    if (new_address == MAP_FAILED) {
+        return NULL;
+    }
+#    else
+    void* new_address = hbk_os_allocate_pages(new_size);
+    if (new_address == NULL) {
+        return NULL;
+    }
+
+    memcpy(new_address, address, old_size < new_size ? old_size : new_size);
+    munmap(address, old_size);
+#    endif
+
+    return new_address;
+}
+
+void hbk_os_free_pages(void* address, size_t size) {
+    if (address == NULL) return;
+    munmap(address, hbk_os_round_to_pages(size));
+}
+
+#else // !HBK_OS_HAS_MMAP
+
+bool hbk_os_map_file(const char* file_path, hbk_os_file_mapping* out_mapping) {
+    return false;
+}
+
+void hbk_os_unmap_file(hbk_os_file_mapping* mapping) {}
+
+size_t hbk_os_page_size() {
+    return 4096;
+}
+
+void* hbk_os_reserve(size_t size) {
+    return NULL;
+}
+
+bool hbk_os_commit(void* address, size_t size) {
+    return false;
+}
+
+void hbk_os_release(void* address, size_t size) {}
+
+void* hbk_os_allocate_pages(size_t size) {
+    return NULL;
+}
+
+void* hbk_os_reallocate_pages(void* address, size_t old_size, size_t new_size) {
+    return NULL;
+}
+
+void hbk_os_free_pages(void* address, size_t size) {}
+
+#endif // HBK_OS_HAS_MMAP
+
+#if defined(_WIN32)
+
+#    define NOMINMAX
+#    include <Windows.h>
+
+int64_t hbk_os_monotonic_nanoseconds() {
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    /// Split the division so the multiplication can't overflow for long uptimes.
+    int64_t seconds = counter.QuadPart / frequency.QuadPart;
+    int64_t remainder = counter.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000 + remainder * 1000000000 / frequency.QuadPart;
+}
+
+int64_t hbk_os_processor_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int64_t)info.dwNumberOfProcessors : 1;
+}
+
+static DWORD WINAPI hbk_os_thread_entry(LPVOID parameter) {
+    hbk_os_thread* thread = parameter;
+    thread->function(thread->argument);
+    return 0;
+}
+
+bool hbk_os_thread_start(hbk_os_thread* thread, void (*function)(void* argument), void* argument) {
+    thread->function = function;
+    thread->argument = argument;
+    thread->handle = CreateThread(NULL, 0, hbk_os_thread_entry, thread, 0, NULL);
+    return thread->handle != NULL;
+}
+
+void hbk_os_thread_join(hbk_os_thread* thread) {
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    thread->handle = NULL;
+}
+
+static_assert(sizeof(SRWLOCK) == sizeof(void*), "hbk_os_mutex assumes an SRWLOCK is the size of a pointer");
+
+void hbk_os_mutex_init(hbk_os_mutex* mutex) {
+    InitializeSRWLock((SRWLOCK*)&mutex->handle);
+}
+
+void hbk_os_mutex_destroy(hbk_os_mutex* mutex) {}
+
+void hbk_os_mutex_lock(hbk_os_mutex* mutex) {
+    AcquireSRWLockExclusive((SRWLOCK*)&mutex->handle);
+}
+
+void hbk_os_mutex_unlock(hbk_os_mutex* mutex) {
+    ReleaseSRWLockExclusive((SRWLOCK*)&mutex->handle);
+}
+
+static_assert(sizeof(INIT_ONCE) == sizeof(void*), "hbk_os_once assumes an INIT_ONCE is the size of a pointer");
+
+static BOOL CALLBACK hbk_os_once_entry(PINIT_ONCE init_once, PVOID parameter, PVOID* context) {
+    void (*function)() = (void (*)())parameter;
+    function();
+    return TRUE;
+}
+
+void hbk_os_once_call(hbk_os_once* once, void (*function)()) {
+    InitOnceExecuteOnce((INIT_ONCE*)&once->handle, hbk_os_once_entry, (PVOID)function, NULL);
+}
+
+bool hbk_os_thread_exit_init(hbk_os_thread_exit* thread_exit, void (*destructor)(void* value)) {
+    /// Fiber local storage, unlike thread local storage, calls a destructor when a thread exits.
+    /// The cast is fine on x64 and arm64, which have a single calling convention.
+    DWORD index = FlsAlloc((PFLS_CALLBACK_FUNCTION)destructor);
+    thread_exit->index = index;
+    return index != FLS_OUT_OF_INDEXES;
+}
+
+void hbk_os_thread_exit_register(hbk_os_thread_exit* thread_exit, void* value) {
+    FlsSetValue(thread_exit->index, value);
+}
+
+#elif HBK_OS_HAS_MMAP
+
+#    include <time.h>
+
+int64_t hbk_os_monotonic_nanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int64_t hbk_os_processor_count() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int64_t)count : 1;
+}
+
+static void* hbk_os_thread_entry(void* parameter) {
+    hbk_os_thread* thread = parameter;
+    thread->function(thread->argument);
+    return NULL;
+}
+
+bool hbk_os_thread_start(hbk_os_thread* thread, void (*function)(void* argument), void* argument) {
+    thread->function = function;
+    thread->argument = argument;
+    return 0 == pthread_create(&thread->handle, NULL, hbk_os_thread_entry, thread);
+}
+
+void hbk_os_thread_join(hbk_os_thread* thread) {
+    pthread_join(thread->handle, NULL);
+}
+
+void hbk_os_mutex_init(hbk_os_mutex* mutex) {
+    pthread_mutex_init(&mutex->handle, NULL);
+}
+
+void hbk_os_mutex_destroy(hbk_os_mutex* mutex) {
+    pthread_mutex_destroy(&mutex->handle);
+}
+
+void hbk_os_mutex_lock(hbk_os_mutex* mutex) {
+    pthread_mutex_lock(&mutex->handle);
+}
+
+void hbk_os_mutex_unlock(hbk_os_mutex* mutex) {
+    pthread_mutex_unlock(&mutex->handle);
+}
+
+void hbk_os_once_call(hbk_os_once* once, void (*function)()) {
+    pthread_once(&once->handle, function);
+}
+
+bool hbk_os_thread_exit_init(hbk_os_thread_exit* thread_exit, void (*destructor)(void* value)) {
+    return 0 == pthread_key_create(&thread_exit->key, destructor);
+}
+
+void hbk_os_thread_exit_register(hbk_os_thread_exit* thread_exit, void* value) {
+    pthread_setspecific(thread_exit->key, value);
+}
+
+#else
+
+#    include <time.h>
+
+int64_t hbk_os_monotonic_nanoseconds() {
+    /// Plain C has no monotonic clock, so this is the best we can do.
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int64_t hbk_os_processor_count() {
+    return 1;
+}
+
+bool hbk_os_thread_start(hbk_os_thread* thread, void (*function)(void* argument), void* argument) {
+    return false;
+}
+
+void hbk_os_thread_join(hbk_os_thread* thread) {}
+
+void hbk_os_mutex_init(hbk_os_mutex* mutex) {}
+void hbk_os_mutex_destroy(hbk_os_mutex* mutex) {}
+void hbk_os_mutex_lock(hbk_os_mutex* mutex) {}
+void hbk_os_mutex_unlock(hbk_os_mutex* mutex) {}
+
+void hbk_os_once_call(hbk_os_once* once, void (*function)()) {
+    if (!once->done) {
+        once->done = true;
+        function();
+    }
+}
+
+bool hbk_os_thread_exit_init(hbk_os_thread_exit* thread_exit, void (*destructor)(void* value)) {
+    return true;
+}
+
+void hbk_os_thread_exit_register(hbk_os_thread_exit* thread_exit, void* value) {}
+
+#endif
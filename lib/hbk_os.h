@@ -0,0 +1,162 @@
+#ifndef HBK_OS_H
+#define HBK_OS_H
+
+#include <hibiku.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Thin wrappers around the operating system features the rest of the library
+/// needs and that plain C doesn't give us. Anything platform-specific should
+/// live behind this header, so the other files can stay portable.
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define HBK_OS_HAS_MMAP 1
+#else
+#    define HBK_OS_HAS_MMAP 0
+#endif
+
+#if defined(__linux__)
+#    define HBK_OS_HAS_MREMAP 1
+#else
+#    define HBK_OS_HAS_MREMAP 0
+#endif
+
+#if defined(_WIN32)
+#    define HBK_OS_HAS_THREADS 1
+#elif HBK_OS_HAS_MMAP
+#    define HBK_OS_HAS_THREADS 1
+#    include <pthread.h>
+#else
+#    define HBK_OS_HAS_THREADS 0
+#endif
+
+/// @brief A read-only, private memory mapping of a file.
+/// The mapping is padded so that there is always at least one NUL byte
+/// directly after the file contents, i.e. `data[length] == 0`.
+typedef struct hbk_os_file_mapping {
+    const char* data;
+    int64_t length;
+
+    /// @brief The start and size of the whole mapped region, padding included.
+    void* base;
+    size_t size;
+} hbk_os_file_mapping;
+
+/// @brief Maps the file at the given path into memory.
+/// This only works for non-empty regular files, so pipes, character devices and
+/// the like will fail, as will everything on platforms without `mmap`.
+/// @return true if the file was mapped, false if the caller should read it instead.
+bool hbk_os_map_file(const char* file_path, hbk_os_file_mapping* out_mapping);
+void hbk_os_unmap_file(hbk_os_file_mapping* mapping);
+
+/// @brief The size of a virtual memory page, in bytes.
+size_t hbk_os_page_size();
+
+/// @brief Reserves `size` bytes of address space without backing any of it with memory.
+/// Nothing in the range can be touched until it has been committed with `hbk_os_commit`.
+/// @return The start of the reserved range, or NULL if it couldn't be reserved.
+void* hbk_os_reserve(size_t size);
+/// @brief Makes a page-aligned part of a reserved range readable and writable.
+/// The memory is zeroed by the OS the first time each page is touched.
+bool hbk_os_commit(void* address, size_t size);
+/// @brief Gives a whole reserved range, committed or not, back to the OS.
+void hbk_os_release(void* address, size_t size);
+
+/// @brief Allocates `size` bytes of zeroed, readable and writable memory straight from the OS,
+/// rounded up to whole pages.
+/// @return The start of the memory, or NULL if it couldn't be allocated.
+void* hbk_os_allocate_pages(size_t size);
+/// @brief Resizes memory from `hbk_os_allocate_pages`, keeping its contents. With HBK_OS_HAS_MREMAP
+/// the pages are remapped rather than copied, so this is cheap no matter how big they are.
+/// @return The new start of the memory, or NULL (with the old memory untouched) on failure.
+void* hbk_os_reallocate_pages(void* address, size_t old_size, size_t new_size);
+void hbk_os_free_pages(void* address, size_t size);
+
+/// @brief A timestamp from a clock which never goes backwards, in nanoseconds since some
+/// arbitrary point. Only the differences between two of these mean anything.
+int64_t hbk_os_monotonic_nanoseconds();
+
+/// @brief The number of processors the OS will run our threads on, at least 1.
+int64_t hbk_os_processor_count();
+
+/// @brief A thread started with `hbk_os_thread_start`. It must stay where it is until it has been joined.
+typedef struct hbk_os_thread {
+    void (*function)(void* argument);
+    void* argument;
+#if defined(_WIN32)
+    void* handle;
+#elif HBK_OS_HAS_THREADS
+    pthread_t handle;
+#endif
+} hbk_os_thread;
+
+/// @brief Starts running `function(argument)` on a new thread.
+/// @return false if the thread couldn't be started, which is always the case without HBK_OS_HAS_THREADS.
+bool hbk_os_thread_start(hbk_os_thread* thread, void (*function)(void* argument), void* argument);
+/// @brief Waits for a thread to finish.
+void hbk_os_thread_join(hbk_os_thread* thread);
+
+/// @brief A plain, non-recursive mutex. Without HBK_OS_HAS_THREADS there is only ever one
+/// thread, and locking does nothing.
+typedef struct hbk_os_mutex {
+#if defined(_WIN32)
+    /// @brief An SRWLOCK, which is the size of a pointer and initialized to zero.
+    void* handle;
+#elif HBK_OS_HAS_THREADS
+    pthread_mutex_t handle;
+#else
+    char unused;
+#endif
+} hbk_os_mutex;
+
+void hbk_os_mutex_init(hbk_os_mutex* mutex);
+void hbk_os_mutex_destroy(hbk_os_mutex* mutex);
+void hbk_os_mutex_lock(hbk_os_mutex* mutex);
+void hbk_os_mutex_unlock(hbk_os_mutex* mutex);
+
+/// @brief Makes sure something happens only once, however many threads try to do it at the same time.
+/// It has to start out as HBK_OS_ONCE_INIT.
+typedef struct hbk_os_once {
+#if defined(_WIN32)
+    /// @brief An INIT_ONCE, which is the size of a pointer and initialized to zero.
+    void* handle;
+#elif HBK_OS_HAS_THREADS
+    pthread_once_t handle;
+#else
+    bool done;
+#endif
+} hbk_os_once;
+
+#if defined(_WIN32)
+#    define HBK_OS_ONCE_INIT {NULL}
+#elif HBK_OS_HAS_THREADS
+#    define HBK_OS_ONCE_INIT {PTHREAD_ONCE_INIT}
+#else
+#    define HBK_OS_ONCE_INIT {false}
+#endif
+
+/// @brief Calls `function` the first time this is called with `once`. Every other call waits until
+/// that first one has returned, so whatever the function sets up can be used straight after.
+void hbk_os_once_call(hbk_os_once* once, void (*function)());
+
+/// @brief Calls a destructor when a thread exits, for per-thread state that would otherwise outlive
+/// its thread. It is set up once with `hbk_os_thread_exit_init`, then each thread registers its own value.
+typedef struct hbk_os_thread_exit {
+#if defined(_WIN32)
+    /// @brief A fiber local storage index.
+    uint32_t index;
+#elif HBK_OS_HAS_THREADS
+    pthread_key_t key;
+#else
+    char unused;
+#endif
+} hbk_os_thread_exit;
+
+/// @brief Returns false if the system has no slots left, in which case no destructor is ever called.
+bool hbk_os_thread_exit_init(hbk_os_thread_exit* thread_exit, void (*destructor)(void* value));
+
+/// @brief Has the destructor called with `value` when the calling thread exits. `value` can't be NULL.
+/// Without threads there is only the main thread, which takes everything with it when it exits.
+void hbk_os_thread_exit_register(hbk_os_thread_exit* thread_exit, void* value);
+
+#endif // !HBK_OS_H
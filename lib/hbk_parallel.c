@@ -0,0 +1,136 @@
+#include "hbk_internal.h"
+#include "hbk_os.h"
+#include "hbk_parallel.h"
+
+#include <stdatomic.h>
+
+/// A worker's remaining tasks, [begin, end), packed into one word so both ends change together:
+/// begin in the low 32 bits and end in the high 32 bits.
+typedef _Atomic uint64_t hbk_parallel_range;
+
+static uint64_t hbk_parallel_range_pack(uint64_t begin, uint64_t end) {
+    return begin | (end << 32);
+}
+
+typedef struct hbk_parallel_worker {
+    struct hbk_parallel_pool* pool;
+    int64_t index;
+    hbk_parallel_range range;
+    hbk_os_thread thread;
+    bool thread_started;
+} hbk_parallel_worker;
+
+typedef struct hbk_parallel_pool {
+    hbk_parallel_task task;
+    void* context;
+    hbk_parallel_worker* workers;
+    int64_t worker_count;
+} hbk_parallel_pool;
+
+/// @brief Takes the next task from the front of the worker's own range.
+/// @return false once the range is empty.
+static bool hbk_parallel_take(hbk_parallel_worker* worker, uint64_t* out_task_index) {
+    uint64_t range = atomic_load_explicit(&worker->range, memory_order_acquire);
+    for (;;) {
+        uint64_t begin = range & 0xFFFFFFFF;
+        uint64_t end = range >> 32;
+        if (begin >= end) {
+            return false;
+        }
+
+        if (atomic_compare_exchange_weak_explicit(&worker->range, &range, hbk_parallel_range_pack(begin + 1, end), memory_order_acq_rel, memory_order_acquire)) {
+            *out_task_index = begin;
+            return true;
+        }
+    }
+}
+
+/// @brief Moves the back half of some other worker's range into this worker's, which must be empty.
+/// @return false if every other worker has run out too.
+static bool hbk_parallel_steal(hbk_parallel_worker* thief) {
+    hbk_parallel_pool* pool = thief->pool;
+    for (int64_t offset = 1; offset < pool->worker_count; offset++) {
+        hbk_parallel_worker* victim = &pool->workers[(thief->index + offset) % pool->worker_count];
+
+        uint64_t range = atomic_load_explicit(&victim->range, memory_order_acquire);
+        for (;;) {
+            uint64_t begin = range & 0xFFFFFFFF;
+            uint64_t end = range >> 32;
+            if (begin >= end) {
+                break;
+            }
+
+            uint64_t middle = end - (end - begin + 1) / 2;
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &range, hbk_parallel_range_pack(begin, middle), memory_order_acq_rel, memory_order_acquire)) {
+                /// Other thieves never touch an empty range, so a plain store is enough here.
+                atomic_store_explicit(&thief->range, hbk_parallel_range_pack(middle, end), memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static void hbk_parallel_worker_run(void* argument) {
+    hbk_parallel_worker* worker = argument;
+    hbk_parallel_pool* pool = worker->pool;
+
+    do {
+        uint64_t task_index = 0;
+        while (hbk_parallel_take(worker, &task_index)) {
+            pool->task(pool->context, worker->index, (int64_t)task_index);
+        }
+    } while (hbk_parallel_steal(worker));
+}
+
+void hbk_parallel_for(int64_t task_count, int64_t thread_count, hbk_parallel_task task, void* context) {
+    HBK_ASSERT(task_count >= 0 && task_count <= UINT32_MAX, "Invalid task count");
+    HBK_ASSERT(thread_count > 0, "Invalid thread count");
+    HBK_ASSERT(task != NULL, "Invalid task function");
+
+    if (thread_count > task_count) {
+        thread_count = task_count;
+    }
+
+    if (thread_count <= 1) {
+        for (int64_t i = 0; i < task_count; i++) {
+            task(context, 0, i);
+        }
+
+        return;
+    }
+
+    hbk_parallel_worker* workers = hbk_allocator_alloc(hbk_default_allocator(), (size_t)thread_count * sizeof *workers);
+    hbk_parallel_pool pool = {
+        .task = task,
+        .context = context,
+        .workers = workers,
+        .worker_count = thread_count,
+    };
+
+    for (int64_t i = 0; i < thread_count; i++) {
+        workers[i] = (hbk_parallel_worker){
+            .pool = &pool,
+            .index = i,
+        };
+
+        uint64_t begin = (uint64_t)(task_count * i / thread_count);
+        uint64_t end = (uint64_t)(task_count * (i + 1) / thread_count);
+        atomic_init(&workers[i].range, hbk_parallel_range_pack(begin, end));
+    }
+
+    for (int64_t i = 1; i < thread_count; i++) {
+        workers[i].thread_started = hbk_os_thread_start(&workers[i].thread, hbk_parallel_worker_run, &workers[i]);
+    }
+
+    hbk_parallel_worker_run(&workers[0]);
+
+    for (int64_t i = 1; i < thread_count; i++) {
+        if (workers[i].thread_started) {
+            hbk_os_thread_join(&workers[i].thread);
+        }
+    }
+
+    hbk_allocator_free(hbk_default_allocator(), workers, (size_t)thread_count * sizeof *workers);
+}
@@ -0,0 +1,23 @@
+#ifndef HBK_PARALLEL_H
+#define HBK_PARALLEL_H
+
+#include <hibiku.h>
+#include <stdint.h>
+
+/// @brief One task of `hbk_parallel_for`. `worker_index` is in [0, thread_count) and says which
+/// thread runs the task, so tasks can keep per-worker data without locking it.
+typedef void (*hbk_parallel_task)(void* context, int64_t worker_index, int64_t task_index);
+
+/// @brief Runs `task` for every index in [0, task_count) on up to `thread_count` threads, and returns
+/// once all of them are done. The calling thread is worker 0 and does its share of the work.
+///
+/// Each worker starts with a contiguous range of the tasks and works through it from the front.
+/// A worker which runs out steals the back half of the first non-empty range it finds, so
+/// workers which got the quick tasks take over from the ones which got the slow ones.
+/// Nothing is locked, ranges are only ever changed with a compare-and-swap.
+///
+/// If threads can't be started (or there are no threads on this platform), the tasks they
+/// would have run are stolen by the others, so every task always runs exactly once.
+void hbk_parallel_for(int64_t task_count, int64_t thread_count, hbk_parallel_task task, void* context);
+
+#endif // !HBK_PARALLEL_H
@@ -0,0 +1,249 @@
+#include "hbk_scan.h"
+#include "hbk_internal.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#    define HBK_SCAN_X86 1
+#    include <immintrin.h>
+#else
+#    define HBK_SCAN_X86 0
+#endif
+
+// ===== scalar kernels =====
+
+static bool hbk_scan_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v';
+}
+
+static bool hbk_scan_is_identifier_part(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static int64_t hbk_scan_skip_whitespace_scalar(const char* text, int64_t position, int64_t end) {
+    while (position < end && hbk_scan_is_space(text[position])) position++;
+    return position;
+}
+
+static int64_t hbk_scan_skip_identifier_scalar(const char* text, int64_t position, int64_t end) {
+    while (position < end && hbk_scan_is_identifier_part(text[position])) position++;
+    return position;
+}
+
+static int64_t hbk_scan_find_byte_scalar(const char* text, int64_t position, int64_t end, char c) {
+    while (position < end && text[position] != c) position++;
+    return position;
+}
+
+static int64_t hbk_scan_find_either_scalar(const char* text, int64_t position, int64_t end, char a, char b) {
+    while (position < end && text[position] != a && text[position] != b) position++;
+    return position;
+}
+
+#if HBK_SCAN_X86
+
+/// SSE2 and AVX2 only have signed byte comparisons, so to test `lo <= c <= hi` we shift
+/// the range down so that it starts at -128, at which point a single signed "less than"
+/// does the job: anything outside of the range wraps around to a larger signed value.
+#    define HBK_SCAN_RANGE_BIAS(lo)       ((char)(0x80 - (lo)))
+#    define HBK_SCAN_RANGE_LIMIT(lo, hi)  ((char)(-128 + ((hi) - (lo)) + 1))
+
+// ===== SSE2 kernels =====
+
+static int hbk_scan_space_mask_sse2(__m128i v) {
+    __m128i control = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(HBK_SCAN_RANGE_BIAS('\t'))), _mm_set1_epi8(HBK_SCAN_RANGE_LIMIT('\t', '\v')));
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    return _mm_movemask_epi8(_mm_or_si128(control, space));
+}
+
+static int hbk_scan_identifier_mask_sse2(__m128i v) {
+    /// Setting bit 5 maps 'A'-'Z' onto 'a'-'z' and leaves the lowercase letters alone.
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i letter = _mm_cmplt_epi8(_mm_add_epi8(lower, _mm_set1_epi8(HBK_SCAN_RANGE_BIAS('a'))), _mm_set1_epi8(HBK_SCAN_RANGE_LIMIT('a', 'z')));
+    __m128i digit = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(HBK_SCAN_RANGE_BIAS('0'))), _mm_set1_epi8(HBK_SCAN_RANGE_LIMIT('0', '9')));
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore));
+}
+
+static int64_t hbk_scan_skip_whitespace_sse2(const char* text, int64_t position, int64_t end) {
+    while (position + 16 <= end) {
+        int mask = ~hbk_scan_space_mask_sse2(_mm_loadu_si128((const __m128i*)(text + position))) & 0xFFFF;
+        if (mask != 0) return position + __builtin_ctz((unsigned)mask);
+        position += 16;
+    }
+
+    return hbk_scan_skip_whitespace_scalar(text, position, end);
+}
+
+static int64_t hbk_scan_skip_identifier_sse2(const char* text, int64_t position, int64_t end) {
+    while (position + 16 <= end) {
+        int mask = ~hbk_scan_identifier_mask_sse2(_mm_loadu_si128((const __m128i*)(text + position))) & 0xFFFF;
+        if (mask != 0) return position + __builtin_ctz((unsigned)mask);
+        position += 16;
+    }
+
+    return hbk_scan_skip_identifier_scalar(text, position, end);
+}
+
+static int64_t hbk_scan_find_byte_sse2(const char* text, int64_t position, int64_t end, char c) {
+    __m128i needle = _mm_set1_epi8(c);
+    while (position + 16 <= end) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(text + position)), needle));
+        if (mask != 0) return position + __builtin_ctz((unsigned)mask);
+        position += 16;
+    }
+
+    return hbk_scan_find_byte_scalar(text, position, end, c);
+}
+
+static int64_t hbk_scan_find_either_sse2(const char* text, int64_t position, int64_t end, char a, char b) {
+    __m128i needle_a = _mm_set1_epi8(a);
+    __m128i needle_b = _mm_set1_epi8(b);
+    while (position + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(text + position));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, needle_a), _mm_cmpeq_epi8(v, needle_b)));
+        if (mask != 0) return position + __builtin_ctz((unsigned)mask);
+        position += 16;
+    }
+
+    return hbk_scan_find_either_scalar(text, position, end, a, b);
+}
+
+// ===== AVX2 kernels =====
+
+#    define HBK_SCAN_AVX2 __attribute__((target("avx2")))
+
+HBK_SCAN_AVX2 static uint32_t hbk_scan_space_mask_avx2(__m256i v) {
+    __m256i control = _mm256_cmpgt_epi8(_mm256_set1_epi8(HBK_SCAN_RANGE_LIMIT('\t', '\v')), _mm256_add_epi8(v, _mm256_set1_epi8(HBK_SCAN_RANGE_BIAS('\t'))));
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(control, space));
+}
+
+HBK_SCAN_AVX2 static uint32_t hbk_scan_identifier_mask_avx2(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i letter = _mm256_cmpgt_epi8(_mm256_set1_epi8(HBK_SCAN_RANGE_LIMIT('a', 'z')), _mm256_add_epi8(lower, _mm256_set1_epi8(HBK_SCAN_RANGE_BIAS('a'))));
+    __m256i digit = _mm256_cmpgt_epi8(_mm256_set1_epi8(HBK_SCAN_RANGE_LIMIT('0', '9')), _mm256_add_epi8(v, _mm256_set1_epi8(HBK_SCAN_RANGE_BIAS('0'))));
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letter, digit), underscore));
+}
+
+HBK_SCAN_AVX2 static int64_t hbk_scan_skip_whitespace_avx2(const char* text, int64_t position, int64_t end) {
+    while (position + 32 <= end) {
+        uint32_t mask = ~hbk_scan_space_mask_avx2(_mm256_loadu_si256((const __m256i*)(text + position)));
+        if (mask != 0) return position + __builtin_ctz(mask);
+        position += 32;
+    }
+
+    return hbk_scan_skip_whitespace_sse2(text, position, end);
+}
+
+HBK_SCAN_AVX2 static int64_t hbk_scan_skip_identifier_avx2(const char* text, int64_t position, int64_t end) {
+    while (position + 32 <= end) {
+        uint32_t mask = ~hbk_scan_identifier_mask_avx2(_mm256_loadu_si256((const __m256i*)(text + position)));
+        if (mask != 0) return position + __builtin_ctz(mask);
+        position += 32;
+    }
+
+    return hbk_scan_skip_identifier_sse2(text, position, end);
+}
+
+HBK_SCAN_AVX2 static int64_t hbk_scan_find_byte_avx2(const char* text, int64_t position, int64_t end, char c) {
+    __m256i needle = _mm256_set1_epi8(c);
+    while (position + 32 <= end) {
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(text + position)), needle));
+        if (mask != 0) return position + __builtin_ctz(mask);
+        position += 32;
+    }
+
+    return hbk_scan_find_byte_sse2(text, position, end, c);
+}
+
+HBK_SCAN_AVX2 static int64_t hbk_scan_find_either_avx2(const char* text, int64_t position, int64_t end, char a, char b) {
+    __m256i needle_a = _mm256_set1_epi8(a);
+    __m256i needle_b = _mm256_set1_epi8(b);
+    while (position + 32 <= end) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(text + position));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, needle_a), _mm256_cmpeq_epi8(v, needle_b)));
+        if (mask != 0) return position + __builtin_ctz(mask);
+        position += 32;
+    }
+
+    return hbk_scan_find_either_sse2(text, position, end, a, b);
+}
+
+#endif // HBK_SCAN_X86
+
+// ===== dispatch =====
+
+typedef struct hbk_scan_kernels {
+    const char* name;
+    int64_t (*skip_whitespace)(const char* text, int64_t position, int64_t end);
+    int64_t (*skip_identifier)(const char* text, int64_t position, int64_t end);
+    int64_t (*find_byte)(const char* text, int64_t position, int64_t end, char c);
+    int64_t (*find_either)(const char* text, int64_t position, int64_t end, char a, char b);
+} hbk_scan_kernels;
+
+static const hbk_scan_kernels scalar_kernels = {
+    .name = "scalar",
+    .skip_whitespace = hbk_scan_skip_whitespace_scalar,
+    .skip_identifier = hbk_scan_skip_identifier_scalar,
+    .find_byte = hbk_scan_find_byte_scalar,
+    .find_either = hbk_scan_find_either_scalar,
+};
+
+#if HBK_SCAN_X86
+static const hbk_scan_kernels sse2_kernels = {
+    .name = "sse2",
+    .skip_whitespace = hbk_scan_skip_whitespace_sse2,
+    .skip_identifier = hbk_scan_skip_identifier_sse2,
+    .find_byte = hbk_scan_find_byte_sse2,
+    .find_either = hbk_scan_find_either_sse2,
+};
+
+static const hbk_scan_kernels avx2_kernels = {
+    .name = "avx2",
+    .skip_whitespace = hbk_scan_skip_whitespace_avx2,
+    .skip_identifier = hbk_scan_skip_identifier_avx2,
+    .find_byte = hbk_scan_find_byte_avx2,
+    .find_either = hbk_scan_find_either_avx2,
+};
+#endif
+
+static const hbk_scan_kernels* kernels = NULL;
+
+void hbk_scan_init() {
+    if (kernels != NULL) return;
+
+#if HBK_SCAN_X86
+    /// SSE2 is part of the x86-64 baseline, so it's always there.
+    __builtin_cpu_init();
+    kernels = __builtin_cpu_supports("avx2") ? &avx2_kernels : &sse2_kernels;
+#else
+    kernels = &scalar_kernels;
+#endif
+}
+
+const char* hbk_scan_kernel_name() {
+    HBK_ASSERT(kernels != NULL, "hbk_scan_init must be called first");
+    return kernels->name;
+}
+
+int64_t hbk_scan_skip_whitespace(const char* text, int64_t position, int64_t end) {
+    HBK_ASSERT(kernels != NULL, "hbk_scan_init must be called first");
+    return kernels->skip_whitespace(text, position, end);
+}
+
+int64_t hbk_scan_skip_identifier(const char* text, int64_t position, int64_t end) {
+    HBK_ASSERT(kernels != NULL, "hbk_scan_init must be called first");
+    return kernels->skip_identifier(text, position, end);
+}
+
+int64_t hbk_scan_find_byte(const char* text, int64_t position, int64_t end, char c) {
+    HBK_ASSERT(kernels != NULL, "hbk_scan_init must be called first");
+    return kernels->find_byte(text, position, end, c);
+}
+
+int64_t hbk_scan_find_either(const char* text, int64_t position, int64_t end, char a, char b) {
+    HBK_ASSERT(kernels != NULL, "hbk_scan_init must be called first");
+    return kernels->find_either(text, position, end, a, b);
+}
@@ -0,0 +1,32 @@
+#ifndef HBK_SCAN_H
+#define HBK_SCAN_H
+
+#include <hibiku.h>
+#include <stdint.h>
+
+/// Bulk scanning kernels for the lexer.
+/// Each of these takes the text, the position to start at and the end position
+/// (exclusive), and returns the position where the scan stopped. If the scan
+/// runs off the end, the end position is returned.
+///
+/// On x86-64 these process 16 (SSE2) or 32 (AVX2) bytes at a time, picked at
+/// runtime based on what the CPU supports. Everywhere else, or if neither is
+/// available, they fall back to plain byte-at-a-time loops. All implementations
+/// return exactly the same results.
+
+/// @brief Selects the best kernels for the current CPU. This must be called
+/// before any of the scanning functions, and is cheap to call more than once.
+void hbk_scan_init();
+/// @brief The name of the kernels selected by `hbk_scan_init`, for debugging.
+const char* hbk_scan_kernel_name();
+
+/// @brief Skips over whitespace, as defined by the lexer: ' ', '\t', '\n', '\v' and '\r'.
+int64_t hbk_scan_skip_whitespace(const char* text, int64_t position, int64_t end);
+/// @brief Skips over identifier characters: ASCII letters, digits and '_'.
+int64_t hbk_scan_skip_identifier(const char* text, int64_t position, int64_t end);
+/// @brief Finds the first occurrence of the byte `c`.
+int64_t hbk_scan_find_byte(const char* text, int64_t position, int64_t end, char c);
+/// @brief Finds the first occurrence of either the byte `a` or the byte `b`.
+int64_t hbk_scan_find_either(const char* text, int64_t position, int64_t end, char a, char b);
+
+#endif // !HBK_SCAN_H
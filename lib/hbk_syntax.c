@@ -1,14 +1,31 @@
 #include "hbk_syntax.h"
 
+#include <string.h>
+
+/// @brief A binary operator waiting for its right-hand side in `hbk_parse_expr`.
+typedef struct hbk_parser_operator {
+    hbk_token_kind kind;
+    int precedence;
+} hbk_parser_operator;
+
 typedef struct hbk_parser {
     hbk_state* state;
     hbk_source_id source_id;
-    hbk_string_view source_text;
 
-    hbk_vector(hbk_token) tokens;
+    /// @brief Tokens are lexed as the parser gets to them, so only the few it's looking at are kept.
+    hbk_lexer lexer;
+    /// @brief The number of tokens consumed so far.
     int64_t current_index;
 
     hbk_syntax_tree* tree;
+    /// @brief Child lists are collected here while they're being parsed, since they
+    /// can nest, and only copied into the tree's `extra` array once they're complete.
+    hbk_vector(hbk_syntax_id) scratch;
+
+    /// @brief The operand and operator stacks for `hbk_parse_expr`. They live on the parser
+    /// so that deeply nested expressions grow these vectors instead of the C stack.
+    hbk_vector(hbk_syntax_id) expr_operands;
+    hbk_vector(hbk_parser_operator) expr_operators;
 } hbk_parser;
 
 const char* hbk_syntax_kind_to_cstring(hbk_syntax_kind kind) {
@@ -24,35 +41,30 @@ const char* hbk_syntax_kind_to_cstring(hbk_syntax_kind kind) {
     }
 }
 
-hbk_syntax* hbk_parse_decl(hbk_parser* p);
-hbk_syntax* hbk_parse_decl_function(hbk_parser* p, hbk_token export_token);
-hbk_syntax* hbk_parse_decl_variable(hbk_parser* p, hbk_token decl_token);
+hbk_syntax_id hbk_parse_decl(hbk_parser* p);
+hbk_syntax_id hbk_parse_decl_function(hbk_parser* p, hbk_token export_token);
+hbk_syntax_id hbk_parse_decl_variable(hbk_parser* p, hbk_token decl_token);
 
-hbk_syntax* hbk_parse_stmt(hbk_parser* p);
-hbk_syntax* hbk_parse_stmt_compound(hbk_parser* p);
+hbk_syntax_id hbk_parse_stmt(hbk_parser* p);
+hbk_syntax_id hbk_parse_stmt_compound(hbk_parser* p);
 
-hbk_syntax* hbk_parse_type(hbk_parser* p);
+hbk_syntax_id hbk_parse_type(hbk_parser* p);
 
-hbk_syntax* hbk_parse_expr(hbk_parser* p);
-hbk_syntax* hbk_parse_expr_primary(hbk_parser* p);
+hbk_syntax_id hbk_parse_expr(hbk_parser* p);
+hbk_syntax_id hbk_parse_expr_primary(hbk_parser* p);
 
 void hbk_parser_advance(hbk_parser* p) {
     HBK_ASSERT(p != NULL, "invalid parser pointer");
+
+    (void)hbk_lexer_next(&p->lexer);
     p->current_index++;
 }
 
 hbk_token hbk_parser_peek(hbk_parser* p, int offset) {
     HBK_ASSERT(p != NULL, "invalid parser pointer");
+    HBK_ASSERT(offset >= 0, "the parser can only peek forward");
 
-    int64_t peek_index = p->current_index + offset;
-    if (peek_index < 0 || peek_index >= hbk_vector_count(p->tokens)) {
-        return (hbk_token){
-            .location = hbk_location_create(p->source_id, p->source_text.count, 0),
-            .kind = HBK_TOKEN_EOF,
-        };
-    }
-
-    return p->tokens[peek_index];
+    return hbk_lexer_peek(&p->lexer, offset);
 }
 
 hbk_token hbk_parser_token(hbk_parser* p) {
@@ -86,8 +98,8 @@ void hbk_parser_expect(hbk_parser* p, hbk_token_kind kind, hbk_token* out_token)
     }
 
     if (!hbk_parser_consume(p, kind)) {
-        if (kind < 256) {
-            hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_token(p).location, "Expected '%c'.", kind);
+        if (kind < __HBK_TOKEN_MULTIBYTE_START__) {
+            hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_location(p), "Expected '%c'.", kind);
         } else {
             const char* suffix = NULL;
             switch (kind) {
@@ -98,47 +110,161 @@ void hbk_parser_expect(hbk_parser* p, hbk_token_kind kind, hbk_token* out_token)
             }
 
             HBK_ASSERT(suffix != NULL, "error message 'suffix' was not set");
-            hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_token(p).location, "Expected %s.", suffix);
+            hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_location(p), "Expected %s.", suffix);
         }
     }
 }
 
 void hbk_parser_expect_semi(hbk_parser* p) {
     if (!hbk_parser_consume(p, ';')) {
-        hbk_diagnostic_create(p->state, HBK_DIAG_ERROR, hbk_parser_token(p).location, "Expected ';'.");
+        hbk_diagnostic_create(p->state, HBK_DIAG_ERROR, hbk_parser_location(p), "Expected ';'.");
     }
 }
 
-hbk_syntax_tree* hbk_syntax_tree_create() {
-    hbk_arena* tree_arena = hbk_arena_create();
-    HBK_ASSERT(tree_arena != NULL, "buy more ram");
+hbk_syntax_tree* hbk_syntax_tree_create(hbk_state* state) {
+    const hbk_allocator* allocator = hbk_state_get_category_allocator(state, HBK_MEMORY_SYNTAX);
 
-    hbk_syntax_tree* tree = hbk_arena_alloc(tree_arena, sizeof *tree);
+    /// Everything else in the tree is in its vectors, so the tree itself is a plain allocation.
+    hbk_syntax_tree* tree = hbk_allocator_alloc(allocator, sizeof *tree);
     HBK_ASSERT(tree != NULL, "buy more ram");
-    tree->arena = tree_arena;
+    *tree = (hbk_syntax_tree){
+        .state = state,
+    };
+
+    hbk_vector_init(tree->declarations, allocator);
+    hbk_vector_init(tree->kinds, allocator);
+    hbk_vector_init(tree->locations, allocator);
+    hbk_vector_init(tree->data, allocator);
+    hbk_vector_init(tree->decl_functions, allocator);
+    hbk_vector_init(tree->decl_parameters, allocator);
+    hbk_vector_init(tree->decl_variables, allocator);
+    hbk_vector_init(tree->binaries, allocator);
+    hbk_vector_init(tree->integer_literals, allocator);
+    hbk_vector_init(tree->extra, allocator);
+
+    /// Reserve node 0 for HBK_SYNTAX_NONE.
+    hbk_vector_push(tree->kinds, HBK_SYNTAX_INVALID);
+    hbk_vector_push(tree->locations, 0);
+    hbk_vector_push(tree->data, 0);
 
     return tree;
 }
 
 void hbk_syntax_tree_destroy(hbk_syntax_tree* tree) {
     if (tree == NULL) return;
-    hbk_arena_destroy(tree->arena);
+    hbk_vector_free(tree->declarations);
+    hbk_vector_free(tree->kinds);
+    hbk_vector_free(tree->locations);
+    hbk_vector_free(tree->data);
+    hbk_vector_free(tree->decl_functions);
+    hbk_vector_free(tree->decl_parameters);
+    hbk_vector_free(tree->decl_variables);
+    hbk_vector_free(tree->binaries);
+    hbk_vector_free(tree->integer_literals);
+    hbk_vector_free(tree->extra);
+    hbk_allocator_free(hbk_state_get_category_allocator(tree->state, HBK_MEMORY_SYNTAX), tree, sizeof *tree);
+}
+
+hbk_syntax_id hbk_syntax_create(hbk_syntax_tree* tree, hbk_syntax_kind kind, hbk_location location, uint32_t data) {
+    HBK_ASSERT(tree != NULL, "invalid tree pointer");
+    HBK_ASSERT(hbk_vector_count(tree->kinds) > 0, "the tree must have its reserved node 0");
+    HBK_ASSERT(hbk_vector_count(tree->kinds) < UINT32_MAX, "too many syntax nodes in one tree");
+
+    hbk_syntax_id id = (hbk_syntax_id)hbk_vector_count(tree->kinds);
+    hbk_vector_push(tree->kinds, (uint8_t)kind);
+    hbk_vector_push(tree->locations, hbk_state_pack_location(tree->state, location));
+    hbk_vector_push(tree->data, data);
+
+    return id;
+}
+
+static void hbk_syntax_assert_kind(hbk_syntax_tree* tree, hbk_syntax_id id, hbk_syntax_kind kind) {
+    HBK_ASSERT(tree != NULL, "invalid tree pointer");
+    HBK_ASSERT(id != HBK_SYNTAX_NONE && id < hbk_vector_count(tree->kinds), "invalid syntax node id");
+    HBK_ASSERT(tree->kinds[id] == kind, "syntax node is not of the expected kind");
 }
 
-hbk_syntax* hbk_syntax_create(hbk_syntax_tree* tree, hbk_syntax_kind kind, hbk_location location) {
+hbk_syntax_kind hbk_syntax_get_kind(hbk_syntax_tree* tree, hbk_syntax_id id) {
     HBK_ASSERT(tree != NULL, "invalid tree pointer");
-    HBK_ASSERT(tree->arena != NULL, "invalid arena pointer");
+    HBK_ASSERT(id != HBK_SYNTAX_NONE && id < hbk_vector_count(tree->kinds), "invalid syntax node id");
+    return (hbk_syntax_kind)tree->kinds[id];
+}
+
+hbk_location hbk_syntax_get_location(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    HBK_ASSERT(tree != NULL, "invalid tree pointer");
+    HBK_ASSERT(id != HBK_SYNTAX_NONE && id < hbk_vector_count(tree->kinds), "invalid syntax node id");
+    return hbk_state_unpack_location(tree->state, tree->locations[id]);
+}
+
+hbk_syntax_id hbk_syntax_range_get(hbk_syntax_tree* tree, hbk_syntax_range range, int64_t index) {
+    HBK_ASSERT(tree != NULL, "invalid tree pointer");
+    HBK_ASSERT(index >= 0 && index < range.count, "syntax range index out of bounds");
+    HBK_ASSERT((int64_t)range.start + range.count <= hbk_vector_count(tree->extra), "invalid syntax range");
+    return tree->extra[range.start + index];
+}
+
+hbk_syntax_decl_function* hbk_syntax_get_decl_function(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_DECL_FUNCTION);
+    return &tree->decl_functions[tree->data[id]];
+}
+
+hbk_syntax_decl_parameter* hbk_syntax_get_decl_parameter(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_DECL_PARAMETER);
+    return &tree->decl_parameters[tree->data[id]];
+}
+
+hbk_syntax_decl_variable* hbk_syntax_get_decl_variable(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_DECL_VARIABLE);
+    return &tree->decl_variables[tree->data[id]];
+}
+
+hbk_syntax_binary* hbk_syntax_get_binary(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_BINARY);
+    return &tree->binaries[tree->data[id]];
+}
+
+hbk_syntax_id hbk_syntax_get_arrow_value(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_STMT_ARROW);
+    return tree->data[id];
+}
 
-    hbk_arena* arena = tree->arena;
-    hbk_syntax* syntax = hbk_arena_alloc(arena, sizeof *syntax);
-    HBK_ASSERT(syntax != NULL, "invalid syntax pointer");
-    syntax->kind = kind;
-    syntax->location = location;
+hbk_symbol hbk_syntax_get_identifier_name(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_IDENTIFIER);
+    return tree->data[id];
+}
 
-    return syntax;
+int64_t hbk_syntax_get_integer_value(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_INTEGER_LITERAL);
+    return tree->integer_literals[tree->data[id]];
 }
 
-hbk_syntax* hbk_parse_decl(hbk_parser* p) {
+bool hbk_syntax_get_bool_value(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_BOOL_LITERAL);
+    return tree->data[id] != 0;
+}
+
+hbk_symbol hbk_syntax_get_string_value(hbk_syntax_tree* tree, hbk_syntax_id id) {
+    hbk_syntax_assert_kind(tree, id, HBK_SYNTAX_STRING_LITERAL);
+    return tree->data[id];
+}
+
+/// @brief Moves everything pushed to the parser's scratch list since `scratch_start`
+/// into the tree's `extra` array, and returns the range it now occupies.
+static hbk_syntax_range hbk_parser_commit_scratch(hbk_parser* p, int64_t scratch_start) {
+    int64_t count = hbk_vector_count(p->scratch) - scratch_start;
+    HBK_ASSERT(count >= 0, "the scratch list was truncated below its start");
+
+    hbk_syntax_range range = {
+        .start = (uint32_t)hbk_vector_count(p->tree->extra),
+        .count = (uint32_t)count,
+    };
+
+    hbk_vector_append_n(p->tree->extra, p->scratch + scratch_start, count);
+    hbk_vector_set_count(p->scratch, scratch_start);
+    return range;
+}
+
+hbk_syntax_id hbk_parse_decl(hbk_parser* p) {
     hbk_token token = hbk_parser_token(p);
     switch (token.kind) {
         case HBK_TOKEN_EXPORT: {
@@ -150,9 +276,7 @@ hbk_syntax* hbk_parse_decl(hbk_parser* p) {
             if (!hbk_parser_at(p, HBK_TOKEN_IDENTIFIER)) {
                 // TODO(local): Turn token kinds into more human-readable strings, not just the internal enum representation
                 hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_location(p), "Expected an identifier to name this exported variable, but got %s.", hbk_token_kind_to_cstring(token.kind));
-                hbk_syntax* invalid = hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location);
-                invalid->invalid.token = token;
-                return invalid;
+                return hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location, 0);
             }
 
             return hbk_parse_decl_variable(p, token);
@@ -168,9 +292,7 @@ hbk_syntax* hbk_parse_decl(hbk_parser* p) {
             if (!hbk_parser_at(p, HBK_TOKEN_IDENTIFIER)) {
                 // TODO(local): Turn token kinds into more human-readable strings, not just the internal enum representation
                 hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_location(p), "Expected an identifier to name this local variable, but got %s.", hbk_token_kind_to_cstring(token.kind));
-                hbk_syntax* invalid = hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location);
-                invalid->invalid.token = token;
-                return invalid;
+                return hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location, 0);
             }
 
             return hbk_parse_decl_variable(p, token);
@@ -181,73 +303,89 @@ hbk_syntax* hbk_parse_decl(hbk_parser* p) {
             hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_location(p), "Expected a declaration, but got %s.", hbk_token_kind_to_cstring(token.kind));
             hbk_parser_advance(p);
 
-            hbk_syntax* invalid = hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location);
-            invalid->invalid.token = token;
-            return invalid;
+            return hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location, 0);
         }
     }
 }
 
-hbk_syntax* hbk_parse_decl_parameter(hbk_parser* p) {
+hbk_syntax_id hbk_parse_decl_parameter(hbk_parser* p) {
     HBK_ASSERT(p != NULL, "invalid parser pointer");
-    
-    hbk_syntax* param_node = hbk_syntax_create(p->tree, HBK_SYNTAX_DECL_PARAMETER, hbk_parser_token(p).location);
-    hbk_parser_expect(p, HBK_TOKEN_IDENTIFIER, &param_node->decl_parameter.name);
+
+    hbk_location location = hbk_parser_location(p);
+    hbk_syntax_decl_parameter param = {};
+
+    hbk_token name_token = {};
+    hbk_parser_expect(p, HBK_TOKEN_IDENTIFIER, &name_token);
+    param.name = name_token.symbol;
 
     if (hbk_parser_consume(p, ':')) {
-        param_node->decl_parameter.type = hbk_parse_type(p);
-        HBK_ASSERT(param_node->decl_parameter.type != NULL, "failed to parse type for parameter");
+        param.type = hbk_parse_type(p);
+        HBK_ASSERT(param.type != HBK_SYNTAX_NONE, "failed to parse type for parameter");
     }
 
-    return param_node;
+    uint32_t param_index = (uint32_t)hbk_vector_count(p->tree->decl_parameters);
+    hbk_vector_push(p->tree->decl_parameters, param);
+    return hbk_syntax_create(p->tree, HBK_SYNTAX_DECL_PARAMETER, location, param_index);
 }
 
-hbk_syntax* hbk_parse_decl_function(hbk_parser* p, hbk_token export_token) {
+hbk_syntax_id hbk_parse_decl_function(hbk_parser* p, hbk_token export_token) {
     // <decl-function> ::= <attribs> [ EXPORT ] FUNCTION IDENTIFIER "(" ")" [ ":" <type> ] <function-body>
 
     HBK_ASSERT(p != NULL, "invalid parser pointer");
     HBK_ASSERT(hbk_parser_token(p).kind == HBK_TOKEN_FUNCTION, "hbk_parse_decl_function must be called with the parser positioned at the 'function' keyword");
 
-    hbk_syntax* func_node = hbk_syntax_create(p->tree, HBK_SYNTAX_DECL_FUNCTION, hbk_parser_token(p).location);
+    /// The function's data is built up here and only added to the tree at the end,
+    /// since parsing the parameters and body adds other nodes in the meantime.
+    hbk_location location = hbk_parser_location(p);
+    hbk_syntax_decl_function func = {
+        .is_exported = export_token.kind == HBK_TOKEN_EXPORT,
+    };
+
     hbk_parser_advance(p);
 
-    hbk_parser_expect(p, HBK_TOKEN_IDENTIFIER, &func_node->decl_function.name);
+    hbk_token name_token = {};
+    hbk_parser_expect(p, HBK_TOKEN_IDENTIFIER, &name_token);
+    func.name = name_token.symbol;
+
+    int64_t scratch_start = hbk_vector_count(p->scratch);
 
     hbk_parser_expect(p, '(', NULL);
     while (!hbk_parser_at(p, HBK_TOKEN_EOF) && !hbk_parser_at(p, ')')) {
-        hbk_syntax* param = hbk_parse_decl_parameter(p);
-        HBK_ASSERT(param != NULL, "did not parse param ig");
+        hbk_syntax_id param = hbk_parse_decl_parameter(p);
+        HBK_ASSERT(param != HBK_SYNTAX_NONE, "did not parse param ig");
 
-        hbk_vector_push(func_node->decl_function.parameter_declarations, param);
+        hbk_vector_push(p->scratch, param);
 
         if (!hbk_parser_consume(p, ',')) {
             break;
         }
     }
 
+    func.parameter_declarations = hbk_parser_commit_scratch(p, scratch_start);
     hbk_parser_expect(p, ')', NULL);
 
     if (hbk_parser_consume(p, ':')) {
-        func_node->decl_function.return_type = hbk_parse_type(p);
-        HBK_ASSERT(func_node->decl_function.return_type != NULL, "failed to parse type for parameter");
+        func.return_type = hbk_parse_type(p);
+        HBK_ASSERT(func.return_type != HBK_SYNTAX_NONE, "failed to parse type for parameter");
     }
 
     if (hbk_parser_consume(p, HBK_TOKEN_EQUALGREATER)) {
-        hbk_syntax* return_value = hbk_parse_expr(p);
-        HBK_ASSERT(return_value != NULL, "return value was null");
+        hbk_syntax_id return_value = hbk_parse_expr(p);
+        HBK_ASSERT(return_value != HBK_SYNTAX_NONE, "return value was null");
 
-        func_node->decl_function.body = hbk_syntax_create(p->tree, HBK_SYNTAX_STMT_ARROW, return_value->location);
-        func_node->decl_function.body->stmt_arrow.value = return_value;
+        func.body = hbk_syntax_create(p->tree, HBK_SYNTAX_STMT_ARROW, hbk_syntax_get_location(p->tree, return_value), return_value);
 
         hbk_parser_expect_semi(p);
     } else {
         hbk_parser_expect_semi(p);
     }
-    
-    return func_node;
+
+    uint32_t func_index = (uint32_t)hbk_vector_count(p->tree->decl_functions);
+    hbk_vector_push(p->tree->decl_functions, func);
+    return hbk_syntax_create(p->tree, HBK_SYNTAX_DECL_FUNCTION, location, func_index);
 }
 
-hbk_syntax* hbk_parse_decl_variable(hbk_parser* p, hbk_token decl_token) {
+hbk_syntax_id hbk_parse_decl_variable(hbk_parser* p, hbk_token decl_token) {
     HBK_ASSERT(p != NULL, "invalid parser pointer");
     HBK_ASSERT(decl_token.kind == HBK_TOKEN_LOCAL || decl_token.kind == HBK_TOKEN_EXPORT, "hibiku variable must start with either `local` or `export`");
     HBK_ASSERT(hbk_parser_at(p, HBK_TOKEN_IDENTIFIER), "hbk_parse_decl_variable expected to be at the variable name");
@@ -255,28 +393,32 @@ hbk_syntax* hbk_parse_decl_variable(hbk_parser* p, hbk_token decl_token) {
     hbk_token variable_token = hbk_parser_token(p);
     hbk_parser_advance(p);
 
-    hbk_syntax* var_node = hbk_syntax_create(p->tree, HBK_SYNTAX_DECL_VARIABLE, variable_token.location);
-    var_node->decl_variable.name = variable_token;
+    hbk_syntax_decl_variable var = {
+        .name = variable_token.symbol,
+        .is_exported = decl_token.kind == HBK_TOKEN_EXPORT,
+    };
 
     if (hbk_parser_consume(p, ':')) {
-        var_node->decl_variable.type = hbk_parse_type(p);
+        var.type = hbk_parse_type(p);
     }
 
     if (hbk_parser_consume(p, '=')) {
-        var_node->decl_variable.default_value = hbk_parse_expr(p);
+        var.default_value = hbk_parse_expr(p);
     }
 
     hbk_parser_expect_semi(p);
-    return var_node;
+
+    uint32_t var_index = (uint32_t)hbk_vector_count(p->tree->decl_variables);
+    hbk_vector_push(p->tree->decl_variables, var);
+    return hbk_syntax_create(p->tree, HBK_SYNTAX_DECL_VARIABLE, variable_token.location, var_index);
 }
 
-hbk_syntax* hbk_parse_type(hbk_parser* p) {
+hbk_syntax_id hbk_parse_type(hbk_parser* p) {
     hbk_token token = hbk_parser_token(p);
     switch (token.kind) {
         case HBK_TOKEN_INT: {
             hbk_parser_advance(p);
-            hbk_syntax* invalid = hbk_syntax_create(p->tree, HBK_SYNTAX_TYPE_INTEGER, token.location);
-            return invalid;
+            return hbk_syntax_create(p->tree, HBK_SYNTAX_TYPE_INTEGER, token.location, 0);
         }
 
         default: {
@@ -284,18 +426,139 @@ hbk_syntax* hbk_parse_type(hbk_parser* p) {
             hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_location(p), "Expected a type, but got %s.", hbk_token_kind_to_cstring(token.kind));
             hbk_parser_advance(p);
 
-            hbk_syntax* invalid = hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location);
-            invalid->invalid.token = token;
-            return invalid;
+            return hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location, 0);
         }
     }
 }
 
-hbk_syntax* hbk_parse_expr(hbk_parser* p) {
-    return hbk_parse_expr_primary(p);
+/// @brief The binding power of a binary operator token, or 0 if the token is not a binary operator.
+/// Higher binds tighter. Assignments are the only right-associative operators.
+static int hbk_binary_operator_precedence(hbk_token_kind kind) {
+    /// Single-character tokens are their ASCII value, which isn't a named enumerator.
+    switch ((int)kind) {
+        default: return 0;
+
+        case '*':
+        case '/':
+        case '%': return 10;
+
+        case '+':
+        case '-': return 9;
+
+        case HBK_TOKEN_LESSLESS:
+        case HBK_TOKEN_GREATERGREATER: return 8;
+
+        case '&': return 7;
+        case '~': return 6;
+        case '|': return 5;
+
+        case HBK_TOKEN_EQUALEQUAL:
+        case HBK_TOKEN_BANGEQUAL:
+        case '<':
+        case '>':
+        case HBK_TOKEN_LESSEQUAL:
+        case HBK_TOKEN_GREATEREQUAL: return 4;
+
+        case HBK_TOKEN_AND: return 3;
+        case HBK_TOKEN_OR: return 2;
+
+        case '=':
+        case HBK_TOKEN_PLUSEQUAL:
+        case HBK_TOKEN_MINUSEQUAL:
+        case HBK_TOKEN_STAREQUAL:
+        case HBK_TOKEN_SLASHEQUAL:
+        case HBK_TOKEN_PERCENTEQUAL:
+        case HBK_TOKEN_AMPERSANDEQUAL:
+        case HBK_TOKEN_PIPEEQUAL:
+        case HBK_TOKEN_TILDEEQUAL:
+        case HBK_TOKEN_LESSLESSEQUAL:
+        case HBK_TOKEN_GREATERGREATEREQUAL: return 1;
+    }
+}
+
+#define HBK_ASSIGNMENT_PRECEDENCE 1
+
+/// @brief Pops the top operator and its two operands, and pushes the binary node made from them.
+static void hbk_parser_reduce_binary(hbk_parser* p) {
+    int64_t operand_count = hbk_vector_count(p->expr_operands);
+    int64_t operator_count = hbk_vector_count(p->expr_operators);
+    HBK_ASSERT(operand_count >= 2 && operator_count >= 1, "not enough operands to reduce a binary expression");
+
+    hbk_parser_operator op = p->expr_operators[operator_count - 1];
+    hbk_syntax_binary binary = {
+        .operator = op.kind,
+        .lhs = p->expr_operands[operand_count - 2],
+        .rhs = p->expr_operands[operand_count - 1],
+    };
+
+    uint32_t binary_index = (uint32_t)hbk_vector_count(p->tree->binaries);
+    hbk_vector_push(p->tree->binaries, binary);
+
+    /// The expression covers its operands and everything between them, not just the operator.
+    hbk_location lhs_location = hbk_syntax_get_location(p->tree, binary.lhs);
+    hbk_location rhs_location = hbk_syntax_get_location(p->tree, binary.rhs);
+    hbk_location location = hbk_location_create(p->source_id, lhs_location.offset, rhs_location.offset + rhs_location.length - lhs_location.offset);
+
+    hbk_vector_set_count(p->expr_operators, operator_count - 1);
+    hbk_vector_set_count(p->expr_operands, operand_count - 1);
+    p->expr_operands[operand_count - 2] = hbk_syntax_create(p->tree, HBK_SYNTAX_BINARY, location, binary_index);
 }
 
-hbk_syntax* hbk_parse_expr_primary(hbk_parser* p) {
+hbk_syntax_id hbk_parse_expr(hbk_parser* p) {
+    // <expr-binary> ::= <expr> <binary-op> <expr>
+
+    HBK_ASSERT(p != NULL, "invalid parser pointer");
+
+    /// This is precedence climbing done in a single loop: operators wait on an explicit stack
+    /// until an operator that binds less tightly shows up, at which point they are reduced.
+    /// Nothing here recurses, so a hundred thousand chained operands nest no deeper than one.
+    /// Only the parts of the stacks above where we started belong to this expression.
+    int64_t operand_base = hbk_vector_count(p->expr_operands);
+    int64_t operator_base = hbk_vector_count(p->expr_operators);
+
+    hbk_vector_push(p->expr_operands, hbk_parse_expr_primary(p));
+
+    for (;;) {
+        hbk_token token = hbk_parser_token(p);
+        int precedence = hbk_binary_operator_precedence(token.kind);
+        if (precedence == 0) {
+            break;
+        }
+
+        /// Left-associative operators reduce everything of equal or higher precedence first,
+        /// right-associative ones (assignments) leave equal precedence operators waiting.
+        while (hbk_vector_count(p->expr_operators) > operator_base) {
+            int top_precedence = p->expr_operators[hbk_vector_count(p->expr_operators) - 1].precedence;
+            if (top_precedence < precedence || (top_precedence == precedence && precedence == HBK_ASSIGNMENT_PRECEDENCE)) {
+                break;
+            }
+
+            hbk_parser_reduce_binary(p);
+        }
+
+        hbk_parser_operator op = {
+            .kind = token.kind,
+            .precedence = precedence,
+        };
+
+        hbk_vector_push(p->expr_operators, op);
+        hbk_parser_advance(p);
+
+        hbk_vector_push(p->expr_operands, hbk_parse_expr_primary(p));
+    }
+
+    while (hbk_vector_count(p->expr_operators) > operator_base) {
+        hbk_parser_reduce_binary(p);
+    }
+
+    HBK_ASSERT(hbk_vector_count(p->expr_operands) == operand_base + 1, "binary expression did not reduce to a single operand");
+    hbk_syntax_id result = p->expr_operands[operand_base];
+    hbk_vector_set_count(p->expr_operands, operand_base);
+
+    return result;
+}
+
+hbk_syntax_id hbk_parse_expr_primary(hbk_parser* p) {
     HBK_ASSERT(p != NULL, "invalid parser pointer");
 
     hbk_token token = hbk_parser_token(p);
@@ -305,72 +568,86 @@ hbk_syntax* hbk_parse_expr_primary(hbk_parser* p) {
             hbk_diagnostic_create_format(p->state, HBK_DIAG_ERROR, hbk_parser_location(p), "Expected an expression, but got %s.", hbk_token_kind_to_cstring(token.kind));
             hbk_parser_advance(p);
 
-            hbk_syntax* invalid = hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location);
-            invalid->invalid.token = token;
-            return invalid;
+            return hbk_syntax_create(p->tree, HBK_SYNTAX_INVALID, token.location, 0);
         }
 
         case HBK_TOKEN_IDENTIFIER: {
             hbk_parser_advance(p);
-            hbk_syntax* primary = hbk_syntax_create(p->tree, HBK_SYNTAX_IDENTIFIER, token.location);
-            primary->identifier.name = token;
-            return primary;
-        }
-
-        case HBK_TOKEN_INTEGER_LITERAL: {
-            hbk_parser_advance(p);
-            hbk_syntax* primary = hbk_syntax_create(p->tree, HBK_SYNTAX_INTEGER_LITERAL, token.location);
-            primary->literal.integer_value = token.integer_value;
-            return primary;
+            return hbk_syntax_create(p->tree, HBK_SYNTAX_IDENTIFIER, token.location, token.symbol);
         }
 
+        case HBK_TOKEN_INTEGER_LITERAL:
         case HBK_TOKEN_CHARACTER_LITERAL: {
             hbk_parser_advance(p);
-            hbk_syntax* primary = hbk_syntax_create(p->tree, HBK_SYNTAX_INTEGER_LITERAL, token.location);
-            primary->literal.integer_value = token.integer_value;
-            return primary;
+            uint32_t literal_index = (uint32_t)hbk_vector_count(p->tree->integer_literals);
+            hbk_vector_push(p->tree->integer_literals, token.integer_value);
+            return hbk_syntax_create(p->tree, HBK_SYNTAX_INTEGER_LITERAL, token.location, literal_index);
         }
 
         case HBK_TOKEN_STRING_LITERAL: {
             hbk_parser_advance(p);
-            hbk_syntax* primary = hbk_syntax_create(p->tree, HBK_SYNTAX_STRING_LITERAL, token.location);
-            primary->literal.string_value = token.string_value;
-            return primary;
+            return hbk_syntax_create(p->tree, HBK_SYNTAX_STRING_LITERAL, token.location, token.symbol);
         }
 
         case HBK_TOKEN_TRUE:
         case HBK_TOKEN_FALSE: {
             hbk_parser_advance(p);
-            hbk_syntax* primary = hbk_syntax_create(p->tree, HBK_SYNTAX_BOOL_LITERAL, token.location);
-            primary->literal.bool_value = token.kind == HBK_TOKEN_TRUE;
-            return primary;
+            return hbk_syntax_create(p->tree, HBK_SYNTAX_BOOL_LITERAL, token.location, token.kind == HBK_TOKEN_TRUE);
         }
     }
 }
 
 hbk_syntax_tree* hbk_parse(hbk_state* state, hbk_source_id source_id) {
-    hbk_vector(hbk_token) tokens = hbk_lex(state, source_id);
-    hbk_string_view source_text = hbk_state_get_source_text(state, source_id);
-
-    hbk_syntax_tree* tree = hbk_syntax_tree_create();
-    tree->source_id = source_id;
-
     hbk_parser parser = {
         .state = state,
         .source_id = source_id,
-        .source_text = source_text,
-        .tokens = tokens,
-        .tree = tree,
     };
 
-    while (!hbk_parser_at(&parser, HBK_TOKEN_EOF)) {
+    /// A large source may be lexed ahead of time. Otherwise the tokens are lexed as the parser
+    /// asks for them, and the lexer adds up the time that takes. Either way it's timed as lexing.
+    hbk_lexer_init(&parser.lexer, state, source_id, hbk_state_get_lex_thread_count(state));
+
+    HBK_PASS_BEGIN(state, PARSE, hbk_state_get_source_name(state, source_id));
+
+    hbk_syntax_tree* tree = hbk_syntax_tree_create(state);
+    tree->source_id = source_id;
+    parser.tree = tree;
+
+    const hbk_allocator* allocator = hbk_state_get_category_allocator(state, HBK_MEMORY_SYNTAX);
+    hbk_vector_init(parser.scratch, allocator);
+    hbk_vector_init(parser.expr_operands, allocator);
+    hbk_vector_init(parser.expr_operators, allocator);
+
+    while (!hbk_parser_at(&parser, HBK_TOKEN_EOF) && !hbk_state_has_reached_error_limit(state)) {
         int64_t last_parser_index = parser.current_index;
-        hbk_syntax* parsed_syntax = hbk_parse_decl(&parser);
-        HBK_ASSERT(parsed_syntax != NULL, "all parser routines must return a valid syntax node");
+        hbk_syntax_id parsed_syntax = hbk_parse_decl(&parser);
+        HBK_ASSERT(parsed_syntax != HBK_SYNTAX_NONE, "all parser routines must return a valid syntax node");
         HBK_ASSERT(last_parser_index < parser.current_index, "all parser routines must advance the token index by at least one");
-        hbk_vector_push(tree->syntax_nodes, parsed_syntax);
+        hbk_vector_push(tree->declarations, parsed_syntax);
     }
 
+    /// The tree lives as long as the state does, so don't hold on to the slack from growing it.
+    hbk_vector_shrink_to_fit(tree->declarations);
+    hbk_vector_shrink_to_fit(tree->kinds);
+    hbk_vector_shrink_to_fit(tree->locations);
+    hbk_vector_shrink_to_fit(tree->data);
+    hbk_vector_shrink_to_fit(tree->decl_functions);
+    hbk_vector_shrink_to_fit(tree->decl_parameters);
+    hbk_vector_shrink_to_fit(tree->decl_variables);
+    hbk_vector_shrink_to_fit(tree->binaries);
+    hbk_vector_shrink_to_fit(tree->integer_literals);
+    hbk_vector_shrink_to_fit(tree->extra);
+
+    HBK_PASS_EXCLUDE(PARSE, parser.lexer.lex_nanoseconds);
+    hbk_lexer_destroy(&parser.lexer);
+    hbk_vector_free(parser.scratch);
+    hbk_vector_free(parser.expr_operands);
+    hbk_vector_free(parser.expr_operators);
+
+    /// Node 0 is the reserved HBK_SYNTAX_NONE, not a real node.
+    HBK_COUNTER_ADD(state, SYNTAX_NODES, hbk_vector_count(tree->kinds) - 1);
+    HBK_PASS_END(state, PARSE);
+
     return tree;
 }
 
@@ -383,146 +660,248 @@ hbk_syntax_tree* hbk_parse(hbk_state* state, hbk_source_id source_id) {
 #define COL_LITERAL  YELLOW
 #define COL_KEYWORD  BRIGHT_MAGENTA
 
+/// @brief Nodes deeper than this are indented as if they were at this depth, and say how
+/// deep they really are instead. Otherwise a long chain of operators, which nests one level
+/// per operand, would print output quadratic in the length of the chain.
+#define HBK_SYNTAX_PRINT_MAX_INDENT_DEPTH 64
+
+/// @brief A node waiting to be printed.
+typedef struct hbk_syntax_print_entry {
+    hbk_syntax_id node;
+    int64_t depth;
+    /// @brief Whether this is the last child of its parent, which decides its tree lines.
+    bool is_last;
+} hbk_syntax_print_entry;
+
 typedef struct hbk_syntax_print_context {
     hbk_state* state;
+    hbk_syntax_tree* tree;
     hbk_string* output;
-    hbk_string indents;
     bool use_color;
+    /// @brief The nodes still to print, the next one on top.
+    /// Printing is a loop over this rather than recursion, so deep trees can't overflow the C stack.
+    hbk_vector(hbk_syntax_print_entry) stack;
+    /// @brief The tree lines of the ancestors of the current node, one leader per depth.
+    /// "│ " is the longest leader at four bytes.
+    char indents[HBK_SYNTAX_PRINT_MAX_INDENT_DEPTH * 4];
+    /// @brief How much of `indents` the children of the last node printed at each depth put in front of their own leader.
+    int64_t indents_lengths[HBK_SYNTAX_PRINT_MAX_INDENT_DEPTH];
 } hbk_syntax_print_context;
 
-void hbk_syntax_print(hbk_syntax_print_context* print_context, hbk_syntax* node);
-
-void hbk_syntax_print_children(hbk_syntax_print_context* print_context, hbk_vector(hbk_syntax*) children) {
+/// @brief Prints the line for one node, and pushes its children to be printed after it.
+static void hbk_syntax_print(hbk_syntax_print_context* print_context, hbk_syntax_print_entry entry) {
     HBK_ASSERT(print_context != NULL, "invalid print context pointer");
+    HBK_ASSERT(entry.node != HBK_SYNTAX_NONE, "invalid hibiku syntax node id");
 
     bool use_color = print_context->use_color;
+    hbk_state* state = print_context->state;
+    hbk_syntax_tree* tree = print_context->tree;
+    hbk_string* output = print_context->output;
+    hbk_syntax_id node = entry.node;
+    hbk_syntax_kind kind = hbk_syntax_get_kind(tree, node);
+    hbk_location location = hbk_syntax_get_location(tree, node);
+
+    /// Only the ancestors of this node have printed at the depths above it, so the
+    /// leaders up to its parent's depth are exactly the ones it needs.
+    int64_t indent_depth = entry.depth < HBK_SYNTAX_PRINT_MAX_INDENT_DEPTH ? entry.depth : HBK_SYNTAX_PRINT_MAX_INDENT_DEPTH;
+    if (entry.depth > 0) {
+        int64_t parent_indents_length = print_context->indents_lengths[indent_depth - 1];
+        hbk_string_append_cstr(output, COL(COL_TREE));
+        hbk_string_append_sv(output, (hbk_string_view){print_context->indents, parent_indents_length});
+        if (entry.depth > HBK_SYNTAX_PRINT_MAX_INDENT_DEPTH) {
+            hbk_string_append_cstr(output, "(");
+            hbk_string_append_int(output, entry.depth);
+            hbk_string_append_cstr(output, ") ");
+        }
 
-    for (int64_t i = 0, count = hbk_vector_count(children); i < count; i++) {
-        bool is_last = i == count - 1;
-
-        hbk_syntax* child = children[i];
-        int64_t old_indents_count = hbk_vector_count(print_context->indents);
-
-        const char* next_leader = is_last ? "└─" : "├─";
-        hbk_string_append_format(print_context->output, "%s%s%s", COL(COL_TREE), (print_context->indents ? print_context->indents : ""), next_leader);
-
-        hbk_string_append_format(&print_context->indents, "%s", is_last ? "  " : "│ ");
-        hbk_syntax_print(print_context, child);
-
-        hbk_vector_set_count(print_context->indents, old_indents_count);
-        print_context->indents[old_indents_count] = 0;
+        hbk_string_append_cstr(output, entry.is_last ? "└─" : "├─");
     }
-}
 
-void hbk_syntax_print(hbk_syntax_print_context* print_context, hbk_syntax* node) {
-    HBK_ASSERT(print_context != NULL, "invalid print context pointer");
-    HBK_ASSERT(node != NULL, "invalid hibiku syntax node pointer");
-
-    bool use_color = print_context->use_color;
+    /// This runs for every node, so it sticks to the plain appends rather than formatting.
+    hbk_string_append_cstr(output, COL(COL_TREE));
+    hbk_string_append_cstr(output, hbk_syntax_kind_to_cstring(kind));
+    hbk_string_append_cstr(output, " ");
+    hbk_string_append_cstr(output, COL(COL_ADDRESS));
+    hbk_string_append_cstr(output, "<");
+    hbk_string_append_int(output, node);
+    hbk_string_append_cstr(output, "> ");
+    hbk_string_append_cstr(output, COL(COL_LOCATION));
+    hbk_string_append_cstr(output, "[");
+    hbk_string_append_int(output, location.offset);
+    hbk_string_append_cstr(output, ":");
+    hbk_string_append_int(output, location.length);
+    hbk_string_append_cstr(output, "]");
+    hbk_string_append_cstr(output, COL(RESET));
+
+    /// Children are pushed in order for now, and flipped over below once we know how many there are.
+    int64_t children_start = hbk_vector_count(print_context->stack);
+    hbk_syntax_print_entry child = {
+        .depth = entry.depth + 1,
+    };
 
-    hbk_string_append_format(
-        print_context->output,
-        "%s%s %s<%llX> %s[%lld:%lld]%s",
-        COL(COL_TREE),
-        hbk_syntax_kind_to_cstring(node->kind),
-        COL(COL_ADDRESS),
-        (size_t)node,
-        COL(COL_LOCATION),
-        (long long)node->location.offset,
-        (long long)node->location.length,
-        COL(RESET)
-    );
-
-    hbk_vector(hbk_syntax*) children = NULL;
-
-    switch (node->kind) {
+    switch (kind) {
         default: break;
 
         case HBK_SYNTAX_INVALID: {
-            hbk_string_view source_text = hbk_state_get_source_text(print_context->state, node->location.source_id);
-            hbk_string_append_format(print_context->output, " %s%.*s", COL(RED), (int)node->location.length, source_text.data + node->location.offset);
+            hbk_string_view source_text = hbk_state_get_source_text(state, location.source_id);
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(RED));
+            hbk_string_append_sv(output, (hbk_string_view){source_text.data + location.offset, location.length});
         } break;
 
         case HBK_SYNTAX_DECL_FUNCTION: {
-            hbk_string_append_format(print_context->output, " %s%.*s%s(", COL(COL_NAME), HBK_SV_EXPAND(node->decl_function.name.string_value), COL(RESET));
-            for (int64_t i = 0; i < hbk_vector_count(node->decl_function.parameter_declarations); i++) {
+            hbk_syntax_decl_function func = *hbk_syntax_get_decl_function(tree, node);
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(COL_NAME));
+            hbk_string_append_sv(output, hbk_state_symbol_view(state, func.name));
+            hbk_string_append_cstr(output, COL(RESET));
+            hbk_string_append_cstr(output, "(");
+            for (int64_t i = 0; i < func.parameter_declarations.count; i++) {
                 if (i > 0) {
-                    hbk_string_append_format(print_context->output, "%s, ", COL(RESET));
+                    hbk_string_append_cstr(output, COL(RESET));
+                    hbk_string_append_cstr(output, ", ");
                 }
 
-                hbk_syntax* parameter_syntax = node->decl_function.parameter_declarations[i];
-                hbk_vector_push(children, parameter_syntax);
-
-                hbk_string_append_format(print_context->output, "%s%.*s", COL(COL_NAME), HBK_SV_EXPAND(parameter_syntax->decl_parameter.name.string_value), COL(RESET));
-                if (parameter_syntax->decl_parameter.type != NULL) {
-                    hbk_string_append_format(print_context->output, " %s: ", COL(RESET));
-                    hbk_syntax_type_print_to_string(print_context->state, parameter_syntax->decl_parameter.type, print_context->output, print_context->use_color);
+                hbk_syntax_id parameter_syntax = hbk_syntax_range_get(tree, func.parameter_declarations, i);
+                child.node = parameter_syntax;
+                hbk_vector_push(print_context->stack, child);
+
+                hbk_syntax_decl_parameter param = *hbk_syntax_get_decl_parameter(tree, parameter_syntax);
+                hbk_string_append_cstr(output, COL(COL_NAME));
+                hbk_string_append_sv(output, hbk_state_symbol_view(state, param.name));
+                if (param.type != HBK_SYNTAX_NONE) {
+                    hbk_string_append_cstr(output, " ");
+                    hbk_string_append_cstr(output, COL(RESET));
+                    hbk_string_append_cstr(output, ": ");
+                    hbk_syntax_type_print_to_string(tree, param.type, output, use_color);
                 }
             }
 
-            hbk_string_append_format(print_context->output, "%s)", COL(RESET));
-            if (node->decl_function.return_type != NULL) {
-                hbk_string_append_format(print_context->output, " %s: ", COL(RESET));
-                hbk_syntax_type_print_to_string(print_context->state, node->decl_function.return_type, print_context->output, print_context->use_color);
+            hbk_string_append_cstr(output, COL(RESET));
+            hbk_string_append_cstr(output, ")");
+            if (func.return_type != HBK_SYNTAX_NONE) {
+                hbk_string_append_cstr(output, " ");
+                hbk_string_append_cstr(output, COL(RESET));
+                hbk_string_append_cstr(output, ": ");
+                hbk_syntax_type_print_to_string(tree, func.return_type, output, use_color);
             }
 
-            if (node->decl_function.body != NULL) {
-                hbk_vector_push(children, node->decl_function.body);
+            if (func.body != HBK_SYNTAX_NONE) {
+                child.node = func.body;
+                hbk_vector_push(print_context->stack, child);
             }
         } break;
 
         case HBK_SYNTAX_DECL_PARAMETER: {
-            hbk_string_append_format(print_context->output, " %s%.*s", COL(COL_NAME), HBK_SV_EXPAND(node->decl_parameter.name.string_value));
-            if (node->decl_parameter.type != NULL) {
-                hbk_string_append_format(print_context->output, " %s: ", COL(RESET));
-                hbk_syntax_type_print_to_string(print_context->state, node->decl_parameter.type, print_context->output, print_context->use_color);
+            hbk_syntax_decl_parameter param = *hbk_syntax_get_decl_parameter(tree, node);
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(COL_NAME));
+            hbk_string_append_sv(output, hbk_state_symbol_view(state, param.name));
+            if (param.type != HBK_SYNTAX_NONE) {
+                hbk_string_append_cstr(output, " ");
+                hbk_string_append_cstr(output, COL(RESET));
+                hbk_string_append_cstr(output, ": ");
+                hbk_syntax_type_print_to_string(tree, param.type, output, use_color);
             }
 
-            if (node->decl_parameter.default_value != NULL) {
-                hbk_vector_push(children, node->decl_parameter.default_value);
+            if (param.default_value != HBK_SYNTAX_NONE) {
+                child.node = param.default_value;
+                hbk_vector_push(print_context->stack, child);
             }
         } break;
 
         case HBK_SYNTAX_DECL_VARIABLE: {
-            hbk_string_append_format(print_context->output, " %s%.*s", COL(COL_NAME), HBK_SV_EXPAND(node->decl_variable.name.string_value));
-            if (node->decl_variable.type != NULL) {
-                hbk_string_append_format(print_context->output, " %s: ", COL(RESET));
-                hbk_syntax_type_print_to_string(print_context->state, node->decl_variable.type, print_context->output, print_context->use_color);
+            hbk_syntax_decl_variable var = *hbk_syntax_get_decl_variable(tree, node);
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(COL_NAME));
+            hbk_string_append_sv(output, hbk_state_symbol_view(state, var.name));
+            if (var.type != HBK_SYNTAX_NONE) {
+                hbk_string_append_cstr(output, " ");
+                hbk_string_append_cstr(output, COL(RESET));
+                hbk_string_append_cstr(output, ": ");
+                hbk_syntax_type_print_to_string(tree, var.type, output, use_color);
             }
 
-            if (node->decl_variable.default_value != NULL) {
-                hbk_vector_push(children, node->decl_variable.default_value);
+            if (var.default_value != HBK_SYNTAX_NONE) {
+                child.node = var.default_value;
+                hbk_vector_push(print_context->stack, child);
             }
         } break;
 
         case HBK_SYNTAX_STMT_ARROW: {
-            hbk_vector_push(children, node->stmt_arrow.value);
+            child.node = hbk_syntax_get_arrow_value(tree, node);
+            hbk_vector_push(print_context->stack, child);
+        } break;
+
+        case HBK_SYNTAX_BINARY: {
+            hbk_syntax_binary binary = *hbk_syntax_get_binary(tree, node);
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(COL_KEYWORD));
+            hbk_string_append_cstr(output, hbk_token_kind_to_cstring(binary.operator));
+            child.node = binary.lhs;
+            hbk_vector_push(print_context->stack, child);
+            child.node = binary.rhs;
+            hbk_vector_push(print_context->stack, child);
         } break;
 
         case HBK_SYNTAX_IDENTIFIER: {
-            hbk_string_append_format(print_context->output, " %s%.*s", COL(COL_NAME), HBK_SV_EXPAND(node->identifier.name.string_value));
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(COL_NAME));
+            hbk_string_append_sv(output, hbk_state_symbol_view(state, hbk_syntax_get_identifier_name(tree, node)));
         } break;
 
         case HBK_SYNTAX_INTEGER_LITERAL: {
-            hbk_string_append_format(print_context->output, " %s%lld", COL(COL_LITERAL), node->literal.integer_value);
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(COL_LITERAL));
+            hbk_string_append_int(output, hbk_syntax_get_integer_value(tree, node));
         } break;
 
         case HBK_SYNTAX_STRING_LITERAL: {
             // TODO(local): print the escaped version of the literal
-            hbk_string_append_format(print_context->output, " %s\"%.*s\"", COL(COL_LITERAL), HBK_SV_EXPAND(node->literal.string_value));
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(COL_LITERAL));
+            hbk_string_append_cstr(output, "\"");
+            hbk_string_append_sv(output, hbk_state_symbol_view(state, hbk_syntax_get_string_value(tree, node)));
+            hbk_string_append_cstr(output, "\"");
         } break;
 
         case HBK_SYNTAX_BOOL_LITERAL: {
-            hbk_string_append_format(print_context->output, " %s%s", COL(COL_LITERAL), node->literal.bool_value ? "true" : "false");
+            hbk_string_append_cstr(output, " ");
+            hbk_string_append_cstr(output, COL(COL_LITERAL));
+            hbk_string_append_cstr(output, hbk_syntax_get_bool_value(tree, node) ? "true" : "false");
         } break;
     }
 
-    hbk_string_append_format(print_context->output, "%s\n", COL(RESET));
+    hbk_string_append_cstr(output, COL(RESET));
+    hbk_string_append_cstr(output, "\n");
 
-    if (children != NULL) {
-        hbk_syntax_print_children(print_context, children);
-        hbk_vector_free(children);
+    int64_t children_end = hbk_vector_count(print_context->stack);
+    if (children_start == children_end) {
+        return;
     }
+
+    print_context->stack[children_end - 1].is_last = true;
+    for (int64_t i = children_start, j = children_end - 1; i < j; i++, j--) {
+        hbk_syntax_print_entry temp = print_context->stack[i];
+        print_context->stack[i] = print_context->stack[j];
+        print_context->stack[j] = temp;
+    }
+
+    /// Past the maximum depth the indentation stays the same, so there's nothing to record.
+    if (entry.depth >= HBK_SYNTAX_PRINT_MAX_INDENT_DEPTH) {
+        return;
+    }
+
+    int64_t indents_length = 0;
+    if (entry.depth > 0) {
+        const char* child_indent = entry.is_last ? "  " : "│ ";
+        int64_t child_indent_length = (int64_t)strlen(child_indent);
+        indents_length = print_context->indents_lengths[entry.depth - 1];
+        memcpy(print_context->indents + indents_length, child_indent, (size_t)child_indent_length);
+        indents_length += child_indent_length;
+    }
+
+    print_context->indents_lengths[entry.depth] = indents_length;
 }
 
 void hbk_syntax_tree_print_to_string(hbk_state* state, hbk_syntax_tree* tree, hbk_string* out_string, bool use_color) {
@@ -532,32 +911,48 @@ void hbk_syntax_tree_print_to_string(hbk_state* state, hbk_syntax_tree* tree, hb
 
     hbk_syntax_print_context print_context = {
         .state = state,
-        .indents = NULL,
+        .tree = tree,
         .output = out_string,
         .use_color = use_color,
     };
 
-    for (int64_t i = 0; i < hbk_vector_count(tree->syntax_nodes); i++) {
-        hbk_syntax_print(&print_context, tree->syntax_nodes[i]);
+    hbk_vector_init(print_context.stack, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+
+    for (int64_t i = 0; i < hbk_vector_count(tree->declarations); i++) {
+        hbk_syntax_print_entry root = {
+            .node = tree->declarations[i],
+        };
+
+        hbk_vector_push(print_context.stack, root);
+        while (hbk_vector_count(print_context.stack) > 0) {
+            hbk_syntax_print_entry entry = print_context.stack[hbk_vector_count(print_context.stack) - 1];
+            hbk_vector_set_count(print_context.stack, hbk_vector_count(print_context.stack) - 1);
+            hbk_syntax_print(&print_context, entry);
+        }
     }
+
+    hbk_vector_free(print_context.stack);
 }
 
-void hbk_syntax_type_print_to_string(hbk_state* state, hbk_syntax* type, hbk_string* out_string, bool use_color) {
-    HBK_ASSERT(state != NULL, "invalid state pointer");
-    HBK_ASSERT(type != NULL, "invalid syntax node pointer");
+void hbk_syntax_type_print_to_string(hbk_syntax_tree* tree, hbk_syntax_id type, hbk_string* out_string, bool use_color) {
+    HBK_ASSERT(tree != NULL, "invalid tree pointer");
+    HBK_ASSERT(type != HBK_SYNTAX_NONE, "invalid syntax node id");
     HBK_ASSERT(out_string != NULL, "invalid (output) string pointer");
 
-    switch (type->kind) {
+    hbk_syntax_kind kind = hbk_syntax_get_kind(tree, type);
+    switch (kind) {
         default: {
-            hbk_string_append_format(out_string, "%s<unknown type %s>", COL(RED), hbk_syntax_kind_to_cstring(type->kind));
+            hbk_string_append_format(out_string, "%s<unknown type %s>", COL(RED), hbk_syntax_kind_to_cstring(kind));
         } break;
 
         case HBK_SYNTAX_INVALID: {
-            hbk_string_append_format(out_string, "%s<invalid>", COL(RED));
+            hbk_string_append_cstr(out_string, COL(RED));
+            hbk_string_append_cstr(out_string, "<invalid>");
         } break;
 
         case HBK_SYNTAX_TYPE_INTEGER: {
-            hbk_string_append_format(out_string, "%sint", COL(COL_KEYWORD));
+            hbk_string_append_cstr(out_string, COL(COL_KEYWORD));
+            hbk_string_append_cstr(out_string, "int");
         } break;
     }
 }
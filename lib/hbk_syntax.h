@@ -20,6 +20,7 @@
     X(FLOAT_LITERAL)        \
     X(BOOL_LITERAL)         \
     X(STRING_LITERAL)       \
+    X(BINARY)               \
     X(TYPE_INTEGER)
 
 typedef enum hbk_syntax_kind {
@@ -31,61 +32,80 @@ typedef enum hbk_syntax_kind {
 } hbk_syntax_kind;
 
 typedef struct hbk_syntax_tree hbk_syntax_tree;
-typedef struct hbk_syntax hbk_syntax;
 
+/// @brief A handle to a node in a `hbk_syntax_tree`. Nodes are never individually
+/// allocated, they live in the tree's arrays and are addressed by index.
+typedef uint32_t hbk_syntax_id;
+/// @brief The id which means "no node", for optional children. Index 0 of every tree
+/// is reserved for it, so a zero-initialized id is always empty.
+#define HBK_SYNTAX_NONE ((hbk_syntax_id)0)
+
+/// @brief A list of child nodes, stored as a slice of the tree's `extra` array.
+typedef struct hbk_syntax_range {
+    uint32_t start;
+    uint32_t count;
+} hbk_syntax_range;
+
+typedef struct hbk_syntax_decl_function {
+    hbk_symbol name;
+    bool is_exported;
+    hbk_syntax_range parameter_declarations;
+    hbk_syntax_id return_type;
+    hbk_syntax_id body;
+} hbk_syntax_decl_function;
+
+typedef struct hbk_syntax_decl_parameter {
+    hbk_symbol name;
+    hbk_syntax_id type;
+    hbk_syntax_id default_value;
+} hbk_syntax_decl_parameter;
+
+typedef struct hbk_syntax_decl_variable {
+    hbk_symbol name;
+    bool is_exported;
+    hbk_syntax_id type;
+    hbk_syntax_id default_value;
+} hbk_syntax_decl_variable;
+
+typedef struct hbk_syntax_binary {
+    /// @brief The operator token, e.g. '+' or HBK_TOKEN_EQUALEQUAL.
+    hbk_token_kind operator;
+    hbk_syntax_id lhs;
+    hbk_syntax_id rhs;
+} hbk_syntax_binary;
+
+/// @brief The syntax tree of a single source, and the owner of every node in it.
+///
+/// Every node has a kind, a location and a 32-bit `data` word, each stored in its own
+/// array and indexed by the node's `hbk_syntax_id`. What `data` means depends on the kind:
+///
+///   DECL_FUNCTION, DECL_PARAMETER, DECL_VARIABLE, BINARY: an index into the matching side array.
+///   INTEGER_LITERAL: an index into `integer_literals`.
+///   STMT_ARROW: the id of the returned value.
+///   IDENTIFIER, STRING_LITERAL: the interned `hbk_symbol`.
+///   BOOL_LITERAL: 1 for true, 0 for false.
+///   everything else: unused, always 0.
+///
+/// That way small nodes like identifiers cost 13 bytes, and only the kinds which need
+/// more pay for it. Use the `hbk_syntax_*` accessors rather than decoding `data` by hand.
 struct hbk_syntax_tree {
-    hbk_arena* arena;
+    hbk_state* state;
 
     hbk_source_id source_id;
-    hbk_vector(hbk_syntax*) syntax_nodes;
-};
-
-// If you don't know what tagged unions are: https://en.wikipedia.org/wiki/Tagged_union
-struct hbk_syntax {
-    hbk_syntax_kind kind;
-    hbk_location location;
-
-    union {
-        struct {
-            hbk_token token;
-        } invalid;
-
-        struct {
-            bool is_exported;
-            hbk_token name;
-            hbk_vector(hbk_syntax*) parameter_declarations;
-            hbk_syntax* return_type;
-            hbk_syntax* body;
-        } decl_function;
-
-        struct {
-            hbk_token name;
-            hbk_syntax* type;
-            hbk_syntax* default_value;
-        } decl_parameter;
-
-        struct {
-            bool is_exported;
-            hbk_token name;
-            hbk_syntax* type;
-            hbk_syntax* default_value;
-        } decl_variable;
-
-        struct {
-            hbk_syntax* value;
-        } stmt_arrow;
-
-        struct {
-            hbk_token name;
-        } identifier;
-
-        struct {
-            int64_t integer_value;
-            double float_value;
-            bool bool_value;
-            hbk_string_view string_value;
-        } literal;
-    };
+    /// @brief The top-level declarations, in source order.
+    hbk_vector(hbk_syntax_id) declarations;
+
+    hbk_vector(uint8_t) kinds;
+    hbk_vector(hbk_packed_location) locations;
+    hbk_vector(uint32_t) data;
+
+    hbk_vector(hbk_syntax_decl_function) decl_functions;
+    hbk_vector(hbk_syntax_decl_parameter) decl_parameters;
+    hbk_vector(hbk_syntax_decl_variable) decl_variables;
+    hbk_vector(hbk_syntax_binary) binaries;
+    hbk_vector(int64_t) integer_literals;
+    /// @brief Child lists of every node, referenced by `hbk_syntax_range`s.
+    hbk_vector(hbk_syntax_id) extra;
 };
 
 const char* hbk_syntax_kind_to_cstring(hbk_syntax_kind kind);
@@ -93,9 +113,30 @@ const char* hbk_syntax_kind_to_cstring(hbk_syntax_kind kind);
 void hbk_syntax_tree_destroy(hbk_syntax_tree* tree);
 void hbk_syntax_tree_print_to_string(hbk_state* state, hbk_syntax_tree* tree, hbk_string* out_string, bool use_color);
 
-hbk_syntax* hbk_syntax_create(hbk_syntax_tree* tree, hbk_syntax_kind kind, hbk_location location);
-void hbk_syntax_type_print_to_string(hbk_state* state, hbk_syntax* type, hbk_string* out_string, bool use_color);
+/// @brief Adds a node to the tree. See `hbk_syntax_tree` for what `data` means for each kind.
+hbk_syntax_id hbk_syntax_create(hbk_syntax_tree* tree, hbk_syntax_kind kind, hbk_location location, uint32_t data);
+void hbk_syntax_type_print_to_string(hbk_syntax_tree* tree, hbk_syntax_id type, hbk_string* out_string, bool use_color);
+
+hbk_syntax_kind hbk_syntax_get_kind(hbk_syntax_tree* tree, hbk_syntax_id id);
+hbk_location hbk_syntax_get_location(hbk_syntax_tree* tree, hbk_syntax_id id);
+/// @brief Returns the id of the `index`th node in the child list `range`.
+hbk_syntax_id hbk_syntax_range_get(hbk_syntax_tree* tree, hbk_syntax_range range, int64_t index);
+
+/// The returned pointers are only valid until the next node of the same kind is created.
+hbk_syntax_decl_function* hbk_syntax_get_decl_function(hbk_syntax_tree* tree, hbk_syntax_id id);
+hbk_syntax_decl_parameter* hbk_syntax_get_decl_parameter(hbk_syntax_tree* tree, hbk_syntax_id id);
+hbk_syntax_decl_variable* hbk_syntax_get_decl_variable(hbk_syntax_tree* tree, hbk_syntax_id id);
+hbk_syntax_binary* hbk_syntax_get_binary(hbk_syntax_tree* tree, hbk_syntax_id id);
+hbk_syntax_id hbk_syntax_get_arrow_value(hbk_syntax_tree* tree, hbk_syntax_id id);
+hbk_symbol hbk_syntax_get_identifier_name(hbk_syntax_tree* tree, hbk_syntax_id id);
+int64_t hbk_syntax_get_integer_value(hbk_syntax_tree* tree, hbk_syntax_id id);
+bool hbk_syntax_get_bool_value(hbk_syntax_tree* tree, hbk_syntax_id id);
+hbk_symbol hbk_syntax_get_string_value(hbk_syntax_tree* tree, hbk_syntax_id id);
 
 hbk_syntax_tree* hbk_parse(hbk_state* state, hbk_source_id source_id);
 
+/// @brief Returns the syntax tree for the given source, parsing it first if it hasn't been already.
+/// The tree is owned by the state.
+hbk_syntax_tree* hbk_state_get_source_syntax(hbk_state* state, hbk_source_id source_id);
+
 #endif // !HBK_PARSE_H
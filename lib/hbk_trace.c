@@ -0,0 +1,196 @@
+#include "hbk_internal.h"
+#include "hbk_os.h"
+#include "hbk_trace.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+/// Events per thread. A source takes 8 (begin and end for read, lex, parse and print),
+/// so this holds the last few thousand sources a thread worked on.
+#define HBK_TRACE_BUFFER_CAPACITY (1 << 16)
+
+typedef struct hbk_trace_event {
+    const char* name;
+    hbk_string_view detail;
+    int64_t timestamp_nanoseconds;
+    char phase;
+} hbk_trace_event;
+
+typedef struct hbk_trace_buffer hbk_trace_buffer;
+struct hbk_trace_buffer {
+    hbk_trace_buffer* next;
+    /// @brief Identifies the thread which owns this buffer, see `hbk_trace_thread_identity`.
+    const void* thread_identity;
+    /// @brief The thread id in the output, counting up from 1 in the order threads started recording.
+    int64_t thread_id;
+    /// @brief The number of events ever recorded. Only the owning thread writes it, and the event
+    /// at `write_count - 1` is complete before the new count is published.
+    _Atomic uint64_t write_count;
+    hbk_trace_event events[HBK_TRACE_BUFFER_CAPACITY];
+};
+
+struct hbk_trace {
+    const hbk_allocator* allocator;
+    /// @brief Tells traces apart in the per-thread cache, even when one is allocated where an old one used to be.
+    uint64_t generation;
+    int64_t start_nanoseconds;
+    _Atomic(hbk_trace_buffer*) buffers;
+    _Atomic int64_t buffer_count;
+};
+
+static _Atomic uint64_t hbk_trace_next_generation = 1;
+
+/// The buffer this thread used last, and the trace it belongs to. Threads nearly always
+/// record into the same trace over and over, so this saves looking through the list.
+static _Thread_local uint64_t hbk_trace_cached_generation;
+static _Thread_local hbk_trace_buffer* hbk_trace_cached_buffer;
+
+/// @brief Something unique to each running thread: the address of one of its thread-locals.
+/// A new thread may get the address of one which has exited, but then it can have its buffer too.
+static const void* hbk_trace_thread_identity() {
+    static _Thread_local char identity;
+    return &identity;
+}
+
+hbk_trace* hbk_trace_create(const hbk_allocator* allocator) {
+    HBK_ASSERT(allocator != NULL, "Invalid allocator pointer");
+
+    hbk_trace* trace = hbk_allocator_alloc(allocator, sizeof *trace);
+    *trace = (hbk_trace){
+        .allocator = allocator,
+        .generation = atomic_fetch_add(&hbk_trace_next_generation, 1),
+        .start_nanoseconds = hbk_os_monotonic_nanoseconds(),
+    };
+
+    return trace;
+}
+
+void hbk_trace_destroy(hbk_trace* trace) {
+    if (trace == NULL) return;
+
+    hbk_trace_buffer* buffer = atomic_load(&trace->buffers);
+    while (buffer != NULL) {
+        hbk_trace_buffer* next = buffer->next;
+        hbk_allocator_free(trace->allocator, buffer, sizeof *buffer);
+        buffer = next;
+    }
+
+    hbk_allocator_free(trace->allocator, trace, sizeof *trace);
+}
+
+static hbk_trace_buffer* hbk_trace_get_thread_buffer(hbk_trace* trace) {
+    if (hbk_trace_cached_generation == trace->generation) {
+        return hbk_trace_cached_buffer;
+    }
+
+    const void* identity = hbk_trace_thread_identity();
+
+    hbk_trace_buffer* buffer = atomic_load_explicit(&trace->buffers, memory_order_acquire);
+    for (; buffer != NULL; buffer = buffer->next) {
+        if (buffer->thread_identity == identity) {
+            break;
+        }
+    }
+
+    if (buffer == NULL) {
+        /// The events don't need zeroing, only the first `write_count` of them are ever read.
+        buffer = hbk_allocator_alloc(trace->allocator, sizeof *buffer);
+        buffer->thread_identity = identity;
+        buffer->thread_id = atomic_fetch_add(&trace->buffer_count, 1) + 1;
+        atomic_init(&buffer->write_count, 0);
+
+        buffer->next = atomic_load_explicit(&trace->buffers, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&trace->buffers, &buffer->next, buffer, memory_order_release, memory_order_relaxed)) {
+        }
+    }
+
+    hbk_trace_cached_generation = trace->generation;
+    hbk_trace_cached_buffer = buffer;
+    return buffer;
+}
+
+void hbk_trace_record(hbk_trace* trace, char phase, const char* name, hbk_string_view detail, int64_t timestamp_nanoseconds) {
+    HBK_ASSERT(trace != NULL, "Invalid trace pointer");
+    HBK_ASSERT(phase == 'B' || phase == 'E', "Trace events must begin or end a span");
+
+    hbk_trace_buffer* buffer = hbk_trace_get_thread_buffer(trace);
+
+    uint64_t write_count = atomic_load_explicit(&buffer->write_count, memory_order_relaxed);
+    buffer->events[write_count % HBK_TRACE_BUFFER_CAPACITY] = (hbk_trace_event){
+        .name = name,
+        .detail = detail,
+        .timestamp_nanoseconds = timestamp_nanoseconds,
+        .phase = phase,
+    };
+
+    atomic_store_explicit(&buffer->write_count, write_count + 1, memory_order_release);
+}
+
+/// @brief Writes nanoseconds as the fractional microseconds the trace format wants, without going through a double.
+static void hbk_trace_write_microseconds(hbk_file_writer* writer, int64_t nanoseconds) {
+    if (nanoseconds < 0) {
+        hbk_file_writer_write(writer, "-", 1);
+        nanoseconds = -nanoseconds;
+    }
+
+    hbk_file_writer_write_int(writer, nanoseconds / 1000);
+    int64_t fraction = nanoseconds % 1000;
+    char fraction_digits[4] = {'.', (char)('0' + fraction / 100), (char)('0' + fraction / 10 % 10), (char)('0' + fraction % 10)};
+    hbk_file_writer_write(writer, fraction_digits, sizeof fraction_digits);
+}
+
+void hbk_trace_write_json(hbk_trace* trace, FILE* file) {
+    HBK_ASSERT(trace != NULL, "Invalid trace pointer");
+    HBK_ASSERT(file != NULL, "Invalid file pointer");
+
+    hbk_file_writer writer = {.file = file};
+    hbk_file_writer_write_cstr(&writer, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    bool first_event = true;
+    int64_t dropped_count = 0;
+
+    hbk_trace_buffer* buffer = atomic_load_explicit(&trace->buffers, memory_order_acquire);
+    for (; buffer != NULL; buffer = buffer->next) {
+        if (!first_event) {
+            hbk_file_writer_write_cstr(&writer, ",\n");
+        }
+
+        first_event = false;
+
+        /// Name the thread, so Perfetto doesn't just show the number.
+        hbk_file_writer_write_cstr(&writer, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+        hbk_file_writer_write_int(&writer, buffer->thread_id);
+        hbk_file_writer_write_cstr(&writer, ",\"args\":{\"name\":\"hibiku thread ");
+        hbk_file_writer_write_int(&writer, buffer->thread_id);
+        hbk_file_writer_write_cstr(&writer, "\"}}");
+
+        uint64_t write_count = atomic_load_explicit(&buffer->write_count, memory_order_acquire);
+        uint64_t first_index = write_count > HBK_TRACE_BUFFER_CAPACITY ? write_count - HBK_TRACE_BUFFER_CAPACITY : 0;
+        dropped_count += (int64_t)first_index;
+
+        for (uint64_t i = first_index; i < write_count; i++) {
+            hbk_trace_event* event = &buffer->events[i % HBK_TRACE_BUFFER_CAPACITY];
+
+            hbk_file_writer_write_cstr(&writer, ",\n{\"name\":\"");
+            hbk_file_writer_write_cstr(&writer, event->name);
+            hbk_file_writer_write_cstr(&writer, "\",\"cat\":\"hibiku\",\"ph\":\"");
+            hbk_file_writer_write(&writer, &event->phase, 1);
+            hbk_file_writer_write_cstr(&writer, "\",\"ts\":");
+            hbk_trace_write_microseconds(&writer, event->timestamp_nanoseconds - trace->start_nanoseconds);
+            hbk_file_writer_write_cstr(&writer, ",\"pid\":1,\"tid\":");
+            hbk_file_writer_write_int(&writer, buffer->thread_id);
+            if (event->phase == 'B' && event->detail.count > 0) {
+                hbk_file_writer_write_cstr(&writer, ",\"args\":{\"source\":");
+                hbk_file_writer_write_json_string(&writer, event->detail);
+                hbk_file_writer_write_cstr(&writer, "}");
+            }
+
+            hbk_file_writer_write_cstr(&writer, "}");
+        }
+    }
+
+    hbk_file_writer_write_cstr(&writer, "\n],\"otherData\":{\"dropped_events\":");
+    hbk_file_writer_write_int(&writer, dropped_count);
+    hbk_file_writer_write_cstr(&writer, "}}\n");
+    hbk_file_writer_flush(&writer);
+}
@@ -0,0 +1,32 @@
+#ifndef HBK_TRACE_H
+#define HBK_TRACE_H
+
+#include <hibiku.h>
+#include <stdint.h>
+
+/// A recorder for begin and end events of the compiler's passes, written out in the
+/// Chrome Trace Event format so a run can be looked at as a timeline in Perfetto or
+/// chrome://tracing.
+///
+/// Every thread that records gets its own ring buffer, so recording never takes a lock
+/// and never waits on another thread. The buffers are found again through a list which
+/// threads add themselves to with a compare-and-swap. When a ring is full, the oldest
+/// events are overwritten, and the trace says how many were lost.
+
+typedef struct hbk_trace hbk_trace;
+
+/// @brief Creates an empty trace. Timestamps in the output are relative to this point.
+hbk_trace* hbk_trace_create(const hbk_allocator* allocator);
+void hbk_trace_destroy(hbk_trace* trace);
+
+/// @brief Records an event on the calling thread's ring.
+/// @param phase 'B' for the beginning of a span, 'E' for its end.
+/// @param name A string which outlives the trace, usually a string literal.
+/// @param detail What the span was working on, e.g. a source name. It must outlive the trace too, and can be empty.
+void hbk_trace_record(hbk_trace* trace, char phase, const char* name, hbk_string_view detail, int64_t timestamp_nanoseconds);
+
+/// @brief Writes every recorded event as a Chrome Trace Event JSON object.
+/// No thread may be recording into the trace while this runs.
+void hbk_trace_write_json(hbk_trace* trace, FILE* file);
+
+#endif // !HBK_TRACE_H
@@ -4,54 +4,137 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define HBK_VECTOR_MIN_CAPACITY 32
+/// The least memory a vector grows to the first time, in bytes rather than elements,
+/// so byte strings don't crawl up from tiny sizes and big structs don't start out huge.
+#define HBK_VECTOR_MIN_BYTES 256
+
+static size_t hbk_vector_allocation_size(int64_t element_size, int64_t capacity) {
+    return sizeof(hbk_vector_header) + (size_t)(element_size * capacity);
+}
+
+void hbk_vector_init_with_allocator(void** vector_address, const hbk_allocator* allocator) {
+    HBK_ASSERT(vector_address != NULL, "Invalid vector address pointer");
+    HBK_ASSERT(*vector_address == NULL, "Only empty (NULL) vectors can be initialized");
+    HBK_ASSERT(allocator != NULL, "Invalid allocator pointer");
+
+    hbk_vector_header* header = hbk_allocator_alloc(allocator, hbk_vector_allocation_size(1, 0));
+    *header = (hbk_vector_header){
+        .allocator = allocator,
+    };
+
+    *vector_address = header + 1;
+}
+
+void hbk_vector_release(void* vector, int64_t element_size) {
+    if (vector == NULL) return;
+    hbk_vector_header* header = hbk_vector_get_header(vector);
+    hbk_allocator_free(header->allocator, header, hbk_vector_allocation_size(element_size, header->capacity));
+}
+
+/// @brief Moves the vector to an allocation with exactly `capacity` elements of room.
+/// A NULL vector gets a new allocation from the default allocator. Nothing is zeroed.
+static void hbk_vector_reallocate(void** vector_address, int64_t element_size, int64_t capacity) {
+    hbk_vector_header* header = NULL;
+    if (*vector_address == NULL) {
+        const hbk_allocator* allocator = hbk_default_allocator();
+        header = hbk_allocator_alloc(allocator, hbk_vector_allocation_size(element_size, capacity));
+        *header = (hbk_vector_header){
+            .allocator = allocator,
+        };
+    } else {
+        header = hbk_vector_get_header(*vector_address);
+        header = hbk_allocator_realloc(
+            header->allocator,
+            header,
+            hbk_vector_allocation_size(element_size, header->capacity),
+            hbk_vector_allocation_size(element_size, capacity)
+        );
+    }
+
+    header->capacity = capacity;
+    *vector_address = header + 1;
+}
 
 void hbk_vector_ensure_capacity(void** vector_address, int64_t element_size, int64_t minimum_capacity) {
     HBK_ASSERT(vector_address != NULL, "Invalid vector address pointer");
     HBK_ASSERT(element_size > 0, "Invalid element size");
     HBK_ASSERT(minimum_capacity >= 0, "Invalid vector minimum capacity");
 
-    if (minimum_capacity == 0) {
+    int64_t capacity = hbk_vector_capacity(*vector_address);
+    if (minimum_capacity <= capacity) {
         return;
     }
 
-    hbk_vector_header* header = NULL;
+    /// Vectors set up with `hbk_vector_init` start out with no capacity at all.
+    int64_t min_capacity = HBK_VECTOR_MIN_BYTES / element_size;
+    int64_t new_capacity = capacity < min_capacity ? min_capacity : capacity;
+    if (new_capacity < 1) {
+        new_capacity = 1;
+    }
+
+    while (new_capacity < minimum_capacity) {
+        new_capacity *= 2;
+    }
+
+    hbk_vector_reallocate(vector_address, element_size, new_capacity);
+}
+
+void hbk_vector_set_capacity_exact(void** vector_address, int64_t element_size, int64_t capacity) {
+    HBK_ASSERT(vector_address != NULL, "Invalid vector address pointer");
+    HBK_ASSERT(element_size > 0, "Invalid element size");
+    HBK_ASSERT(capacity >= 0, "Invalid vector capacity");
+
+    if (capacity <= hbk_vector_capacity(*vector_address)) {
+        return;
+    }
+
+    hbk_vector_reallocate(vector_address, element_size, capacity);
+}
+
+void hbk_vector_shrink(void** vector_address, int64_t element_size) {
+    HBK_ASSERT(vector_address != NULL, "Invalid vector address pointer");
+    HBK_ASSERT(element_size > 0, "Invalid element size");
+
     if (*vector_address == NULL) {
-        if (minimum_capacity < HBK_VECTOR_MIN_CAPACITY) {
-            minimum_capacity = HBK_VECTOR_MIN_CAPACITY;
-        }
+        return;
+    }
 
-        header = malloc((sizeof *header) + (element_size * minimum_capacity));
-        HBK_ASSERT(header != NULL, "Buy more ram lol");
-        header->capacity = minimum_capacity;
-        header->count = 0;
+    int64_t count = hbk_vector_count(*vector_address);
+    if (count == hbk_vector_capacity(*vector_address)) {
+        return;
+    }
 
-        void* data = header + 1;
-        memset(data, 0, (size_t)(element_size * minimum_capacity));
+    hbk_vector_reallocate(vector_address, element_size, count);
+}
 
-        *vector_address = data;
-    } else {
-        header = (hbk_vector_header*)(*vector_address) - 1;
-        if (minimum_capacity <= header->capacity) {
-            return;
-        }
+void hbk_vector_append_elements(void** vector_address, int64_t element_size, const void* elements, int64_t count) {
+    HBK_ASSERT(vector_address != NULL, "Invalid vector address pointer");
+    HBK_ASSERT(count >= 0, "Invalid element count");
+    HBK_ASSERT(count == 0 || elements != NULL, "Invalid elements pointer");
 
-        int64_t original_count = header->count;
+    if (count == 0) {
+        return;
+    }
 
-        int64_t new_capacity = header->capacity;
-        while (new_capacity < minimum_capacity) {
-            new_capacity *= 2;
-        }
+    int64_t old_count = hbk_vector_count(*vector_address);
+    hbk_vector_ensure_capacity(vector_address, element_size, old_count + count);
+    memcpy((char*)*vector_address + element_size * old_count, elements, (size_t)(element_size * count));
+    hbk_vector_get_header(*vector_address)->count = old_count + count;
+}
 
-        header = realloc(header, (sizeof *header) + (element_size * new_capacity));
-        HBK_ASSERT(header != NULL, "Buy more ram lol");
-        header->capacity = new_capacity;
+void hbk_vector_set_count_and_zero(void** vector_address, int64_t element_size, int64_t count) {
+    HBK_ASSERT(vector_address != NULL, "Invalid vector address pointer");
+    HBK_ASSERT(count >= 0, "Invalid element count");
 
-        void* data = header + 1;
-        memset((char*)data + (element_size * original_count), 0, (size_t)(element_size * (new_capacity - original_count)));
+    int64_t old_count = hbk_vector_count(*vector_address);
+    hbk_vector_ensure_capacity(vector_address, element_size, count);
+    if (*vector_address == NULL) {
+        return;
+    }
 
-        *vector_address = data;
+    if (count > old_count) {
+        memset((char*)*vector_address + element_size * old_count, 0, (size_t)(element_size * (count - old_count)));
     }
 
-    HBK_ASSERT(*vector_address != NULL, "Failed to populate vector data");
+    hbk_vector_get_header(*vector_address)->count = count;
 }
@@ -1,5 +1,11 @@
+#include "hbk_hasmap.h"
 #include "hbk_internal.h"
+#include "hbk_interner.h"
+#include "hbk_os.h"
+#include "hbk_parallel.h"
+#include "hbk_scan.h"
 #include "hbk_syntax.h"
+#include "hbk_trace.h"
 
 #include <hibiku.h>
 #include <stdio.h>
@@ -8,18 +14,114 @@
 
 typedef struct hbk_source {
     hbk_string_view name;
-    hbk_string text;
+    /// @brief The source text, which is always NUL-terminated.
+    /// This points either into `owned_text` or into `mapping`, whichever is in use.
+    hbk_string_view text;
+    /// @brief The text, if it was read into memory.
+    hbk_string owned_text;
+    /// @brief The memory mapping of the source file, if it was mapped rather than read.
+    hbk_os_file_mapping mapping;
+    /// @brief Text handed over to the state with HBK_SOURCE_TAKE_OWNERSHIP, to be freed with it.
+    char* taken_text;
+    /// @brief The parsed syntax tree for this source, or NULL if it hasn't been parsed yet.
+    hbk_syntax_tree* syntax_tree;
+    /// @brief The offset at which each line starts, in order, so the first is always 0.
+    /// Built the first time a location in this source is turned into a line and column.
+    hbk_vector(int64_t) line_starts;
 } hbk_source;
 
 struct hbk_state {
+    /// @brief Where all of the state's memory comes from. Everything the state owns points
+    /// at this copy, so it has to stay put for as long as the state is alive.
+    hbk_allocator allocator;
+    /// @brief Where the state's memory goes, per category and in total, see `hbk_state_get_memory_stats`.
+    hbk_memory_account memory_accounts[HBK_MEMORY_CATEGORY_COUNT];
+    hbk_memory_account memory_total;
+#if HBK_INSTRUMENTATION
+    hbk_instrumentation_stats instrumentation;
+    /// @brief The trace being recorded, or NULL. This is the only thing passes check for tracing.
+    hbk_trace* trace;
+#endif
     bool use_color;
+    hbk_diagnostic_format diagnostic_format;
+    bool use_mmap;
     hbk_vector(hbk_source) sources;
-    hbk_vector(hbk_string_view) interned_strings;
+    hbk_interner* interner;
+    /// @brief What the calling thread interns with, outside of `hbk_state_parse_all`'s workers.
+    /// The workers' counts are added to it once they're done.
+    hbk_interner_local intern_local;
+    /// @brief The diagnostics waiting to be rendered. Diagnostics handed to a sink aren't kept here.
     hbk_vector(hbk_diagnostic*) diagnostics;
+    /// @brief Maps each diagnostic's kind, location and message (laid out one after the other, see
+    /// `hbk_diagnostic_allocate_unique`) to the diagnostic, so duplicates are only reported once.
+    /// This also tracks every diagnostic ever created, whether it went to a sink or not.
+    hbk_hashmap diagnostic_map;
+    hbk_diagnostic_sink diagnostic_sink;
+    void* diagnostic_sink_user_data;
+    /// @brief The number of errors after which diagnostics are dropped and lexing and parsing stop, or 0 for no limit.
+    int64_t max_errors;
+    int64_t error_count;
+    bool error_limit_reached;
+    /// @brief Arenas holding the diagnostics and strings created by `hbk_state_parse_all`'s workers.
+    hbk_vector(hbk_arena*) worker_arenas;
+    /// @brief Set while `hbk_state_parse_all` has workers running, or a lexer has chunks lexing.
+    /// Only then are the locks below taken, so single-threaded use never pays for them.
+    bool is_parallel;
+    /// @brief The threads a single large source may be lexed on. `hbk_state_parse_all` sets
+    /// this when it has more threads than sources to give them, and it's 1 the rest of the time.
+    int64_t lex_thread_count;
+    /// @brief Guards the memory accounts, which workers update whenever they allocate.
+    hbk_os_mutex memory_mutex;
+    /// @brief Guards the location overflows and the instrumentation.
+    hbk_os_mutex shared_mutex;
+    /// @brief Locations which were too big to pack into a `hbk_packed_location`.
+    hbk_vector(hbk_location) location_overflows;
     hbk_arena* misc_arena;
     hbk_arena* string_arena;
 };
 
+/// @brief What a thread running `hbk_state_parse_all`'s tasks creates diagnostics with.
+typedef struct hbk_parse_worker {
+    hbk_state* state;
+    /// @brief Holds the worker's diagnostics and their keys, and is handed to the state when it's done.
+    hbk_arena* diagnostic_arena;
+    /// @brief Finds duplicates within the current source. A location includes its source,
+    /// so there can't be any duplicates between sources.
+    hbk_hashmap diagnostic_map;
+    /// @brief The list for the current source, created with its first diagnostic.
+    hbk_vector(hbk_diagnostic*)* diagnostics;
+    /// @brief The errors in the current source.
+    int64_t error_count;
+    /// @brief How many more errors the state takes, or 0 for no limit. No source can get past
+    /// this, whatever the sources before it hold, so the worker stops there.
+    int64_t error_budget;
+    bool error_limit_reached;
+    /// @brief New strings go to the worker's own arena, which is handed to the state when it's done.
+    hbk_interner_local intern_local;
+} hbk_parse_worker;
+
+/// @brief Takes one of the state's locks, but only while it's being used from several threads.
+static void hbk_state_lock(hbk_state* state, hbk_os_mutex* mutex) {
+    if (state->is_parallel) {
+        hbk_os_mutex_lock(mutex);
+    }
+}
+
+static void hbk_state_unlock(hbk_state* state, hbk_os_mutex* mutex) {
+    if (state->is_parallel) {
+        hbk_os_mutex_unlock(mutex);
+    }
+}
+
+/// @brief The parse worker running on this thread, if any.
+static _Thread_local hbk_parse_worker* hbk_current_parse_worker;
+
+/// @brief The worker on this thread, if it's working for the given state.
+static hbk_parse_worker* hbk_state_current_parse_worker(hbk_state* state) {
+    hbk_parse_worker* worker = hbk_current_parse_worker;
+    return worker != NULL && worker->state == state ? worker : NULL;
+}
+
 hbk_string_view hbk_cstring_as_view(const char* string) {
     int64_t count = (int64_t)strlen(string);
     return (hbk_string_view){
@@ -36,15 +138,67 @@ void hbk_string_append_format(hbk_string* string, const char* format, ...) {
 }
 
 void hbk_string_append_formatv(hbk_string* string, const char* format, va_list v) {
+    int64_t count = hbk_vector_count(*string);
+    int64_t spare_capacity = hbk_vector_capacity(*string) - count;
+
+    /// Format straight into whatever room is left, and only format a second time
+    /// if it didn't fit. Once the string has grown a bit, that's hardly ever.
     va_list vcopy;
     va_copy(vcopy, v);
-    int64_t message_length = (int64_t)vsnprintf(NULL, 0, format, vcopy);
+    int64_t message_length = (int64_t)vsnprintf(spare_capacity > 0 ? *string + count : NULL, (size_t)spare_capacity, format, vcopy);
     va_end(vcopy);
 
-    int64_t count = hbk_vector_count(*string);
-    hbk_vector_set_capacity(*string, count + message_length + 1);
+    if (message_length >= spare_capacity) {
+        hbk_vector_set_capacity(*string, count + message_length + 1);
+        vsnprintf(*string + count, (size_t)message_length + 1, format, v);
+    }
+
     hbk_vector_set_count(*string, count + message_length);
-    vsnprintf(*string + count, message_length + 1, format, v);
+}
+
+/// @brief Makes room for `length` more characters plus the NUL terminator,
+/// and returns where they go. The caller writes the characters, this writes the NUL.
+static char* hbk_string_append_uninitialized(hbk_string* string, int64_t length) {
+    int64_t count = hbk_vector_count(*string);
+    hbk_vector_set_capacity(*string, count + length + 1);
+    hbk_vector_get_header(*string)->count = count + length;
+    (*string)[count + length] = 0;
+    return *string + count;
+}
+
+void hbk_string_append_sv(hbk_string* string, hbk_string_view sv) {
+    HBK_ASSERT(string != NULL, "Invalid string pointer");
+    char* destination = hbk_string_append_uninitialized(string, sv.count);
+    if (sv.count > 0) {
+        memcpy(destination, sv.data, (size_t)sv.count);
+    }
+}
+
+void hbk_string_append_cstr(hbk_string* string, const char* cstr) {
+    HBK_ASSERT(cstr != NULL, "Invalid C string pointer");
+    hbk_string_append_sv(string, hbk_cstring_as_view(cstr));
+}
+
+void hbk_string_append_int(hbk_string* string, int64_t value) {
+    HBK_ASSERT(string != NULL, "Invalid string pointer");
+
+    /// Write the digits backwards from the end of a buffer big enough for any 64-bit integer.
+    /// The magnitude is computed unsigned so INT64_MIN doesn't overflow.
+    char digits[20];
+    int64_t digit_count = 0;
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+    do {
+        digits[sizeof digits - 1 - digit_count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    bool is_negative = value < 0;
+    char* destination = hbk_string_append_uninitialized(string, digit_count + is_negative);
+    if (is_negative) {
+        *destination++ = '-';
+    }
+
+    memcpy(destination, digits + sizeof digits - digit_count, (size_t)digit_count);
 }
 
 hbk_string_view hbk_string_as_view(hbk_string string) {
@@ -56,101 +210,283 @@ hbk_string_view hbk_string_as_view(hbk_string string) {
 }
 
 hbk_state* hbk_state_create() {
-    hbk_state* state = calloc(sizeof *state, 1);
-    HBK_ASSERT(state != NULL, "Buy more ram lol");
-    state->misc_arena = hbk_arena_create();
-    state->string_arena = hbk_arena_create();
+    return hbk_state_create_with_allocator(hbk_default_allocator());
+}
+
+hbk_state* hbk_state_create_with_allocator(const hbk_allocator* allocator) {
+    HBK_ASSERT(allocator != NULL, "Invalid allocator pointer");
+    HBK_ASSERT(allocator->alloc != NULL && allocator->realloc != NULL && allocator->free != NULL, "Allocators must provide all three callbacks");
+
+    hbk_state* state = hbk_allocator_alloc(allocator, sizeof *state);
+    *state = (hbk_state){
+        .allocator = *allocator,
+        .use_mmap = HBK_OS_HAS_MMAP,
+    };
+
+    hbk_memory_account_init(&state->memory_total, &state->allocator, NULL);
+    for (int64_t i = 0; i < HBK_MEMORY_CATEGORY_COUNT; i++) {
+        hbk_memory_account_init(&state->memory_accounts[i], &state->allocator, &state->memory_total);
+    }
+
+    hbk_memory_account_add(&state->memory_accounts[HBK_MEMORY_STATE], sizeof *state, sizeof *state, 0);
+
+    hbk_vector_init(state->sources, hbk_state_get_category_allocator(state, HBK_MEMORY_SOURCES));
+    state->interner = hbk_interner_create(&state->memory_accounts[HBK_MEMORY_STRINGS]);
+    hbk_vector_init(state->diagnostics, hbk_state_get_category_allocator(state, HBK_MEMORY_DIAGNOSTICS));
+    hbk_hashmap_init(&state->diagnostic_map, hbk_state_get_category_allocator(state, HBK_MEMORY_DIAGNOSTICS));
+    hbk_vector_init(state->location_overflows, hbk_state_get_category_allocator(state, HBK_MEMORY_LOCATIONS));
+    hbk_vector_init(state->worker_arenas, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+    hbk_os_mutex_init(&state->memory_mutex);
+    hbk_os_mutex_init(&state->shared_mutex);
+    state->misc_arena = hbk_arena_create_with_allocator(&state->allocator, &state->memory_accounts[HBK_MEMORY_MISC], HBK_ARENA_RESERVE_SIZE);
+    state->string_arena = hbk_arena_create_with_allocator(&state->allocator, &state->memory_accounts[HBK_MEMORY_STRINGS], HBK_ARENA_RESERVE_SIZE);
+    state->intern_local.arena = state->string_arena;
+    state->lex_thread_count = 1;
+
+    hbk_symbol empty_symbol = hbk_state_intern_symbol(state, (hbk_string_view){});
+    HBK_ASSERT(empty_symbol == HBK_SYMBOL_EMPTY, "The empty string must be the first interned symbol");
+
     return state;
 }
 
 void hbk_state_destroy(hbk_state* state) {
     if (state == NULL) return;
+#if HBK_INSTRUMENTATION
+    hbk_trace_destroy(state->trace);
+#endif
     for (int64_t i = 0; i < hbk_vector_count(state->sources); i++) {
-        hbk_vector_free(state->sources[i].text);
+        hbk_vector_free(state->sources[i].owned_text);
+        hbk_os_unmap_file(&state->sources[i].mapping);
+        free(state->sources[i].taken_text);
+        hbk_syntax_tree_destroy(state->sources[i].syntax_tree);
+        hbk_vector_free(state->sources[i].line_starts);
     }
     hbk_vector_free(state->sources);
-    hbk_vector_free(state->interned_strings);
+    hbk_interner_destroy(state->interner);
+    for (int64_t i = 0; i < hbk_vector_count(state->diagnostic_map.slots); i++) {
+        hbk_hashmap_slot* slot = &state->diagnostic_map.slots[i];
+        if (slot->key.data != NULL) {
+            hbk_diagnostic* diag = (hbk_diagnostic*)(intptr_t)slot->value;
+            hbk_vector_free(diag->related_diagnostics);
+        }
+    }
+    hbk_hashmap_destroy(&state->diagnostic_map);
     hbk_vector_free(state->diagnostics);
+    hbk_vector_free(state->location_overflows);
+    for (int64_t i = 0; i < hbk_vector_count(state->worker_arenas); i++) {
+        hbk_arena_destroy(state->worker_arenas[i]);
+    }
+
+    hbk_vector_free(state->worker_arenas);
+    hbk_os_mutex_destroy(&state->memory_mutex);
+    hbk_os_mutex_destroy(&state->shared_mutex);
     hbk_arena_destroy(state->misc_arena);
     hbk_arena_destroy(state->string_arena);
-    free(state);
+
+    hbk_allocator allocator = state->allocator;
+    hbk_allocator_free(&allocator, state, sizeof *state);
+}
+
+const hbk_allocator* hbk_state_get_allocator(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    return &state->allocator;
+}
+
+const hbk_allocator* hbk_state_get_category_allocator(hbk_state* state, hbk_memory_category category) {
+    return &hbk_state_get_memory_account(state, category)->allocator;
+}
+
+hbk_memory_account* hbk_state_get_memory_account(hbk_state* state, hbk_memory_category category) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(category >= 0 && category < HBK_MEMORY_CATEGORY_COUNT, "Invalid memory category");
+    return &state->memory_accounts[category];
 }
 
 void hbk_state_set_enable_color(hbk_state* state, bool use_color) {
     state->use_color = use_color;
 }
 
-static hbk_string read_file_as_string(const char* file_path) {
-    FILE* f = fopen(file_path, "r");
+void hbk_state_set_diagnostic_format(hbk_state* state, hbk_diagnostic_format format) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(format >= HBK_DIAGNOSTIC_FORMAT_TEXT && format <= HBK_DIAGNOSTIC_FORMAT_BINARY, "Invalid diagnostic format");
+    state->diagnostic_format = format;
+}
+
+void hbk_state_set_enable_mmap(hbk_state* state, bool use_mmap) {
+    state->use_mmap = use_mmap && HBK_OS_HAS_MMAP;
+}
+
+static hbk_string read_file_as_string(const hbk_allocator* allocator, const char* file_path) {
+    FILE* f = fopen(file_path, "rb");
     // TODO(local): handle errors for file not existing, or being unopenable for other reasons
     HBK_ASSERT(f != NULL, "Could not open source files (TODO: error handling)");
-    fseek(f, 0, SEEK_END);
-    int64_t file_length = (int64_t)ftell(f);
-    fseek(f, 0, SEEK_SET);
 
     hbk_string source_text = NULL;
-    hbk_vector_set_capacity(source_text, file_length + 1);
-    HBK_ASSERT(source_text != NULL, "Failed to allocate string data");
-    HBK_ASSERT(hbk_vector_capacity(source_text) >= file_length + 1, "Failed to allocate correct capacity for string data");
-    fread(source_text, 1, (size_t)file_length, f);
-    hbk_vector_set_count(source_text, file_length);
-    HBK_ASSERT(hbk_vector_count(source_text) == file_length, "Failed to allocate correct count for string data");
-    HBK_ASSERT(source_text[file_length] == 0, "Source text string was not NUL-terminated");
+    hbk_vector_init(source_text, allocator);
 
+    /// If we can tell how big the file is up front, allocate all of it at once.
+    /// Pipes and other streams can't seek, so for those we just grow as we go.
+    if (0 == fseek(f, 0, SEEK_END)) {
+        long file_length = ftell(f);
+        if (file_length > 0) {
+            hbk_vector_reserve_exact(source_text, (int64_t)file_length + 1);
+        }
+
+        fseek(f, 0, SEEK_SET);
+    }
+
+    for (;;) {
+        int64_t count = hbk_vector_count(source_text);
+
+        /// Always leave room for the NUL terminator at the end.
+        int64_t read_capacity = hbk_vector_capacity(source_text) - count - 1;
+        if (read_capacity <= 0) {
+            /// For a regular file, a full buffer almost certainly means we've read all of it.
+            /// Check before growing, so we don't double a huge buffer just to find the end.
+            int c = fgetc(f);
+            if (c == EOF) {
+                break;
+            }
+
+            ungetc(c, f);
+            hbk_vector_set_capacity(source_text, count + 4096 + 1);
+            continue;
+        }
+
+        size_t read_count = fread(source_text + count, 1, (size_t)read_capacity, f);
+        hbk_vector_set_count(source_text, count + (int64_t)read_count);
+
+        if (read_count < (size_t)read_capacity) {
+            break;
+        }
+    }
+
+    HBK_ASSERT(!ferror(f), "Failed to read source file (TODO: error handling)");
     fclose(f);
+
+    hbk_vector_set_capacity(source_text, hbk_vector_count(source_text) + 1);
+    source_text[hbk_vector_count(source_text)] = 0;
+
     return source_text;
 }
 
+static hbk_source_id hbk_state_add_source(hbk_state* state, hbk_source source) {
+    HBK_ASSERT(source.text.data != NULL, "Source text must not be NULL");
+    HBK_ASSERT(source.text.data[source.text.count] == 0, "Source text must be NUL-terminated");
+
+    hbk_vector_push(state->sources, source);
+    return (hbk_source_id)(hbk_vector_count(state->sources) - 1);
+}
+
 hbk_source_id hbk_state_add_source_from_file(hbk_state* state, const char* file_path) {
     HBK_ASSERT(state != NULL, "Invalid state pointer");
     HBK_ASSERT(file_path != NULL, "Invalid file_path pointer");
 
-    hbk_source source_file = {};
-
+    /// Interned strings are unique, so comparing the data pointers is enough here.
+    hbk_string_view name = hbk_state_intern_cstring(state, file_path);
     for (int64_t i = 0; i < hbk_vector_count(state->sources); i++) {
-        hbk_source source_file = state->sources[i];
-        if (0 == strncmp(file_path, source_file.name.data, source_file.name.count)) {
+        if (state->sources[i].name.data == name.data) {
             return (hbk_source_id)i;
         }
     }
 
-    hbk_string source_text = read_file_as_string(file_path);
-    source_file = (hbk_source){
-        .name = hbk_cstring_as_view(file_path),
-        .text = source_text,
+    hbk_source source_file = {
+        .name = name,
     };
 
-    hbk_vector_push(state->sources, source_file);
-    hbk_source_id source_id = (hbk_source_id)(hbk_vector_count(state->sources) - 1);
-
-#if 0
-    state->sources[source_id].tokens = hbk_lex(state, source_id);
-    for (int64_t i = 0; i < hbk_vector_count(state->sources[source_id].tokens); i++) {
-        hbk_token token = state->sources[source_id].tokens[i];
-        fprintf(stderr, "%s [%ld,%ld]", hbk_token_kind_to_cstring(token.kind), token.location.offset, token.location.length);
-        if (token.kind == HBK_TOKEN_INTEGER_LITERAL) {
-            fprintf(stderr, " %ld", token.integer_value);
-        } else if (token.kind == HBK_TOKEN_CHARACTER_LITERAL) {
-            fprintf(stderr, " %c", (char)token.integer_value);
-        } else if (token.kind == HBK_TOKEN_STRING_LITERAL) {
-            fprintf(stderr, " \"%.*s\"", (int)token.string_value.count, token.string_value.data);
-        } else if (token.string_value.count != 0) {
-            fprintf(stderr, " [%.*s]", (int)token.string_value.count, token.string_value.data);
-        }
-        fprintf(stderr, "\n");
+    HBK_PASS_BEGIN(state, READ, name);
+
+    /// Mapping the file means the source text is never copied, and only the pages the
+    /// lexer is currently reading need to be resident. If the file can't be mapped
+    /// (it's a pipe, it's empty, or mmap just isn't available) we read it instead.
+    if (state->use_mmap && hbk_os_map_file(file_path, &source_file.mapping)) {
+        source_file.text = (hbk_string_view){
+            .data = source_file.mapping.data,
+            .count = source_file.mapping.length,
+        };
+    } else {
+        source_file.owned_text = read_file_as_string(hbk_state_get_category_allocator(state, HBK_MEMORY_SOURCES), file_path);
+        source_file.text = hbk_string_as_view(source_file.owned_text);
     }
-    hbk_vector_free(state->sources[source_id].tokens);
-#endif
 
-    hbk_syntax_tree* tree = hbk_parse(state, source_id);
-    HBK_ASSERT(tree != NULL, "parser did not return a tree");
+    HBK_PASS_END(state, READ);
+    HBK_COUNTER_ADD(state, SOURCE_BYTES, source_file.text.count);
+
+    return hbk_state_add_source(state, source_file);
+}
+
+hbk_source_id hbk_state_add_source_from_memory(hbk_state* state, const char* name, const char* data, int64_t length, hbk_source_ownership ownership) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(name != NULL, "Invalid name pointer");
+    HBK_ASSERT(data != NULL || length == 0, "Invalid data pointer");
+    HBK_ASSERT(length >= 0, "Invalid source length");
+
+    hbk_source source = {
+        .name = hbk_state_intern_cstring(state, name),
+    };
+
+    switch (ownership) {
+        default: HBK_UNREACHABLE;
+
+        case HBK_SOURCE_COPY: {
+            hbk_vector_init(source.owned_text, hbk_state_get_category_allocator(state, HBK_MEMORY_SOURCES));
+            hbk_vector_reserve_exact(source.owned_text, length + 1);
+            hbk_vector_append_n(source.owned_text, data, length);
+            source.owned_text[length] = 0;
+            source.text = hbk_string_as_view(source.owned_text);
+        } break;
+
+        case HBK_SOURCE_BORROW: {
+            source.text = (hbk_string_view){
+                .data = data == NULL ? "" : data,
+                .count = length,
+            };
+        } break;
+
+        case HBK_SOURCE_TAKE_OWNERSHIP: {
+            source.taken_text = (char*)data;
+            source.text = (hbk_string_view){
+                .data = data == NULL ? "" : data,
+                .count = length,
+            };
+        } break;
+    }
+
+    return hbk_state_add_source(state, source);
+}
+
+hbk_syntax_tree* hbk_state_get_source_syntax(hbk_state* state, hbk_source_id source_id) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(source_id >= 0 && source_id < hbk_vector_count(state->sources), "Invalid source id");
+
+    hbk_source* source = &state->sources[source_id];
+    if (source->syntax_tree == NULL) {
+        source->syntax_tree = hbk_parse(state, source_id);
+        HBK_ASSERT(source->syntax_tree != NULL, "parser did not return a tree");
+    }
+
+    return source->syntax_tree;
+}
+
+void hbk_state_parse_source(hbk_state* state, hbk_source_id source_id) {
+    (void)hbk_state_get_source_syntax(state, source_id);
+}
+
+void hbk_state_print_source_syntax_to_file(hbk_state* state, hbk_source_id source_id, FILE* file) {
+    hbk_syntax_tree* tree = hbk_state_get_source_syntax(state, source_id);
+
+    HBK_PASS_BEGIN(state, PRINT, hbk_state_get_source_name(state, source_id));
 
     hbk_string debug_output = NULL;
+    hbk_vector_init(debug_output, &state->allocator);
     hbk_syntax_tree_print_to_string(state, tree, &debug_output, state->use_color);
-    fprintf(stderr, "%s\n", debug_output);
+    if (hbk_vector_count(debug_output) > 0) {
+        fprintf(file, "%.*s\n", (int)hbk_vector_count(debug_output), debug_output);
+    }
+
     hbk_vector_free(debug_output);
 
-    return source_id;
+    HBK_PASS_END(state, PRINT);
 }
 
 hbk_string_view hbk_state_get_source_name(hbk_state* state, hbk_source_id source_id) {
@@ -162,11 +498,93 @@ hbk_string_view hbk_state_get_source_name(hbk_state* state, hbk_source_id source
 hbk_string_view hbk_state_get_source_text(hbk_state* state, hbk_source_id source_id) {
     HBK_ASSERT(state != NULL, "Invalid state pointer");
     HBK_ASSERT(source_id >= 0, "Invalid source id");
-    return hbk_string_as_view(state->sources[source_id].text);
+    return state->sources[source_id].text;
 }
 
+/// @brief Returns the start offsets of every line in the source, building them if this is the first time they're needed.
+static hbk_vector(int64_t) hbk_source_get_line_starts(hbk_state* state, hbk_source* source) {
+    if (source->line_starts != NULL) {
+        return source->line_starts;
+    }
+
+    hbk_vector_init(source->line_starts, hbk_state_get_category_allocator(state, HBK_MEMORY_SOURCES));
+    hbk_vector_push(source->line_starts, 0);
+
+    /// One pass over the text with the vectorized byte search, skipping from newline to newline.
+    hbk_scan_init();
+    const char* text = source->text.data;
+    int64_t text_length = source->text.count;
+    for (int64_t position = 0;;) {
+        position = hbk_scan_find_byte(text, position, text_length, '\n');
+        if (position >= text_length) {
+            break;
+        }
+
+        position++;
+        hbk_vector_push(source->line_starts, position);
+    }
+
+    hbk_vector_shrink_to_fit(source->line_starts);
+    return source->line_starts;
+}
+
+/// @brief Finds the (0-based) index of the line containing `offset`, by binary search.
+static int64_t hbk_line_index_for_offset(hbk_vector(int64_t) line_starts, int64_t offset) {
+    /// Find the last line which starts at or before the offset.
+    int64_t low = 0;
+    int64_t high = hbk_vector_count(line_starts);
+    while (high - low > 1) {
+        int64_t middle = low + (high - low) / 2;
+        if (line_starts[middle] <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+hbk_line_column hbk_state_location_to_line_column(hbk_state* state, hbk_location location) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(location.source_id >= 0 && location.source_id < hbk_vector_count(state->sources), "Invalid source id");
+
+    hbk_source* source = &state->sources[location.source_id];
+    HBK_ASSERT(location.offset >= 0 && location.offset <= source->text.count, "Location is outside of its source");
+
+    hbk_vector(int64_t) line_starts = hbk_source_get_line_starts(state, source);
+    int64_t line_index = hbk_line_index_for_offset(line_starts, location.offset);
+    return (hbk_line_column){
+        .line = line_index + 1,
+        .column = location.offset - line_starts[line_index] + 1,
+    };
+}
+
+/// Rendered diagnostics are written out whenever this much has built up, rather than all at the end.
+#define HBK_DIAGNOSTIC_RENDER_BUFFER_SIZE (64 * 1024)
+
+static void hbk_diagnostic_write_records(hbk_state* state, hbk_diagnostic** diagnostics, int64_t count, hbk_diagnostic_format format, FILE* file);
+
 void hbk_state_render_diagnostics_to_file(hbk_state* state, FILE* file) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(file != NULL, "Invalid file pointer");
+
+    HBK_PASS_BEGIN(state, DIAGNOSTICS, (hbk_string_view){});
+
+    if (state->diagnostic_format != HBK_DIAGNOSTIC_FORMAT_TEXT) {
+        if (state->diagnostic_format == HBK_DIAGNOSTIC_FORMAT_BINARY) {
+            hbk_diagnostic_write_binary_header(file);
+        }
+
+        hbk_diagnostic_write_records(state, state->diagnostics, hbk_vector_count(state->diagnostics), state->diagnostic_format, file);
+        HBK_PASS_END(state, DIAGNOSTICS);
+        return;
+    }
+
     hbk_string render_target = NULL;
+    hbk_vector_init(render_target, &state->allocator);
+    hbk_vector_reserve_exact(render_target, HBK_DIAGNOSTIC_RENDER_BUFFER_SIZE);
+
     for (int64_t i = 0; i < hbk_vector_count(state->diagnostics); i++) {
         auto diag = state->diagnostics[i];
         if (diag->kind == HBK_DIAG_RELATED) {
@@ -174,33 +592,57 @@ void hbk_state_render_diagnostics_to_file(hbk_state* state, FILE* file) {
         }
 
         hbk_diagnostic_render_to_string(state, diag, &render_target);
+        if (hbk_vector_count(render_target) >= HBK_DIAGNOSTIC_RENDER_BUFFER_SIZE) {
+            fwrite(render_target, 1, (size_t)hbk_vector_count(render_target), file);
+            hbk_vector_set_count(render_target, 0);
+        }
     }
 
-    if (render_target != NULL) {
-        fprintf(file, "%s", render_target);
+    if (hbk_vector_count(render_target) > 0) {
+        fwrite(render_target, 1, (size_t)hbk_vector_count(render_target), file);
     }
 
     hbk_vector_free(render_target);
+
+    HBK_PASS_END(state, DIAGNOSTICS);
 }
 
-hbk_string_view hbk_state_intern_string_data(hbk_state* state, const char* string, int64_t length) {
-    for (int64_t i = 0; i < hbk_vector_count(state->interned_strings); i++) {
-        if (state->interned_strings[i].count != length) {
-            continue;
-        }
+void hbk_state_set_diagnostic_sink(hbk_state* state, hbk_diagnostic_sink sink, void* user_data) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    state->diagnostic_sink = sink;
+    state->diagnostic_sink_user_data = user_data;
+}
 
-        if (0 == strncmp(state->interned_strings[i].data, string, length)) {
-            return state->interned_strings[i];
-        }
+void hbk_state_set_max_errors(hbk_state* state, int64_t max_errors) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(max_errors >= 0, "The error limit can't be negative");
+    state->max_errors = max_errors;
+}
+
+bool hbk_state_has_reached_error_limit(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    hbk_parse_worker* worker = hbk_state_current_parse_worker(state);
+    if (worker != NULL) {
+        return worker->error_limit_reached;
     }
 
-    char* data = hbk_arena_alloc(state->string_arena, length + 1);
-    memcpy(data, string, (size_t)length);
+    return state->error_limit_reached;
+}
 
-    return (hbk_string_view){
-        .data = data,
-        .count = length,
-    };
+/// @brief The interner's view of the calling thread: a parse worker's own, or the state's.
+static hbk_interner_local* hbk_state_intern_local(hbk_state* state) {
+    hbk_parse_worker* worker = hbk_state_current_parse_worker(state);
+    return worker != NULL ? &worker->intern_local : &state->intern_local;
+}
+
+static hbk_symbol hbk_state_intern_symbol_data(hbk_state* state, const char* string, int64_t length) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    return hbk_interner_intern(state->interner, hbk_state_intern_local(state), string, length);
+}
+
+hbk_string_view hbk_state_intern_string_data(hbk_state* state, const char* string, int64_t length) {
+    hbk_symbol symbol = hbk_state_intern_symbol_data(state, string, length);
+    return hbk_interner_view(state->interner, symbol);
 }
 
 hbk_string_view hbk_state_intern_string(hbk_state* state, hbk_string string) {
@@ -217,6 +659,179 @@ hbk_string_view hbk_state_intern_cstring(hbk_state* state, const char* string) {
     return hbk_state_intern_string_data(state, string, length);
 }
 
+hbk_symbol hbk_state_intern_symbol(hbk_state* state, hbk_string_view sv) {
+    return hbk_state_intern_symbol_data(state, sv.data, sv.count);
+}
+
+hbk_string_view hbk_state_symbol_view(hbk_state* state, hbk_symbol symbol) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    return hbk_interner_view(state->interner, symbol);
+}
+
+hbk_interner_stats hbk_state_get_interner_stats(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+
+    int64_t entry_count = hbk_interner_count(state->interner);
+    int64_t capacity = hbk_interner_capacity(state->interner);
+    return (hbk_interner_stats){
+        .entry_count = entry_count,
+        .capacity = capacity,
+        .lookup_count = state->intern_local.lookup_count,
+        .hit_count = state->intern_local.hit_count,
+        .probe_count = state->intern_local.probe_count,
+        .load_factor = capacity == 0 ? 0.0 : (double)entry_count / (double)capacity,
+    };
+}
+
+hbk_memory_stats hbk_state_get_memory_stats(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+
+    hbk_memory_stats stats = {
+        .total = state->memory_total.usage,
+    };
+
+    for (int64_t i = 0; i < HBK_MEMORY_CATEGORY_COUNT; i++) {
+        stats.categories[i] = state->memory_accounts[i].usage;
+    }
+
+    return stats;
+}
+
+const char* hbk_memory_category_name(hbk_memory_category category) {
+    switch (category) {
+        default: return "<unknown>";
+#define X(N, S) \
+    case HBK_MEMORY_##N: return S;
+        HBK_MEMORY_CATEGORIES(X)
+#undef X
+    }
+}
+
+bool hbk_instrumentation_is_enabled() {
+    return HBK_INSTRUMENTATION;
+}
+
+int64_t hbk_state_begin_pass(hbk_state* state, hbk_pass pass, hbk_string_view detail) {
+    int64_t now = hbk_os_monotonic_nanoseconds();
+#if HBK_INSTRUMENTATION
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    if (state->trace != NULL) {
+        hbk_trace_record(state->trace, 'B', hbk_pass_name(pass), detail, now);
+    }
+#endif
+    return now;
+}
+
+void hbk_state_end_pass(hbk_state* state, hbk_pass pass, int64_t start_nanoseconds) {
+#if HBK_INSTRUMENTATION
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(pass >= 0 && pass < HBK_PASS_COUNT, "Invalid pass");
+
+    int64_t now = hbk_os_monotonic_nanoseconds();
+    hbk_state_lock(state, &state->shared_mutex);
+    state->instrumentation.passes[pass].run_count++;
+    state->instrumentation.passes[pass].total_nanoseconds += now - start_nanoseconds;
+    hbk_state_unlock(state, &state->shared_mutex);
+
+    if (state->trace != NULL) {
+        hbk_trace_record(state->trace, 'E', hbk_pass_name(pass), (hbk_string_view){}, now);
+    }
+#endif
+}
+
+void hbk_state_add_pass_run(hbk_state* state, hbk_pass pass, int64_t nanoseconds) {
+#if HBK_INSTRUMENTATION
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(pass >= 0 && pass < HBK_PASS_COUNT, "Invalid pass");
+
+    hbk_state_lock(state, &state->shared_mutex);
+    state->instrumentation.passes[pass].run_count++;
+    state->instrumentation.passes[pass].total_nanoseconds += nanoseconds;
+    hbk_state_unlock(state, &state->shared_mutex);
+#endif
+}
+
+bool hbk_state_start_trace(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+#if HBK_INSTRUMENTATION
+    if (state->trace == NULL) {
+        state->trace = hbk_trace_create(hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool hbk_state_write_trace_to_file(hbk_state* state, FILE* file) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(file != NULL, "Invalid file pointer");
+#if HBK_INSTRUMENTATION
+    if (state->trace == NULL) {
+        return false;
+    }
+
+    hbk_trace_write_json(state->trace, file);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void hbk_state_add_to_counter(hbk_state* state, hbk_counter counter, int64_t amount) {
+#if HBK_INSTRUMENTATION
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(counter >= 0 && counter < HBK_COUNTER_COUNT, "Invalid counter");
+    hbk_state_lock(state, &state->shared_mutex);
+    state->instrumentation.counters[counter] += amount;
+    hbk_state_unlock(state, &state->shared_mutex);
+#endif
+}
+
+hbk_instrumentation_stats hbk_state_get_instrumentation_stats(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+
+    hbk_instrumentation_stats stats = {};
+#if HBK_INSTRUMENTATION
+    stats = state->instrumentation;
+
+    /// The interner keeps these for `hbk_state_get_interner_stats` anyway, and arenas know
+    /// what they hold, so there's no point counting any of it a second time.
+    stats.counters[HBK_COUNTER_INTERN_HITS] = state->intern_local.hit_count;
+    stats.counters[HBK_COUNTER_INTERN_MISSES] = state->intern_local.lookup_count - state->intern_local.hit_count;
+
+    int64_t arena_bytes = (int64_t)(hbk_arena_used_bytes(state->misc_arena) + hbk_arena_used_bytes(state->string_arena));
+    for (int64_t i = 0; i < hbk_vector_count(state->worker_arenas); i++) {
+        arena_bytes += (int64_t)hbk_arena_used_bytes(state->worker_arenas[i]);
+    }
+
+    stats.counters[HBK_COUNTER_ARENA_BYTES] = arena_bytes;
+#endif
+
+    return stats;
+}
+
+const char* hbk_pass_name(hbk_pass pass) {
+    switch (pass) {
+        default: return "<unknown>";
+#define X(N, S) \
+    case HBK_PASS_##N: return S;
+        HBK_PASSES(X)
+#undef X
+    }
+}
+
+const char* hbk_counter_name(hbk_counter counter) {
+    switch (counter) {
+        default: return "<unknown>";
+#define X(N, S) \
+    case HBK_COUNTER_##N: return S;
+        HBK_COUNTERS(X)
+#undef X
+    }
+}
+
 hbk_location hbk_location_create(hbk_source_id source_id, int64_t offset, int64_t length) {
     return (hbk_location){
         .source_id = source_id,
@@ -225,67 +840,537 @@ hbk_location hbk_location_create(hbk_source_id source_id, int64_t offset, int64_
     };
 }
 
-hbk_diagnostic* hbk_diagnostic_create(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* message) {
-    hbk_string_view message_view = hbk_state_intern_cstring(state, message);
+#define HBK_PACKED_LOCATION_OVERFLOW    (1ull << 63)
+#define HBK_PACKED_LOCATION_SOURCE_BITS 19
+#define HBK_PACKED_LOCATION_OFFSET_BITS 32
+#define HBK_PACKED_LOCATION_LENGTH_BITS 12
+
+hbk_packed_location hbk_state_pack_location(hbk_state* state, hbk_location location) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(location.source_id >= 0 && location.offset >= 0 && location.length >= 0, "Invalid location");
+
+    uint64_t source_id = (uint64_t)location.source_id;
+    uint64_t offset = (uint64_t)location.offset;
+    uint64_t length = (uint64_t)location.length;
+
+    if (source_id < (1ull << HBK_PACKED_LOCATION_SOURCE_BITS) && offset < (1ull << HBK_PACKED_LOCATION_OFFSET_BITS) && length < (1ull << HBK_PACKED_LOCATION_LENGTH_BITS)) {
+        return (source_id << (HBK_PACKED_LOCATION_OFFSET_BITS + HBK_PACKED_LOCATION_LENGTH_BITS)) | (offset << HBK_PACKED_LOCATION_LENGTH_BITS) | length;
+    }
+
+    hbk_state_lock(state, &state->shared_mutex);
+    uint64_t overflow_index = (uint64_t)hbk_vector_count(state->location_overflows);
+    hbk_vector_push(state->location_overflows, location);
+    hbk_state_unlock(state, &state->shared_mutex);
+    return HBK_PACKED_LOCATION_OVERFLOW | overflow_index;
+}
+
+hbk_location hbk_state_unpack_location(hbk_state* state, hbk_packed_location packed_location) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
 
-    hbk_diagnostic* result = hbk_arena_alloc(state->misc_arena, sizeof *result);
-    hbk_vector_push(state->diagnostics, result);
+    if (packed_location & HBK_PACKED_LOCATION_OVERFLOW) {
+        uint64_t overflow_index = packed_location & ~HBK_PACKED_LOCATION_OVERFLOW;
+        hbk_state_lock(state, &state->shared_mutex);
+        HBK_ASSERT(overflow_index < (uint64_t)hbk_vector_count(state->location_overflows), "Invalid packed location");
+        hbk_location location = state->location_overflows[overflow_index];
+        hbk_state_unlock(state, &state->shared_mutex);
+        return location;
+    }
+
+    return (hbk_location){
+        .source_id = (hbk_source_id)(packed_location >> (HBK_PACKED_LOCATION_OFFSET_BITS + HBK_PACKED_LOCATION_LENGTH_BITS)),
+        .offset = (int64_t)((packed_location >> HBK_PACKED_LOCATION_LENGTH_BITS) & ((1ull << HBK_PACKED_LOCATION_OFFSET_BITS) - 1)),
+        .length = (int64_t)(packed_location & ((1ull << HBK_PACKED_LOCATION_LENGTH_BITS) - 1)),
+    };
+}
+
+/// @brief What a diagnostic's message is prefixed with in memory. Together they're the key it's
+/// found by in a duplicate map, so diagnostics are only duplicates if all of these match as well.
+typedef struct hbk_diagnostic_key_prefix {
+    hbk_location location;
+    /// @brief The kind it was created with, which stays the same if it becomes a related diagnostic.
+    int64_t kind;
+} hbk_diagnostic_key_prefix;
+
+static_assert(sizeof(hbk_diagnostic_key_prefix) == 4 * sizeof(int64_t), "hbk_diagnostic_key_prefix must not have padding to be used in a key");
+
+static uint64_t hbk_diagnostic_hash(hbk_diagnostic_key_prefix prefix, const char* message, int64_t message_length) {
+    /// Only the message has to go through the byte hash, the rest is mixed in a word at a time.
+    uint64_t hash = hbk_hash_bytes(message, message_length);
+    hash = (hash ^ (uint64_t)prefix.location.source_id) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ (uint64_t)prefix.location.offset) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ (uint64_t)prefix.location.length) * 0x9E3779B97F4A7C15ull;
+    hash = (hash ^ (uint64_t)prefix.kind) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+}
+
+static hbk_diagnostic_key_prefix hbk_diagnostic_get_key_prefix(hbk_diagnostic* diag) {
+    hbk_diagnostic_key_prefix prefix;
+    memcpy(&prefix, diag->message.data - sizeof prefix, sizeof prefix);
+    return prefix;
+}
+
+/// @brief The key a diagnostic is found by in a duplicate map, which sits right before its message.
+static hbk_string_view hbk_diagnostic_key(hbk_diagnostic* diag) {
+    return (hbk_string_view){diag->message.data - sizeof(hbk_diagnostic_key_prefix), (int64_t)sizeof(hbk_diagnostic_key_prefix) + diag->message.count};
+}
+
+/// @brief Creates the diagnostic in the arena, without looking for duplicates.
+static hbk_diagnostic* hbk_diagnostic_allocate(hbk_state* state, hbk_arena* arena, hbk_diagnostic_kind kind, hbk_location location, const char* message, int64_t message_length) {
+    /// The kind, location and message go one after the other in the arena, so together they can be
+    /// the key for finding duplicates, and the message is then used as it is from there.
+    hbk_diagnostic_key_prefix prefix = {
+        .location = location,
+        .kind = kind,
+    };
+
+    char* key_data = hbk_arena_alloc(arena, sizeof prefix + (size_t)message_length + 1);
+    memcpy(key_data, &prefix, sizeof prefix);
+    memcpy(key_data + sizeof prefix, message, (size_t)message_length);
+    key_data[sizeof prefix + (size_t)message_length] = 0;
+
+    hbk_diagnostic* result = hbk_arena_alloc(arena, sizeof *result);
     *result = (hbk_diagnostic){
         .kind = kind,
         .location = location,
-        .message = message_view,
+        .message = {key_data + sizeof prefix, message_length},
+        .allocator = hbk_state_get_category_allocator(state, HBK_MEMORY_DIAGNOSTICS),
     };
 
     return result;
 }
 
-hbk_diagnostic* hbk_diagnostic_create_format(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, ...) {
-    va_list v;
-    va_start(v, format);
-    hbk_diagnostic* result = hbk_diagnostic_create_formatv(state, kind, location, format, v);
-    va_end(v);
+/// @brief Adds the diagnostic to the map, unless the map already has an identical one.
+/// @return The diagnostic, or the existing one with the same kind, location and message.
+static hbk_diagnostic* hbk_diagnostic_insert_unique(hbk_hashmap* map, hbk_diagnostic* diag) {
+    uint64_t hash = hbk_diagnostic_hash(hbk_diagnostic_get_key_prefix(diag), diag->message.data, diag->message.count);
+    int64_t existing = 0;
+    if (!hbk_hashmap_try_insert(map, hbk_diagnostic_key(diag), hash, (int64_t)(intptr_t)diag, &existing)) {
+        return (hbk_diagnostic*)(intptr_t)existing;
+    }
+
+    return diag;
+}
+
+/// @brief Creates the diagnostic in the arena and adds it to the map, unless the map already has an identical one.
+/// @return The new diagnostic, or the existing one with the same kind, location and message.
+static hbk_diagnostic* hbk_diagnostic_allocate_unique(hbk_state* state, hbk_hashmap* map, hbk_arena* arena, hbk_diagnostic_kind kind, hbk_location location, const char* message, int64_t message_length, bool* out_is_new) {
+    /// If it turns out to be a duplicate, the arena is rewound and the copy is gone again.
+    hbk_arena_savepoint savepoint = hbk_arena_mark(arena);
+    hbk_diagnostic* diag = hbk_diagnostic_allocate(state, arena, kind, location, message, message_length);
+    hbk_diagnostic* result = hbk_diagnostic_insert_unique(map, diag);
+    if (result != diag) {
+        hbk_arena_rewind(arena, savepoint);
+    }
+
+    *out_is_new = result == diag;
     return result;
 }
 
-hbk_diagnostic* hbk_diagnostic_create_formatv(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, va_list v) {
+/// @brief Counts a new diagnostic and passes it on to the sink or the list.
+static void hbk_diagnostic_publish(hbk_state* state, hbk_diagnostic* diag) {
+    if (diag->kind == HBK_DIAG_ERROR || diag->kind == HBK_DIAG_FATAL) {
+        state->error_count++;
+    }
+
+    HBK_COUNTER_ADD(state, DIAGNOSTICS, 1);
+
+    if (state->diagnostic_sink != NULL) {
+        state->diagnostic_sink(state, diag, state->diagnostic_sink_user_data);
+    } else {
+        hbk_vector_push(state->diagnostics, diag);
+    }
+}
+
+/// @brief Creates the diagnostic and publishes it, unless an identical one was already created.
+/// @return The new diagnostic, or the existing one with the same kind, location and message.
+static hbk_diagnostic* hbk_diagnostic_record(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* message, int64_t message_length) {
+    bool is_new = false;
+    hbk_diagnostic* result = hbk_diagnostic_allocate_unique(state, &state->diagnostic_map, state->misc_arena, kind, location, message, message_length, &is_new);
+    if (is_new) {
+        result->is_committed = true;
+        hbk_diagnostic_publish(state, result);
+    }
+
+    return result;
+}
+
+/// @brief Publishes a diagnostic a parse worker created, unless an identical one was already created.
+/// @return The diagnostic, or the existing one with the same kind, location and message.
+static hbk_diagnostic* hbk_diagnostic_adopt(hbk_state* state, hbk_diagnostic* diag) {
+    hbk_diagnostic* existing = hbk_diagnostic_insert_unique(&state->diagnostic_map, diag);
+    if (existing != diag) {
+        return existing;
+    }
+
+    hbk_diagnostic_publish(state, diag);
+    return diag;
+}
+
+/// @brief Stops taking diagnostics once there have been too many errors, saying so at the given location.
+static void hbk_state_check_error_limit(hbk_state* state, hbk_location location) {
+    if (state->max_errors == 0 || state->error_count < state->max_errors) {
+        return;
+    }
+
+    state->error_limit_reached = true;
+
+    char limit_message[128];
+    int64_t limit_message_length = (int64_t)snprintf(limit_message, sizeof limit_message, "Too many errors (%lld), stopping here.", (long long)state->max_errors);
+    hbk_diagnostic_record(state, HBK_DIAG_FATAL, location, limit_message, limit_message_length);
+}
+
+/// @brief Adds the diagnostic to the worker's list for its current source. Nothing is published
+/// until `hbk_state_parse_all` merges them.
+static void hbk_parse_worker_push_diagnostic(hbk_parse_worker* worker, hbk_diagnostic* diag) {
+    if (*worker->diagnostics == NULL) {
+        hbk_vector_init(*worker->diagnostics, hbk_state_get_category_allocator(worker->state, HBK_MEMORY_DIAGNOSTICS));
+    }
+
+    hbk_vector_push(*worker->diagnostics, diag);
+
+    if (diag->kind == HBK_DIAG_ERROR || diag->kind == HBK_DIAG_FATAL) {
+        worker->error_count++;
+        if (worker->error_budget > 0 && worker->error_count >= worker->error_budget) {
+            worker->error_limit_reached = true;
+        }
+    }
+}
+
+/// @brief Creates a diagnostic, and commits it straight away if `commit` is set. A committed diagnostic
+/// which is a duplicate is dropped, and the earlier one is returned instead. Inside a parse worker,
+/// duplicates are dropped right away too, so errors are counted the same way they would be without workers.
+static hbk_diagnostic* hbk_diagnostic_from_message(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* message, int64_t message_length, bool commit) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+
+    hbk_parse_worker* worker = hbk_state_current_parse_worker(state);
+    if (worker != NULL) {
+        if (worker->error_limit_reached) {
+            return NULL;
+        }
+
+        if (!commit) {
+            return hbk_diagnostic_allocate(state, worker->diagnostic_arena, kind, location, message, message_length);
+        }
+
+        bool is_new = false;
+        hbk_diagnostic* result = hbk_diagnostic_allocate_unique(state, &worker->diagnostic_map, worker->diagnostic_arena, kind, location, message, message_length, &is_new);
+        if (is_new) {
+            result->is_committed = true;
+            hbk_parse_worker_push_diagnostic(worker, result);
+        }
+
+        return result;
+    }
+
+    if (state->error_limit_reached) {
+        return NULL;
+    }
+
+    if (!commit) {
+        return hbk_diagnostic_allocate(state, state->misc_arena, kind, location, message, message_length);
+    }
+
+    bool is_new = false;
+    hbk_diagnostic* result = hbk_diagnostic_allocate_unique(state, &state->diagnostic_map, state->misc_arena, kind, location, message, message_length, &is_new);
+    if (is_new) {
+        result->is_committed = true;
+        hbk_diagnostic_publish(state, result);
+        hbk_state_check_error_limit(state, location);
+    }
+
+    return result;
+}
+
+static hbk_diagnostic* hbk_diagnostic_from_formatv(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, bool commit, const char* format, va_list v) {
+    /// Most messages are short, so try formatting into a buffer on the stack first,
+    /// and only go to a scratch arena (and format again) for the long ones.
+    char message_buffer[256];
+
     va_list vcopy;
     va_copy(vcopy, v);
-    int64_t message_length = (int64_t)vsnprintf(NULL, 0, format, vcopy);
+    int64_t message_length = (int64_t)vsnprintf(message_buffer, sizeof message_buffer, format, vcopy);
     va_end(vcopy);
 
-    char* message_data = calloc(message_length + 1, 1);
-    vsnprintf(message_data, message_length + 1, format, v);
+    if (message_length < (int64_t)sizeof message_buffer) {
+        return hbk_diagnostic_from_message(state, kind, location, message_buffer, message_length, commit);
+    }
 
-    hbk_string_view message_view = hbk_state_intern_string_data(state, message_data, message_length);
-    free(message_data);
+    /// The message is copied into the diagnostic, so the scratch copy can go straight away.
+    hbk_scratch scratch = hbk_scratch_begin(NULL, 0);
+    char* message_data = hbk_arena_alloc(scratch.arena, (size_t)message_length + 1);
+    vsnprintf(message_data, (size_t)message_length + 1, format, v);
 
-    hbk_diagnostic* result = hbk_arena_alloc(state->misc_arena, sizeof *result);
-    hbk_vector_push(state->diagnostics, result);
-    *result = (hbk_diagnostic){
-        .kind = kind,
-        .location = location,
-        .message = message_view,
-    };
+    hbk_diagnostic* result = hbk_diagnostic_from_message(state, kind, location, message_data, message_length, commit);
+    hbk_scratch_end(scratch);
+    return result;
+}
 
+hbk_diagnostic* hbk_diagnostic_begin(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* message) {
+    HBK_ASSERT(message != NULL, "Invalid message pointer");
+    return hbk_diagnostic_from_message(state, kind, location, message, (int64_t)strlen(message), false);
+}
+
+hbk_diagnostic* hbk_diagnostic_begin_format(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, ...) {
+    va_list v;
+    va_start(v, format);
+    hbk_diagnostic* result = hbk_diagnostic_from_formatv(state, kind, location, false, format, v);
+    va_end(v);
     return result;
 }
 
+hbk_diagnostic* hbk_diagnostic_begin_formatv(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, va_list v) {
+    return hbk_diagnostic_from_formatv(state, kind, location, false, format, v);
+}
+
+void hbk_diagnostic_commit(hbk_state* state, hbk_diagnostic* diag) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+
+    /// It can be NULL once the error limit has been reached.
+    /// Related diagnostics only ever go out as part of their parent.
+    if (diag == NULL || diag->is_committed || diag->kind == HBK_DIAG_RELATED) {
+        return;
+    }
+
+    diag->is_committed = true;
+
+    /// Begun diagnostics only go into the duplicate maps now, so that one which ends up related
+    /// never stands in for a top-level diagnostic, or the other way around. A duplicate is dropped,
+    /// along with whatever was attached to it.
+    hbk_parse_worker* worker = hbk_state_current_parse_worker(state);
+    if (worker != NULL) {
+        if (!worker->error_limit_reached && hbk_diagnostic_insert_unique(&worker->diagnostic_map, diag) == diag) {
+            hbk_parse_worker_push_diagnostic(worker, diag);
+        }
+
+        return;
+    }
+
+    /// Other diagnostics may have reached the limit since this one was begun.
+    if (state->error_limit_reached || hbk_diagnostic_insert_unique(&state->diagnostic_map, diag) != diag) {
+        return;
+    }
+
+    hbk_diagnostic_publish(state, diag);
+    hbk_state_check_error_limit(state, diag->location);
+}
+
+hbk_diagnostic* hbk_diagnostic_create(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* message) {
+    HBK_ASSERT(message != NULL, "Invalid message pointer");
+    return hbk_diagnostic_from_message(state, kind, location, message, (int64_t)strlen(message), true);
+}
+
+hbk_diagnostic* hbk_diagnostic_create_format(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, ...) {
+    va_list v;
+    va_start(v, format);
+    hbk_diagnostic* result = hbk_diagnostic_from_formatv(state, kind, location, true, format, v);
+    va_end(v);
+    return result;
+}
+
+hbk_diagnostic* hbk_diagnostic_create_formatv(hbk_state* state, hbk_diagnostic_kind kind, hbk_location location, const char* format, va_list v) {
+    return hbk_diagnostic_from_formatv(state, kind, location, true, format, v);
+}
+
 void hbk_diagnostic_add_related(hbk_diagnostic* diag, hbk_diagnostic* related) {
-    HBK_ASSERT(diag != NULL, "Invalid diagnostic pointer");
+    /// Either one can be NULL once the error limit has been reached.
+    if (diag == NULL || related == NULL) return;
+    HBK_ASSERT(!related->is_committed, "Only diagnostics from hbk_diagnostic_begin which haven't been committed can be related diagnostics");
+
     related->kind = HBK_DIAG_RELATED;
+    if (diag->related_diagnostics == NULL) {
+        hbk_vector_init(diag->related_diagnostics, diag->allocator);
+    }
+
     hbk_vector_push(diag->related_diagnostics, related);
 }
 
+typedef struct hbk_parse_all_context {
+    hbk_state* state;
+    /// @brief The sources to parse, one per task.
+    hbk_vector(hbk_source_id) source_ids;
+    /// @brief The diagnostics of each task's source, in the order they were created.
+    hbk_vector(hbk_vector(hbk_diagnostic*)) diagnostics;
+    /// @brief The errors among each task's diagnostics.
+    hbk_vector(int64_t) error_counts;
+    hbk_parse_worker* workers;
+} hbk_parse_all_context;
+
+static void hbk_parse_all_task(void* user_data, int64_t worker_index, int64_t task_index) {
+    hbk_parse_all_context* context = user_data;
+    hbk_state* state = context->state;
+    hbk_parse_worker* worker = &context->workers[worker_index];
+
+    hbk_hashmap_destroy(&worker->diagnostic_map);
+    hbk_hashmap_init(&worker->diagnostic_map, hbk_state_get_category_allocator(state, HBK_MEMORY_DIAGNOSTICS));
+    worker->diagnostics = &context->diagnostics[task_index];
+    worker->error_count = 0;
+    worker->error_limit_reached = false;
+
+    hbk_source* source = &state->sources[context->source_ids[task_index]];
+    hbk_current_parse_worker = worker;
+    source->syntax_tree = hbk_parse(state, context->source_ids[task_index]);
+    hbk_current_parse_worker = NULL;
+    HBK_ASSERT(source->syntax_tree != NULL, "parser did not return a tree");
+
+    context->error_counts[task_index] = worker->error_count;
+}
+
+/// @brief Publishes the diagnostics of one source, up to the error limit.
+static void hbk_state_merge_diagnostics(hbk_state* state, hbk_vector(hbk_diagnostic*) diagnostics) {
+    for (int64_t i = 0; i < hbk_vector_count(diagnostics); i++) {
+        hbk_diagnostic* diag = diagnostics[i];
+        hbk_diagnostic* result = state->error_limit_reached ? NULL : hbk_diagnostic_adopt(state, diag);
+        if (result == diag) {
+            hbk_state_check_error_limit(state, diag->location);
+            continue;
+        }
+
+        /// Dropped, or the same as one created before `hbk_state_parse_all`, in which case committing
+        /// it without workers would have dropped it, along with its related diagnostics, too.
+        hbk_vector_free(diag->related_diagnostics);
+    }
+}
+
+/// @brief Throws away what a worker made of the source, and parses it again on this thread.
+static void hbk_state_reparse_source(hbk_state* state, hbk_source_id source_id, hbk_vector(hbk_diagnostic*) diagnostics) {
+    for (int64_t i = 0; i < hbk_vector_count(diagnostics); i++) {
+        hbk_vector_free(diagnostics[i]->related_diagnostics);
+    }
+
+    hbk_source* source = &state->sources[source_id];
+    hbk_syntax_tree_destroy(source->syntax_tree);
+    source->syntax_tree = NULL;
+    hbk_state_parse_source(state, source_id);
+}
+
+void hbk_state_begin_threads(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(!state->is_parallel, "The state is already being used from several threads");
+
+    state->is_parallel = true;
+    state->memory_total.mutex = &state->memory_mutex;
+    for (int64_t i = 0; i < HBK_MEMORY_CATEGORY_COUNT; i++) {
+        state->memory_accounts[i].mutex = &state->memory_mutex;
+    }
+}
+
+void hbk_state_end_threads(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+
+    state->is_parallel = false;
+    state->memory_total.mutex = NULL;
+    for (int64_t i = 0; i < HBK_MEMORY_CATEGORY_COUNT; i++) {
+        state->memory_accounts[i].mutex = NULL;
+    }
+}
+
+int64_t hbk_state_get_lex_thread_count(hbk_state* state) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    return state->lex_thread_count;
+}
+
+void hbk_state_parse_all(hbk_state* state, int64_t thread_count) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(thread_count >= 0, "The thread count can't be negative");
+
+    if (thread_count == 0) {
+        thread_count = hbk_os_processor_count();
+    }
+
+    hbk_parse_all_context context = {
+        .state = state,
+    };
+
+    hbk_vector_init(context.source_ids, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+    for (hbk_source_id i = 0; i < hbk_vector_count(state->sources); i++) {
+        if (state->sources[i].syntax_tree == NULL) {
+            hbk_vector_push(context.source_ids, i);
+        }
+    }
+
+    int64_t source_count = hbk_vector_count(context.source_ids);
+    int64_t lex_thread_count = thread_count;
+    if (thread_count > source_count) {
+        thread_count = source_count;
+    }
+
+    /// Past the error limit, lexing and parsing stop straight away, so there's nothing to share out.
+    if (thread_count <= 1 || state->error_limit_reached) {
+        /// A single source can still make use of the threads, by lexing it in chunks.
+        state->lex_thread_count = lex_thread_count;
+        for (int64_t i = 0; i < source_count; i++) {
+            hbk_state_parse_source(state, context.source_ids[i]);
+        }
+
+        state->lex_thread_count = 1;
+
+        hbk_vector_free(context.source_ids);
+        return;
+    }
+
+    hbk_vector_init(context.diagnostics, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+    hbk_vector_set_count_zeroed(context.diagnostics, source_count);
+    hbk_vector_init(context.error_counts, hbk_state_get_category_allocator(state, HBK_MEMORY_MISC));
+    hbk_vector_set_count_zeroed(context.error_counts, source_count);
+
+    context.workers = hbk_allocator_alloc(hbk_state_get_category_allocator(state, HBK_MEMORY_MISC), sizeof *context.workers * (size_t)thread_count);
+    for (int64_t i = 0; i < thread_count; i++) {
+        context.workers[i] = (hbk_parse_worker){
+            .state = state,
+            .diagnostic_arena = hbk_arena_create_with_allocator(&state->allocator, &state->memory_accounts[HBK_MEMORY_DIAGNOSTICS], 0),
+            .error_budget = state->max_errors > 0 ? state->max_errors - state->error_count : 0,
+            .intern_local = {
+                .arena = hbk_arena_create_with_allocator(&state->allocator, &state->memory_accounts[HBK_MEMORY_STRINGS], 0),
+            },
+        };
+
+        hbk_hashmap_init(&context.workers[i].diagnostic_map, hbk_state_get_category_allocator(state, HBK_MEMORY_DIAGNOSTICS));
+        hbk_vector_push(state->worker_arenas, context.workers[i].diagnostic_arena);
+        hbk_vector_push(state->worker_arenas, context.workers[i].intern_local.arena);
+    }
+
+    hbk_state_begin_threads(state);
+    hbk_parallel_for(source_count, thread_count, hbk_parse_all_task, &context);
+    hbk_state_end_threads(state);
+
+    for (int64_t i = 0; i < thread_count; i++) {
+        hbk_hashmap_destroy(&context.workers[i].diagnostic_map);
+        state->intern_local.lookup_count += context.workers[i].intern_local.lookup_count;
+        state->intern_local.hit_count += context.workers[i].intern_local.hit_count;
+        state->intern_local.probe_count += context.workers[i].intern_local.probe_count;
+    }
+
+    /// A worker doesn't know how many errors the sources before its own hold, so it can parse
+    /// past where the error limit would have stopped it. Any source which might reach the limit,
+    /// and every source after that, is parsed again here the way it would be on one thread,
+    /// which stops it at the limit or doesn't parse it at all. That keeps the diagnostics and
+    /// the trees the same whatever the thread count.
+    for (int64_t i = 0; i < source_count; i++) {
+        bool might_reach_error_limit = state->max_errors > 0 && (state->error_limit_reached || context.error_counts[i] >= state->max_errors - state->error_count);
+        if (might_reach_error_limit) {
+            hbk_state_reparse_source(state, context.source_ids[i], context.diagnostics[i]);
+        } else {
+            hbk_state_merge_diagnostics(state, context.diagnostics[i]);
+        }
+
+        hbk_vector_free(context.diagnostics[i]);
+    }
+
+    hbk_allocator_free(hbk_state_get_category_allocator(state, HBK_MEMORY_MISC), context.workers, sizeof *context.workers * (size_t)thread_count);
+    hbk_vector_free(context.diagnostics);
+    hbk_vector_free(context.error_counts);
+    hbk_vector_free(context.source_ids);
+}
+
 void hbk_diagnostic_render_to_string(hbk_state* state, hbk_diagnostic* diag, hbk_string* string) {
     HBK_ASSERT(state != NULL, "Invalid state pointer");
     HBK_ASSERT(string != NULL, "Invalid string pointer");
 
     hbk_source_id source_id = diag->location.source_id;
     hbk_string_view source_name = hbk_state_get_source_name(state, source_id);
-    // hbk_string_view source_text = hbk_state_get_source_text(state, source_id);
 
     const char* diag_kind_color = "";
-    const char* diag_kind_text = "";
+    const char* diag_kind_text = hbk_diagnostic_kind_name(diag->kind);
 
     bool use_color = state->use_color;
 
@@ -294,44 +1379,245 @@ void hbk_diagnostic_render_to_string(hbk_state* state, hbk_diagnostic* diag, hbk
 
         case HBK_DIAG_VERBOSE: {
             diag_kind_color = COL(CYAN);
-            diag_kind_text = "verbose";
         } break;
 
         case HBK_DIAG_DEBUG: {
             diag_kind_color = COL(YELLOW);
-            diag_kind_text = "debug";
         } break;
 
         case HBK_DIAG_INFO: {
             diag_kind_color = COL(GREEN);
-            diag_kind_text = "note";
         } break;
 
         case HBK_DIAG_WARNING: {
             diag_kind_color = COL(MAGENTA);
-            diag_kind_text = "warning";
         } break;
 
         case HBK_DIAG_ERROR: {
             diag_kind_color = COL(RED);
-            diag_kind_text = "error";
         } break;
 
         case HBK_DIAG_FATAL: {
             diag_kind_color = COL(BRIGHT_RED);
-            diag_kind_text = "fatal";
         } break;
     }
 
-    hbk_string_append_format(
-        string,
-        "%.*s[%lld:%lld]: %s%s:%s %.*s\n",
-        HBK_SV_EXPAND(source_name),
-        (long long)diag->location.offset,
-        (long long)diag->location.length,
-        diag_kind_color,
-        diag_kind_text,
-        COL(RESET),
-        HBK_SV_EXPAND(diag->message)
-    );
+    hbk_source* source = &state->sources[source_id];
+    hbk_vector(int64_t) line_starts = hbk_source_get_line_starts(state, source);
+    int64_t line_index = hbk_line_index_for_offset(line_starts, diag->location.offset);
+    int64_t line_start = line_starts[line_index];
+    int64_t column = diag->location.offset - line_start + 1;
+
+    hbk_string_append_sv(string, source_name);
+    hbk_string_append_cstr(string, ":");
+    hbk_string_append_int(string, line_index + 1);
+    hbk_string_append_cstr(string, ":");
+    hbk_string_append_int(string, column);
+    hbk_string_append_cstr(string, ": ");
+    hbk_string_append_cstr(string, diag_kind_color);
+    hbk_string_append_cstr(string, diag_kind_text);
+    hbk_string_append_cstr(string, ":");
+    hbk_string_append_cstr(string, COL(RESET));
+    hbk_string_append_cstr(string, " ");
+    hbk_string_append_sv(string, diag->message);
+    hbk_string_append_cstr(string, "\n");
+
+    /// The line ends where the next one starts, so the snippet never needs to look for its newline.
+    int64_t line_end = line_index + 1 < hbk_vector_count(line_starts) ? line_starts[line_index + 1] - 1 : source->text.count;
+    if (line_end > line_start && source->text.data[line_end - 1] == '\r') {
+        line_end--;
+    }
+
+    hbk_string_view line_text = {source->text.data + line_start, line_end - line_start};
+
+    /// Only the first line of a location spanning several lines is underlined, up to where it ends.
+    int64_t underline_start = diag->location.offset - line_start;
+    if (underline_start > line_text.count) {
+        underline_start = line_text.count;
+    }
+
+    int64_t underline_length = diag->location.length;
+    if (underline_length > line_text.count - underline_start) {
+        underline_length = line_text.count - underline_start;
+    }
+
+    if (underline_length < 1) {
+        underline_length = 1;
+    }
+
+    hbk_string_append_cstr(string, COL(BRIGHT_BLACK));
+    hbk_string_append_cstr(string, " ");
+    int64_t gutter_start = hbk_vector_count(*string);
+    hbk_string_append_int(string, line_index + 1);
+    int64_t gutter_width = hbk_vector_count(*string) - gutter_start;
+    hbk_string_append_cstr(string, " | ");
+    hbk_string_append_cstr(string, COL(RESET));
+    hbk_string_append_sv(string, line_text);
+    hbk_string_append_cstr(string, "\n");
+
+    /// The gutter is as wide as the line number, so the snippet and underline line up.
+    hbk_string_append_cstr(string, COL(BRIGHT_BLACK));
+    char* gutter = hbk_string_append_uninitialized(string, 1 + gutter_width);
+    memset(gutter, ' ', (size_t)(1 + gutter_width));
+    hbk_string_append_cstr(string, " | ");
+    hbk_string_append_cstr(string, COL(RESET));
+
+    /// Keep tabs as tabs, so the underline lines up however wide the terminal draws them.
+    char* underline_indent = hbk_string_append_uninitialized(string, underline_start);
+    for (int64_t i = 0; i < underline_start; i++) {
+        underline_indent[i] = line_text.data[i] == '\t' ? '\t' : ' ';
+    }
+
+    hbk_string_append_cstr(string, diag_kind_color);
+    char* underline = hbk_string_append_uninitialized(string, underline_length);
+    underline[0] = '^';
+    memset(underline + 1, '~', (size_t)(underline_length - 1));
+    hbk_string_append_cstr(string, COL(RESET));
+    hbk_string_append_cstr(string, "\n");
+}
+
+const char* hbk_diagnostic_kind_name(hbk_diagnostic_kind kind) {
+    switch (kind) {
+        default: HBK_UNREACHABLE;
+        case HBK_DIAG_VERBOSE: return "verbose";
+        case HBK_DIAG_DEBUG: return "debug";
+        case HBK_DIAG_INFO: return "note";
+        case HBK_DIAG_WARNING: return "warning";
+        case HBK_DIAG_ERROR: return "error";
+        case HBK_DIAG_FATAL: return "fatal";
+        case HBK_DIAG_RELATED: return "related";
+    }
+
+    return "";
+}
+
+static void hbk_file_writer_write_u32_le(hbk_file_writer* writer, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    hbk_file_writer_write(writer, bytes, sizeof bytes);
+}
+
+static void hbk_file_writer_write_i64_le(hbk_file_writer* writer, int64_t value) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)((uint64_t)value >> (8 * i));
+    }
+
+    hbk_file_writer_write(writer, bytes, sizeof bytes);
+}
+
+static void hbk_diagnostic_write_json_fields(hbk_state* state, hbk_diagnostic* diag, hbk_file_writer* writer) {
+    hbk_line_column line_column = hbk_state_location_to_line_column(state, diag->location);
+
+    hbk_file_writer_write_cstr(writer, "{\"kind\":\"");
+    hbk_file_writer_write_cstr(writer, hbk_diagnostic_kind_name(diag->kind));
+    hbk_file_writer_write_cstr(writer, "\",\"source_id\":");
+    hbk_file_writer_write_int(writer, diag->location.source_id);
+    hbk_file_writer_write_cstr(writer, ",\"source\":");
+    hbk_file_writer_write_json_string(writer, hbk_state_get_source_name(state, diag->location.source_id));
+    hbk_file_writer_write_cstr(writer, ",\"offset\":");
+    hbk_file_writer_write_int(writer, diag->location.offset);
+    hbk_file_writer_write_cstr(writer, ",\"length\":");
+    hbk_file_writer_write_int(writer, diag->location.length);
+    hbk_file_writer_write_cstr(writer, ",\"line\":");
+    hbk_file_writer_write_int(writer, line_column.line);
+    hbk_file_writer_write_cstr(writer, ",\"column\":");
+    hbk_file_writer_write_int(writer, line_column.column);
+    hbk_file_writer_write_cstr(writer, ",\"message\":");
+    hbk_file_writer_write_json_string(writer, diag->message);
+}
+
+static void hbk_diagnostic_write_json(hbk_state* state, hbk_diagnostic* diag, hbk_file_writer* writer) {
+    hbk_diagnostic_write_json_fields(state, diag, writer);
+    hbk_file_writer_write_cstr(writer, ",\"related\":[");
+    for (int64_t i = 0; i < hbk_vector_count(diag->related_diagnostics); i++) {
+        if (i > 0) {
+            hbk_file_writer_write(writer, ",", 1);
+        }
+
+        hbk_diagnostic_write_json_fields(state, diag->related_diagnostics[i], writer);
+        hbk_file_writer_write(writer, "}", 1);
+    }
+
+    hbk_file_writer_write_cstr(writer, "]}\n");
+}
+
+/// The fixed part of a binary record, after its size: kind and padding, related count, five i64 fields and the message length.
+#define HBK_BINARY_RECORD_FIXED_SIZE (4 + 4 + 5 * 8 + 4)
+
+static void hbk_diagnostic_write_binary_record(hbk_state* state, hbk_diagnostic* diag, int64_t related_count, int64_t size, hbk_file_writer* writer) {
+    HBK_ASSERT(size <= UINT32_MAX, "Diagnostic is too big for a binary record");
+    HBK_ASSERT(diag->message.count <= UINT32_MAX, "Diagnostic message is too long for a binary record");
+
+    hbk_line_column line_column = hbk_state_location_to_line_column(state, diag->location);
+
+    hbk_file_writer_write_u32_le(writer, (uint32_t)size);
+    uint8_t kind_and_padding[4] = {(uint8_t)diag->kind, 0, 0, 0};
+    hbk_file_writer_write(writer, kind_and_padding, sizeof kind_and_padding);
+    hbk_file_writer_write_u32_le(writer, (uint32_t)related_count);
+    hbk_file_writer_write_i64_le(writer, diag->location.source_id);
+    hbk_file_writer_write_i64_le(writer, diag->location.offset);
+    hbk_file_writer_write_i64_le(writer, diag->location.length);
+    hbk_file_writer_write_i64_le(writer, line_column.line);
+    hbk_file_writer_write_i64_le(writer, line_column.column);
+    hbk_file_writer_write_u32_le(writer, (uint32_t)diag->message.count);
+    hbk_file_writer_write(writer, diag->message.data, diag->message.count);
+}
+
+static void hbk_diagnostic_write_binary(hbk_state* state, hbk_diagnostic* diag, hbk_file_writer* writer) {
+    int64_t related_count = hbk_vector_count(diag->related_diagnostics);
+
+    /// The size covers the related records too, so readers can skip a whole diagnostic at once.
+    int64_t size = HBK_BINARY_RECORD_FIXED_SIZE + diag->message.count;
+    for (int64_t i = 0; i < related_count; i++) {
+        size += 4 + HBK_BINARY_RECORD_FIXED_SIZE + diag->related_diagnostics[i]->message.count;
+    }
+
+    hbk_diagnostic_write_binary_record(state, diag, related_count, size, writer);
+    for (int64_t i = 0; i < related_count; i++) {
+        hbk_diagnostic* related = diag->related_diagnostics[i];
+        hbk_diagnostic_write_binary_record(state, related, 0, HBK_BINARY_RECORD_FIXED_SIZE + related->message.count, writer);
+    }
+}
+
+static void hbk_diagnostic_write_records(hbk_state* state, hbk_diagnostic** diagnostics, int64_t count, hbk_diagnostic_format format, FILE* file) {
+    HBK_ASSERT(format == HBK_DIAGNOSTIC_FORMAT_JSON || format == HBK_DIAGNOSTIC_FORMAT_BINARY, "Only JSON and binary diagnostics are written as records");
+
+    hbk_file_writer writer = {.file = file};
+    for (int64_t i = 0; i < count; i++) {
+        hbk_diagnostic* diag = diagnostics[i];
+        if (diag->kind == HBK_DIAG_RELATED) {
+            continue;
+        }
+
+        if (format == HBK_DIAGNOSTIC_FORMAT_JSON) {
+            hbk_diagnostic_write_json(state, diag, &writer);
+        } else {
+            hbk_diagnostic_write_binary(state, diag, &writer);
+        }
+    }
+
+    hbk_file_writer_flush(&writer);
+}
+
+void hbk_diagnostic_write_to_file(hbk_state* state, hbk_diagnostic* diag, hbk_diagnostic_format format, FILE* file) {
+    HBK_ASSERT(state != NULL, "Invalid state pointer");
+    HBK_ASSERT(diag != NULL, "Invalid diagnostic pointer");
+    HBK_ASSERT(file != NULL, "Invalid file pointer");
+
+    if (format == HBK_DIAGNOSTIC_FORMAT_TEXT) {
+        hbk_string text = NULL;
+        hbk_vector_init(text, &state->allocator);
+        hbk_diagnostic_render_to_string(state, diag, &text);
+        fwrite(text, 1, (size_t)hbk_vector_count(text), file);
+        hbk_vector_free(text);
+        return;
+    }
+
+    hbk_diagnostic_write_records(state, &diag, 1, format, file);
+}
+
+void hbk_diagnostic_write_binary_header(FILE* file) {
+    HBK_ASSERT(file != NULL, "Invalid file pointer");
+    const uint8_t header[8] = {'H', 'B', 'K', 'D', 1, 0, 0, 0};
+    fwrite(header, 1, sizeof header, file);
 }
@@ -34,6 +34,7 @@ void cflags(Nob_Cmd* cmd) {
     nob_cmd_append(cmd, "-Wno-unused");
     nob_cmd_append(cmd, "-Wno-unused-parameter");
     nob_cmd_append(cmd, "-Werror=return-type");
+    nob_cmd_append(cmd, "-pthread");
 }
 
 static bool cstring_ends_with(const char* cs, const char* end) {
@@ -83,14 +84,134 @@ defer:
     return result;
 }
 
+/// @brief Extra flags for the tests which need the library built differently, same as TEST_CFLAGS in the Makefile.
+static void test_cflags(Nob_Cmd* cmd, const char* test_name) {
+    /// Tiny chunks, so that small sources are lexed in lots of them.
+    if (0 == strcmp(test_name, "test_lex_chunks")) {
+        nob_cmd_append(cmd, "-DHBK_LEX_MIN_CHUNK_SIZE=64");
+    }
+}
+
+/// @brief Builds every tests/test_*.c against the library sources into ./build/tests, and runs them.
+bool build_and_run_tests() {
+    int result = true;
+
+    Nob_Cmd cmd = {};
+    Nob_File_Paths files = {};
+    nob_read_entire_dir("./tests", &files);
+
+    if (!nob_mkdir_if_not_exists("./build") || !nob_mkdir_if_not_exists("./build/tests")) {
+        nob_return_defer(false);
+    }
+
+    for (size_t i = 0; i < files.count; i++) {
+        const char* file = files.items[i];
+        if (0 != strncmp(file, "test_", 5) || !cstring_ends_with(file, ".c")) {
+            continue;
+        }
+
+        const char* test_name = nob_temp_sprintf("%.*s", (int)(strlen(file) - 2), file);
+        const char* test_path = nob_temp_sprintf("./build/tests/%s", test_name);
+
+        cmd.count = 0;
+        nob_cmd_append(&cmd, CC);
+        cflags(&cmd);
+        nob_cmd_append(&cmd, "-I", "lib");
+        test_cflags(&cmd, test_name);
+        nob_cmd_append(&cmd, "-o", test_path, nob_temp_sprintf("./tests/%s", file));
+        hibiku_files(&cmd);
+
+        if (!nob_cmd_run_sync(cmd)) {
+            nob_return_defer(false);
+        }
+
+        cmd.count = 0;
+        nob_cmd_append(&cmd, test_path);
+        if (!nob_cmd_run_sync(cmd)) {
+            nob_return_defer(false);
+        }
+    }
+
+defer:
+    nob_cmd_free(cmd);
+    return result;
+}
+
+/// @brief Builds every bench/bench_*.c against the library sources into ./build/bench, optimized
+/// and without asserts like `make bench`, and runs them.
+bool build_and_run_benches() {
+    int result = true;
+
+    Nob_Cmd cmd = {};
+    Nob_File_Paths files = {};
+    nob_read_entire_dir("./bench", &files);
+
+    if (!nob_mkdir_if_not_exists("./build") || !nob_mkdir_if_not_exists("./build/bench")) {
+        nob_return_defer(false);
+    }
+
+    for (size_t i = 0; i < files.count; i++) {
+        const char* file = files.items[i];
+        if (0 != strncmp(file, "bench_", 6) || !cstring_ends_with(file, ".c")) {
+            continue;
+        }
+
+        const char* bench_path = nob_temp_sprintf("./build/bench/%.*s", (int)(strlen(file) - 2), file);
+
+        cmd.count = 0;
+        nob_cmd_append(&cmd, CC);
+        cflags(&cmd);
+#if defined(__clang__)
+        /// The sanitizer would be most of what gets measured.
+        nob_cmd_append(&cmd, "-fno-sanitize=address");
+#endif
+        nob_cmd_append(&cmd, "-I", "lib", "-O2", "-DNDEBUG");
+        nob_cmd_append(&cmd, "-o", bench_path, nob_temp_sprintf("./bench/%s", file));
+        hibiku_files(&cmd);
+
+        if (!nob_cmd_run_sync(cmd)) {
+            nob_return_defer(false);
+        }
+
+        cmd.count = 0;
+        nob_cmd_append(&cmd, bench_path);
+        if (!nob_cmd_run_sync(cmd)) {
+            nob_return_defer(false);
+        }
+    }
+
+defer:
+    nob_cmd_free(cmd);
+    return result;
+}
+
 int main(int argc, char** argv) {
     NOB_GO_REBUILD_URSELF(argc, argv);
 
+    const char* program_name = nob_shift_args(&argc, &argv);
+    (void)program_name;
+
     int result = 0;
     if (!build_hibiku_exe()) {
         nob_return_defer(1);
     }
 
+    if (argc > 0) {
+        const char* command = nob_shift_args(&argc, &argv);
+        if (0 == strcmp(command, "test")) {
+            if (!build_and_run_tests()) {
+                nob_return_defer(1);
+            }
+        } else if (0 == strcmp(command, "bench")) {
+            if (!build_and_run_benches()) {
+                nob_return_defer(1);
+            }
+        } else {
+            nob_log(NOB_ERROR, "Unknown command '%s', expected nothing, 'test' or 'bench'.", command);
+            nob_return_defer(1);
+        }
+    }
+
 defer:
     return result;
 }
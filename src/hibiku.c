@@ -3,6 +3,7 @@
 
 #ifdef _WIN32
 #    define NOMINMAX
+#    include <fcntl.h>
 #    include <io.h>
 #    include <Windows.h>
 #    define isatty _isatty
@@ -13,20 +14,221 @@
 #    include <unistd.h>
 #endif
 
+#include <stdlib.h>
+#include <string.h>
+
 bool stdout_isatty();
 bool stderr_isatty();
+void print_memory_stats(hbk_state* state, FILE* file);
+void print_time_passes(hbk_state* state, FILE* file);
+void print_diagnostic(hbk_state* state, hbk_diagnostic* diag, void* user_data);
+void write_diagnostic_record(hbk_state* state, hbk_diagnostic* diag, void* user_data);
 
 int main(int argc, char** argv) {
+    bool show_memory_stats = false;
+    bool show_time_passes = false;
+    const char* trace_file_path = NULL;
+    bool stream_diagnostics = false;
+    int64_t max_errors = 0;
+    int64_t job_count = 1;
+    hbk_diagnostic_format diagnostic_format = HBK_DIAGNOSTIC_FORMAT_TEXT;
+    hbk_vector(const char*) file_paths = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (0 == strcmp(arg, "--mem-stats")) {
+            show_memory_stats = true;
+        } else if (0 == strcmp(arg, "--time-passes")) {
+            show_time_passes = true;
+        } else if (0 == strncmp(arg, "--trace=", 8) && arg[8] != 0) {
+            trace_file_path = arg + 8;
+        } else if (0 == strcmp(arg, "--stream-diagnostics")) {
+            stream_diagnostics = true;
+        } else if (0 == strcmp(arg, "--diagnostic-format=text")) {
+            diagnostic_format = HBK_DIAGNOSTIC_FORMAT_TEXT;
+        } else if (0 == strcmp(arg, "--diagnostic-format=json")) {
+            diagnostic_format = HBK_DIAGNOSTIC_FORMAT_JSON;
+        } else if (0 == strcmp(arg, "--diagnostic-format=binary")) {
+            diagnostic_format = HBK_DIAGNOSTIC_FORMAT_BINARY;
+        } else if (0 == strncmp(arg, "--max-errors=", 13)) {
+            char* end = NULL;
+            max_errors = strtoll(arg + 13, &end, 10);
+            if (end == arg + 13 || *end != 0 || max_errors < 0) {
+                fprintf(stderr, "Invalid error limit in '%s'.\n", arg);
+                hbk_vector_free(file_paths);
+                return 1;
+            }
+        } else if (0 == strncmp(arg, "--jobs=", 7)) {
+            char* end = NULL;
+            job_count = strtoll(arg + 7, &end, 10);
+            if (end == arg + 7 || *end != 0 || job_count < 0) {
+                fprintf(stderr, "Invalid job count in '%s'.\n", arg);
+                hbk_vector_free(file_paths);
+                return 1;
+            }
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            fprintf(stderr, "Unknown option '%s'.\n", arg);
+            fprintf(stderr, "Usage: %s [--mem-stats] [--time-passes] [--trace=out.json] [--stream-diagnostics] [--max-errors=N] [--jobs=N] [--diagnostic-format=text|json|binary] [files...]\n", argv[0]);
+            hbk_vector_free(file_paths);
+            return 1;
+        } else {
+            hbk_vector_push(file_paths, arg);
+        }
+    }
+
+    if (hbk_vector_count(file_paths) == 0) {
+        hbk_vector_push(file_paths, "./examples/hello.hibiku");
+    }
+
     fprintf(stderr, "Hello, %s!\n", HBK_VERSION);
 
     hbk_state* state = hbk_state_create();
     hbk_state_set_enable_color(state, stderr_isatty());
+    hbk_state_set_max_errors(state, max_errors);
+
+    if (trace_file_path != NULL && !hbk_state_start_trace(state)) {
+        fprintf(stderr, "Instrumentation was compiled out of this build (see HBK_INSTRUMENTATION), so --trace won't record anything.\n");
+        trace_file_path = NULL;
+    }
+
+    hbk_state_set_diagnostic_format(state, diagnostic_format);
+
+    /// Text diagnostics are for people and go to stderr along with everything else,
+    /// JSON and binary ones are for tools and get stdout to themselves.
+    FILE* diagnostic_file = stderr;
+    if (diagnostic_format != HBK_DIAGNOSTIC_FORMAT_TEXT) {
+        diagnostic_file = stdout;
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+
+    if (stream_diagnostics && diagnostic_format == HBK_DIAGNOSTIC_FORMAT_BINARY) {
+        hbk_diagnostic_write_binary_header(diagnostic_file);
+    }
+
+    hbk_string diagnostic_buffer = NULL;
+    if (stream_diagnostics && diagnostic_format == HBK_DIAGNOSTIC_FORMAT_TEXT) {
+        hbk_state_set_diagnostic_sink(state, print_diagnostic, &diagnostic_buffer);
+    } else if (stream_diagnostics) {
+        hbk_state_set_diagnostic_sink(state, write_diagnostic_record, &diagnostic_format);
+    }
+
+    if (job_count == 1) {
+        for (int64_t i = 0; i < hbk_vector_count(file_paths); i++) {
+            hbk_source_id source_id = hbk_state_add_source_from_file(state, file_paths[i]);
+            hbk_state_print_source_syntax_to_file(state, source_id, stderr);
+        }
+    } else {
+        /// Read everything first, so all of it can be parsed at once. --jobs=0 uses every processor.
+        hbk_vector(hbk_source_id) source_ids = NULL;
+        for (int64_t i = 0; i < hbk_vector_count(file_paths); i++) {
+            hbk_vector_push(source_ids, hbk_state_add_source_from_file(state, file_paths[i]));
+        }
+
+        hbk_state_parse_all(state, job_count);
+        for (int64_t i = 0; i < hbk_vector_count(source_ids); i++) {
+            hbk_state_print_source_syntax_to_file(state, source_ids[i], stderr);
+        }
+
+        hbk_vector_free(source_ids);
+    }
+
+    if (!stream_diagnostics) {
+        hbk_state_render_diagnostics_to_file(state, diagnostic_file);
+    }
+
+    if (show_memory_stats) {
+        print_memory_stats(state, stderr);
+    }
+
+    if (show_time_passes) {
+        print_time_passes(state, stderr);
+    }
 
-    hbk_source_id source_id = hbk_state_add_source_from_file(state, "./examples/hello.hibiku");
-    hbk_state_render_diagnostics_to_file(state, stderr);
+    int exit_code = 0;
+    if (trace_file_path != NULL) {
+        FILE* trace_file = fopen(trace_file_path, "wb");
+        if (trace_file == NULL) {
+            fprintf(stderr, "Could not open '%s' to write the trace to.\n", trace_file_path);
+            exit_code = 1;
+        } else {
+            hbk_state_write_trace_to_file(state, trace_file);
+            fclose(trace_file);
+        }
+    }
 
     hbk_state_destroy(state);
-    return 0;
+    hbk_vector_free(diagnostic_buffer);
+    hbk_vector_free(file_paths);
+    return exit_code;
+}
+
+static void print_memory_usage(FILE* file, const char* name, hbk_memory_usage usage) {
+    fprintf(
+        file,
+        "%-12s %14lld %14lld %14lld %14lld %14lld\n",
+        name,
+        (long long)usage.reserved_bytes,
+        (long long)usage.used_bytes,
+        (long long)usage.wasted_bytes,
+        (long long)usage.peak_reserved_bytes,
+        (long long)usage.peak_used_bytes
+    );
+}
+
+/// Prints one line per category, in bytes, in a fixed layout so it's easy to diff or scrape.
+void print_memory_stats(hbk_state* state, FILE* file) {
+    hbk_memory_stats stats = hbk_state_get_memory_stats(state);
+
+    fprintf(file, "%-12s %14s %14s %14s %14s %14s\n", "memory", "reserved", "used", "wasted", "peak reserved", "peak used");
+    for (int64_t i = 0; i < HBK_MEMORY_CATEGORY_COUNT; i++) {
+        print_memory_usage(file, hbk_memory_category_name((hbk_memory_category)i), stats.categories[i]);
+    }
+
+    print_memory_usage(file, "total", stats.total);
+}
+
+/// The diagnostic sink for --stream-diagnostics. `user_data` is a string which is reused for every diagnostic.
+void print_diagnostic(hbk_state* state, hbk_diagnostic* diag, void* user_data) {
+    hbk_string* buffer = user_data;
+    hbk_vector_set_count(*buffer, 0);
+    hbk_diagnostic_render_to_string(state, diag, buffer);
+    fwrite(*buffer, 1, (size_t)hbk_vector_count(*buffer), stderr);
+}
+
+/// The diagnostic sink for --stream-diagnostics with JSON or binary output. `user_data` points to the format.
+void write_diagnostic_record(hbk_state* state, hbk_diagnostic* diag, void* user_data) {
+    hbk_diagnostic_write_to_file(state, diag, *(hbk_diagnostic_format*)user_data, stdout);
+}
+
+/// Prints one line per pass and one per counter, in the same spirit as `print_memory_stats`.
+void print_time_passes(hbk_state* state, FILE* file) {
+    if (!hbk_instrumentation_is_enabled()) {
+        fprintf(file, "Instrumentation was compiled out of this build (see HBK_INSTRUMENTATION), there's nothing to report.\n");
+        return;
+    }
+
+    hbk_instrumentation_stats stats = hbk_state_get_instrumentation_stats(state);
+
+    int64_t total_nanoseconds = 0;
+    for (int64_t i = 0; i < HBK_PASS_COUNT; i++) {
+        total_nanoseconds += stats.passes[i].total_nanoseconds;
+    }
+
+    fprintf(file, "%-14s %8s %14s %8s\n", "pass", "runs", "time (ms)", "share");
+    for (int64_t i = 0; i < HBK_PASS_COUNT; i++) {
+        hbk_pass_stats pass = stats.passes[i];
+        double share = total_nanoseconds == 0 ? 0.0 : 100.0 * (double)pass.total_nanoseconds / (double)total_nanoseconds;
+        fprintf(file, "%-14s %8lld %14.3f %7.1f%%\n", hbk_pass_name((hbk_pass)i), (long long)pass.run_count, (double)pass.total_nanoseconds / 1e6, share);
+    }
+
+    fprintf(file, "%-14s %8s %14.3f %7.1f%%\n", "total", "", (double)total_nanoseconds / 1e6, 100.0);
+
+    fprintf(file, "%-14s %14s\n", "counter", "value");
+    for (int64_t i = 0; i < HBK_COUNTER_COUNT; i++) {
+        fprintf(file, "%-14s %14lld\n", hbk_counter_name((hbk_counter)i), (long long)stats.counters[i]);
+    }
 }
 
 bool stdout_isatty() {
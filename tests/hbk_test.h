@@ -0,0 +1,76 @@
+#ifndef HBK_TEST_H
+#define HBK_TEST_H
+
+#include <hibiku.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Each test is its own program, built against the library sources by `make test` (or `./nob test`).
+/// It reports every failed check and exits with a non-zero status if there were any.
+
+static int64_t hbk_test_failure_count = 0;
+
+/// @brief Reports the failure, with where it happened, if `C` doesn't hold. The test keeps going either way.
+#define HBK_TEST_EXPECT(C, ...)                                                 \
+    do {                                                                        \
+        if (!(C)) {                                                             \
+            fprintf(stderr, "%s:%d: check failed: %s\n  ", __FILE__, __LINE__, #C); \
+            fprintf(stderr, __VA_ARGS__);                                       \
+            fprintf(stderr, "\n");                                              \
+            hbk_test_failure_count++;                                           \
+        }                                                                       \
+    } while (0)
+
+/// @brief The exit status for the end of `main`.
+static inline int hbk_test_result(const char* test_name) {
+    if (hbk_test_failure_count != 0) {
+        fprintf(stderr, "%s: %lld check(s) failed\n", test_name, (long long)hbk_test_failure_count);
+        return 1;
+    }
+
+    fprintf(stderr, "%s: ok\n", test_name);
+    return 0;
+}
+
+/// @brief Reads everything written to the (temporary) file back into a string.
+static inline hbk_string hbk_test_read_back(FILE* file) {
+    hbk_string result = NULL;
+    rewind(file);
+
+    char buffer[4096];
+    size_t read_count;
+    while ((read_count = fread(buffer, 1, sizeof buffer, file)) > 0) {
+        hbk_vector_append_n(result, buffer, (int64_t)read_count);
+    }
+
+    hbk_string_append_cstr(&result, "");
+    return result;
+}
+
+/// @brief Parses the source if needed, and returns its syntax tree as the CLI prints it, without color.
+static inline hbk_string hbk_test_print_syntax(hbk_state* state, hbk_source_id source_id) {
+    FILE* file = tmpfile();
+    if (file == NULL) {
+        fprintf(stderr, "Could not create a temporary file for the syntax tree.\n");
+        exit(1);
+    }
+
+    hbk_state_print_source_syntax_to_file(state, source_id, file);
+    hbk_string result = hbk_test_read_back(file);
+    fclose(file);
+    return result;
+}
+
+/// @brief Counts the newlines in the string.
+static inline int64_t hbk_test_count_lines(hbk_string string) {
+    int64_t count = 0;
+    for (int64_t i = 0; i < hbk_vector_count(string); i++) {
+        count += string[i] == '\n';
+    }
+
+    return count;
+}
+
+#endif // !HBK_TEST_H
@@ -0,0 +1,180 @@
+#include "hbk_test.h"
+
+/// Creating diagnostics: which ones count as duplicates, and what reaches the sink.
+
+static void count_diagnostic(hbk_state* state, hbk_diagnostic* diag, void* user_data) {
+    (void)state;
+    (void)diag;
+    int64_t* count = user_data;
+    (*count)++;
+}
+
+/// @brief Only diagnostics which match in kind, location and message are duplicates.
+static void expect_duplicates_dropped() {
+    int64_t published_count = 0;
+    hbk_state* state = hbk_state_create();
+    hbk_state_set_diagnostic_sink(state, count_diagnostic, &published_count);
+
+    const char* text = "local x = 1;";
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "test.hibiku", text, (int64_t)strlen(text), HBK_SOURCE_COPY);
+    hbk_location location = hbk_location_create(source_id, 6, 1);
+
+    hbk_diagnostic* error = hbk_diagnostic_create(state, HBK_DIAG_ERROR, location, "Something about x.");
+    hbk_diagnostic* warning = hbk_diagnostic_create(state, HBK_DIAG_WARNING, location, "Something about x.");
+    hbk_diagnostic* error_again = hbk_diagnostic_create(state, HBK_DIAG_ERROR, location, "Something about x.");
+    hbk_diagnostic* warning_again = hbk_diagnostic_create_format(state, HBK_DIAG_WARNING, location, "Something about %s.", "x");
+    hbk_diagnostic* elsewhere = hbk_diagnostic_create(state, HBK_DIAG_ERROR, hbk_location_create(source_id, 10, 1), "Something about x.");
+    hbk_diagnostic* other_message = hbk_diagnostic_create(state, HBK_DIAG_ERROR, location, "Something else about x.");
+
+    HBK_TEST_EXPECT(error != warning, "an error and a warning with the same location and message were merged");
+    HBK_TEST_EXPECT(error_again == error, "a duplicate error wasn't merged with the first one");
+    HBK_TEST_EXPECT(warning_again == warning, "a duplicate warning wasn't merged with the first one");
+    HBK_TEST_EXPECT(elsewhere != error, "errors at different locations were merged");
+    HBK_TEST_EXPECT(other_message != error, "errors with different messages were merged");
+    HBK_TEST_EXPECT(published_count == 4, "%lld diagnostics were published instead of 4", (long long)published_count);
+
+    hbk_state_destroy(state);
+}
+
+typedef struct related_sink {
+    int64_t published_count;
+    int64_t related_published_count;
+    /// @brief The related count of each published diagnostic, when it reached the sink.
+    int64_t related_counts[4];
+    /// @brief The streamed JSON of every published diagnostic.
+    FILE* json;
+} related_sink;
+
+static void record_related(hbk_state* state, hbk_diagnostic* diag, void* user_data) {
+    related_sink* sink = user_data;
+    if (diag->kind == HBK_DIAG_RELATED) {
+        sink->related_published_count++;
+        return;
+    }
+
+    if (sink->published_count < 4) {
+        sink->related_counts[sink->published_count] = hbk_vector_count(diag->related_diagnostics);
+    }
+
+    sink->published_count++;
+    hbk_diagnostic_write_to_file(state, diag, HBK_DIAGNOSTIC_FORMAT_JSON, sink->json);
+}
+
+/// @brief A diagnostic reaches the sink when it is committed, with the related diagnostics attached by then.
+static void expect_related_published_with_parent() {
+    related_sink sink = {.json = tmpfile()};
+    hbk_state* state = hbk_state_create();
+    hbk_state_set_diagnostic_sink(state, record_related, &sink);
+
+    const char* text = "local x = 1;\nlocal x = 2;";
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "test.hibiku", text, (int64_t)strlen(text), HBK_SOURCE_COPY);
+
+    hbk_diagnostic* diag = hbk_diagnostic_begin(state, HBK_DIAG_ERROR, hbk_location_create(source_id, 19, 1), "Redefinition of 'x'.");
+    HBK_TEST_EXPECT(sink.published_count == 0, "a diagnostic reached the sink before it was committed");
+    hbk_diagnostic_add_related(diag, hbk_diagnostic_begin_format(state, HBK_DIAG_INFO, hbk_location_create(source_id, 6, 1), "'%s' was defined here.", "x"));
+    hbk_diagnostic_add_related(diag, hbk_diagnostic_begin(state, HBK_DIAG_INFO, hbk_location_create(source_id, 0, 5), "In this scope."));
+    hbk_diagnostic_commit(state, diag);
+    hbk_diagnostic_commit(state, diag);
+    hbk_diagnostic_commit(state, diag->related_diagnostics[0]);
+
+    hbk_diagnostic* again = hbk_diagnostic_create(state, HBK_DIAG_ERROR, hbk_location_create(source_id, 19, 1), "Redefinition of 'x'.");
+    HBK_TEST_EXPECT(again == diag, "a committed diagnostic wasn't found again by its key");
+    (void)hbk_diagnostic_create(state, HBK_DIAG_WARNING, hbk_location_create(source_id, 0, 5), "Unused 'x'.");
+
+    HBK_TEST_EXPECT(sink.published_count == 2, "%lld diagnostics were published instead of 2", (long long)sink.published_count);
+    HBK_TEST_EXPECT(sink.related_published_count == 0, "%lld related diagnostics were published on their own", (long long)sink.related_published_count);
+    HBK_TEST_EXPECT(sink.related_counts[0] == 2, "the sink saw %lld related diagnostics instead of 2", (long long)sink.related_counts[0]);
+    HBK_TEST_EXPECT(sink.related_counts[1] == 0, "the sink saw %lld related diagnostics instead of 0", (long long)sink.related_counts[1]);
+
+    hbk_string json = hbk_test_read_back(sink.json);
+    HBK_TEST_EXPECT(strstr(json, "'x' was defined here.") != NULL, "the streamed JSON is missing the first related diagnostic:\n%s", json);
+    HBK_TEST_EXPECT(strstr(json, "In this scope.") != NULL, "the streamed JSON is missing the second related diagnostic:\n%s", json);
+    HBK_TEST_EXPECT(hbk_test_count_lines(json) == 2, "the streamed JSON has %lld lines instead of 2:\n%s", (long long)hbk_test_count_lines(json), json);
+    hbk_vector_free(json);
+    fclose(sink.json);
+
+    hbk_state_destroy(state);
+}
+
+typedef struct kind_counts {
+    int64_t counts[HBK_DIAG_RELATED + 1];
+    /// @brief The related diagnostics attached to the published ones, by kind.
+    int64_t related_counts[HBK_DIAG_RELATED + 1];
+} kind_counts;
+
+static void count_kinds(hbk_state* state, hbk_diagnostic* diag, void* user_data) {
+    (void)state;
+    kind_counts* counts = user_data;
+    counts->counts[diag->kind]++;
+    for (int64_t i = 0; i < hbk_vector_count(diag->related_diagnostics); i++) {
+        counts->related_counts[diag->related_diagnostics[i]->kind]++;
+    }
+}
+
+/// @brief A related diagnostic is never the same object as a top-level one with the same kind, location
+/// and message, whichever of the two comes first.
+static void expect_related_kept_apart_from_top_level(bool note_first) {
+    kind_counts counts = {};
+    hbk_state* state = hbk_state_create();
+    hbk_state_set_diagnostic_sink(state, count_kinds, &counts);
+
+    const char* text = "local x = 1;\nlocal x = 2;";
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "test.hibiku", text, (int64_t)strlen(text), HBK_SOURCE_COPY);
+    hbk_location note_location = hbk_location_create(source_id, 6, 1);
+
+    hbk_diagnostic* note = NULL;
+    if (note_first) {
+        note = hbk_diagnostic_create(state, HBK_DIAG_INFO, note_location, "'x' was defined here.");
+    }
+
+    hbk_diagnostic* error = hbk_diagnostic_begin(state, HBK_DIAG_ERROR, hbk_location_create(source_id, 19, 1), "Redefinition of 'x'.");
+    hbk_diagnostic* related = hbk_diagnostic_begin(state, HBK_DIAG_INFO, note_location, "'x' was defined here.");
+    HBK_TEST_EXPECT(related != note, "beginning a diagnostic returned the published one with the same key");
+    hbk_diagnostic_add_related(error, related);
+    hbk_diagnostic_commit(state, error);
+
+    if (!note_first) {
+        note = hbk_diagnostic_create(state, HBK_DIAG_INFO, note_location, "'x' was defined here.");
+        HBK_TEST_EXPECT(note != related, "creating a diagnostic returned the related one with the same key");
+    }
+
+    HBK_TEST_EXPECT(note != NULL && note->kind == HBK_DIAG_INFO, "the published note is no longer a note");
+    HBK_TEST_EXPECT(counts.counts[HBK_DIAG_INFO] == 1, "%lld notes were published instead of 1", (long long)counts.counts[HBK_DIAG_INFO]);
+    HBK_TEST_EXPECT(counts.counts[HBK_DIAG_ERROR] == 1, "%lld errors were published instead of 1", (long long)counts.counts[HBK_DIAG_ERROR]);
+    HBK_TEST_EXPECT(counts.related_counts[HBK_DIAG_RELATED] == 1, "the error was published with %lld related diagnostics instead of 1", (long long)counts.related_counts[HBK_DIAG_RELATED]);
+
+    hbk_state_destroy(state);
+
+    /// Without a sink, the note has to make it into the rendered output as well.
+    state = hbk_state_create();
+    source_id = hbk_state_add_source_from_memory(state, "test.hibiku", text, (int64_t)strlen(text), HBK_SOURCE_COPY);
+    note_location = hbk_location_create(source_id, 6, 1);
+    if (note_first) {
+        (void)hbk_diagnostic_create(state, HBK_DIAG_INFO, note_location, "'x' was defined here.");
+    }
+
+    error = hbk_diagnostic_begin(state, HBK_DIAG_ERROR, hbk_location_create(source_id, 19, 1), "Redefinition of 'x'.");
+    hbk_diagnostic_add_related(error, hbk_diagnostic_begin(state, HBK_DIAG_INFO, note_location, "'x' was defined here."));
+    hbk_diagnostic_commit(state, error);
+    if (!note_first) {
+        (void)hbk_diagnostic_create(state, HBK_DIAG_INFO, note_location, "'x' was defined here.");
+    }
+
+    FILE* file = tmpfile();
+    hbk_state_set_diagnostic_format(state, HBK_DIAGNOSTIC_FORMAT_JSON);
+    hbk_state_render_diagnostics_to_file(state, file);
+    hbk_string json = hbk_test_read_back(file);
+    HBK_TEST_EXPECT(hbk_test_count_lines(json) == 2, "the JSON output has %lld lines instead of 2:\n%s", (long long)hbk_test_count_lines(json), json);
+    hbk_vector_free(json);
+    fclose(file);
+
+    hbk_state_destroy(state);
+}
+
+int main(void) {
+    expect_duplicates_dropped();
+    expect_related_published_with_parent();
+    expect_related_kept_apart_from_top_level(true);
+    expect_related_kept_apart_from_top_level(false);
+    return hbk_test_result("test_diagnostics");
+}
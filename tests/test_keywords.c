@@ -0,0 +1,119 @@
+#include "hbk_test.h"
+
+#include "hbk_lex.h"
+#include "hbk_os.h"
+
+/// The keyword table is a perfect hash which only looks at the length and the first and last
+/// characters of a word, so words which share those with a keyword have to be told apart by the
+/// comparison after it. Every keyword has to come back as its own kind, and every near miss as
+/// an identifier. The table is built by whichever lexer gets there first, so the first lexers
+/// here start on several threads at once.
+
+#define LEXER_THREAD_COUNT 8
+
+typedef struct keyword {
+    hbk_token_kind kind;
+    const char* spelling;
+} keyword;
+
+static const keyword keywords[] = {
+#define KW(N, S) {HBK_TOKEN_##N, S},
+    HBK_TOKEN_KW_KINDS(KW)
+#undef KW
+};
+
+#define KEYWORD_COUNT ((int64_t)(sizeof keywords / sizeof *keywords))
+
+/// @brief Lexes the word on its own, and returns the kind of the one token it should make.
+static hbk_token_kind lex_word(const char* word) {
+    hbk_state* state = hbk_state_create();
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "word.hibiku", word, (int64_t)strlen(word), HBK_SOURCE_COPY);
+
+    hbk_token_buffer tokens = hbk_lex(state, source_id);
+    hbk_token_kind kind = hbk_vector_count(tokens.kinds) == 1 ? (hbk_token_kind)tokens.kinds[0] : HBK_TOKEN_INVALID;
+
+    hbk_token_buffer_destroy(&tokens);
+    hbk_state_destroy(state);
+    return kind;
+}
+
+static bool is_keyword(const char* word) {
+    for (int64_t i = 0; i < KEYWORD_COUNT; i++) {
+        if (0 == strcmp(word, keywords[i].spelling)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void expect_identifier(const char* word) {
+    if (is_keyword(word)) {
+        return;
+    }
+
+    hbk_token_kind kind = lex_word(word);
+    HBK_TEST_EXPECT(kind == HBK_TOKEN_IDENTIFIER, "`%s` lexed as %s instead of an identifier", word, hbk_token_kind_to_cstring(kind));
+}
+
+static void expect_keywords() {
+    for (int64_t i = 0; i < KEYWORD_COUNT; i++) {
+        hbk_token_kind kind = lex_word(keywords[i].spelling);
+        HBK_TEST_EXPECT(kind == keywords[i].kind, "`%s` lexed as %s instead of %s", keywords[i].spelling, hbk_token_kind_to_cstring(kind), hbk_token_kind_to_cstring(keywords[i].kind));
+    }
+}
+
+static void lexer_thread(void* argument) {
+    (void)argument;
+    expect_keywords();
+}
+
+int main(void) {
+    hbk_os_thread threads[LEXER_THREAD_COUNT];
+    int64_t started_count = 0;
+    for (int64_t i = 0; i < LEXER_THREAD_COUNT; i++) {
+        if (hbk_os_thread_start(&threads[started_count], lexer_thread, NULL)) {
+            started_count++;
+        }
+    }
+
+    for (int64_t i = 0; i < started_count; i++) {
+        hbk_os_thread_join(&threads[i]);
+    }
+
+    expect_keywords();
+
+    /// Every word one edit away from a keyword: a character changed, added or removed anywhere,
+    /// which covers the words the hash can't tell apart, and the changes of case.
+    static const char word_characters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+    for (int64_t i = 0; i < KEYWORD_COUNT; i++) {
+        const char* spelling = keywords[i].spelling;
+        int64_t length = (int64_t)strlen(spelling);
+
+        char word[64];
+        for (int64_t position = 0; position <= length; position++) {
+            for (const char* c = word_characters; *c != 0; c++) {
+                /// Digits can't start a word, they'd be a number.
+                bool can_start_word = !(*c >= '0' && *c <= '9');
+
+                if (position < length && (position > 0 || can_start_word)) {
+                    snprintf(word, sizeof word, "%s", spelling);
+                    word[position] = *c;
+                    expect_identifier(word);
+                }
+
+                if (position > 0 || can_start_word) {
+                    snprintf(word, sizeof word, "%.*s%c%s", (int)position, spelling, *c, spelling + position);
+                    expect_identifier(word);
+                }
+            }
+
+            if (position < length && length > 1 && !(position == 0 && spelling[1] >= '0' && spelling[1] <= '9')) {
+                snprintf(word, sizeof word, "%.*s%s", (int)position, spelling, spelling + position + 1);
+                expect_identifier(word);
+            }
+        }
+    }
+
+    return hbk_test_result("test_keywords");
+}
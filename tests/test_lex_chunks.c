@@ -0,0 +1,210 @@
+#include "hbk_test.h"
+
+#include "hbk_lex.h"
+
+/// Lexing a source in chunks on several threads has to give exactly what lexing it in one go does:
+/// the same tokens, payloads and symbols, and the same diagnostics in the same order, also where
+/// the error limit cuts them off. This is built with a tiny HBK_LEX_MIN_CHUNK_SIZE (see the Makefile),
+/// so that sources of a few kilobytes are split into lots of chunks, with boundaries landing
+/// inside strings, comments and unterminated literals.
+
+#ifndef HBK_LEX_MIN_CHUNK_SIZE
+#    error "test_lex_chunks needs a small HBK_LEX_MIN_CHUNK_SIZE to split its sources into chunks"
+#endif
+
+#define RANDOM_SOURCE_COUNT 100
+
+/// @brief How many chunks were lexed in total, to check that the sources really were split up.
+static int64_t lexed_chunk_count = 0;
+
+static const int64_t thread_counts[] = {2, 3, 4, 7, 16};
+static const int64_t max_errors[] = {0, 1, 2, 5, 40};
+
+/// The tokens are copied out of the state's memory, so that they can be compared once it's gone.
+typedef struct lex_result {
+    hbk_vector(uint8_t) kinds;
+    hbk_vector(uint32_t) offsets;
+    hbk_vector(hbk_token_payload) payloads;
+    /// @brief The text of each payload's symbol, one per line, since symbols are only meaningful in their own state.
+    hbk_string symbols;
+    /// @brief Every diagnostic, rendered, in the order they were published.
+    hbk_string diagnostics;
+    int64_t interned_count;
+    bool reached_error_limit;
+} lex_result;
+
+static void render_diagnostic(hbk_state* state, hbk_diagnostic* diag, void* user_data) {
+    hbk_string* diagnostics = user_data;
+    hbk_diagnostic_render_to_string(state, diag, diagnostics);
+    hbk_string_append_cstr(diagnostics, "\n");
+}
+
+static lex_result lex(hbk_string_view text, int64_t thread_count, int64_t max_error_count, bool has_earlier_error) {
+    lex_result result = {};
+    hbk_string_append_cstr(&result.symbols, "");
+    hbk_string_append_cstr(&result.diagnostics, "");
+
+    hbk_state* state = hbk_state_create();
+    hbk_state_set_enable_color(state, false);
+    hbk_state_set_max_errors(state, max_error_count);
+    hbk_state_set_diagnostic_sink(state, render_diagnostic, &result.diagnostics);
+
+    /// Symbols the state already has mustn't be interned again.
+    hbk_state_intern_symbol(state, hbk_cstring_as_view("foo"));
+
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "test.hibiku", text.data, text.count, HBK_SOURCE_COPY);
+    if (has_earlier_error) {
+        hbk_diagnostic_create(state, HBK_DIAG_ERROR, hbk_location_create(source_id, 0, 1), "An error from before lexing.");
+    }
+
+    hbk_token_buffer tokens = hbk_lex_parallel(state, source_id, thread_count);
+    hbk_vector_append_n(result.kinds, tokens.kinds, hbk_vector_count(tokens.kinds));
+    hbk_vector_append_n(result.offsets, tokens.offsets, hbk_vector_count(tokens.offsets));
+    hbk_vector_append_n(result.payloads, tokens.payloads, hbk_vector_count(tokens.payloads));
+    for (int64_t i = 0; i < hbk_vector_count(tokens.payloads); i++) {
+        hbk_string_append_sv(&result.symbols, hbk_state_symbol_view(state, tokens.payloads[i].symbol));
+        hbk_string_append_cstr(&result.symbols, "\n");
+    }
+
+    hbk_token_buffer_destroy(&tokens);
+
+    hbk_instrumentation_stats stats = hbk_state_get_instrumentation_stats(state);
+    lexed_chunk_count += stats.counters[HBK_COUNTER_LEX_CHUNKS];
+    if (hbk_instrumentation_is_enabled()) {
+        /// Lexed in chunks or in one go, a source is lexed once.
+        HBK_TEST_EXPECT(stats.passes[HBK_PASS_LEX].run_count == 1, "lexing one source took %lld LEX runs", (long long)stats.passes[HBK_PASS_LEX].run_count);
+    }
+
+    result.interned_count = hbk_state_get_interner_stats(state).entry_count;
+    result.reached_error_limit = hbk_state_has_reached_error_limit(state);
+    hbk_state_destroy(state);
+    return result;
+}
+
+static void lex_result_destroy(lex_result* result) {
+    hbk_vector_free(result->kinds);
+    hbk_vector_free(result->offsets);
+    hbk_vector_free(result->payloads);
+    hbk_vector_free(result->symbols);
+    hbk_vector_free(result->diagnostics);
+}
+
+/// @brief Returns a description of the first difference between the results, or NULL if there isn't one.
+static const char* lex_result_difference(lex_result* expected, lex_result* actual) {
+    int64_t token_count = hbk_vector_count(expected->kinds);
+    if (token_count != hbk_vector_count(actual->kinds)) return "token count";
+    if (token_count > 0 && 0 != memcmp(expected->kinds, actual->kinds, (size_t)token_count)) return "token kinds";
+    if (token_count > 0 && 0 != memcmp(expected->offsets, actual->offsets, (size_t)token_count * sizeof *expected->offsets)) return "token offsets";
+
+    int64_t payload_count = hbk_vector_count(expected->payloads);
+    if (payload_count != hbk_vector_count(actual->payloads)) return "payload count";
+    for (int64_t i = 0; i < payload_count; i++) {
+        hbk_token_payload expected_payload = expected->payloads[i];
+        hbk_token_payload actual_payload = actual->payloads[i];
+        if (expected_payload.length != actual_payload.length || expected_payload.integer_value != actual_payload.integer_value) return "payloads";
+        if (expected_payload.symbol != actual_payload.symbol) return "payload symbols";
+    }
+
+    if (0 != strcmp(expected->symbols, actual->symbols)) return "symbol text";
+    if (0 != strcmp(expected->diagnostics, actual->diagnostics)) return "diagnostics";
+
+    /// Past the error limit, chunks may have interned the strings of tokens which are never read (see `hbk_lexer`).
+    if (!expected->reached_error_limit && expected->interned_count != actual->interned_count) return "interned string count";
+    return NULL;
+}
+
+/// @brief Lexes the text on one thread and on each of `thread_counts`, under each of `max_errors`.
+static void expect_same_as_serial(const char* name, hbk_string_view text) {
+    for (size_t i = 0; i < sizeof max_errors / sizeof *max_errors; i++) {
+        for (int has_earlier_error = 0; has_earlier_error < 2; has_earlier_error++) {
+            lex_result expected = lex(text, 1, max_errors[i], has_earlier_error);
+            for (size_t j = 0; j < sizeof thread_counts / sizeof *thread_counts; j++) {
+                lex_result actual = lex(text, thread_counts[j], max_errors[i], has_earlier_error);
+                const char* difference = lex_result_difference(&expected, &actual);
+                HBK_TEST_EXPECT(difference == NULL, "%s: different %s on %lld threads with --max-errors=%lld%s", name, difference, (long long)thread_counts[j], (long long)max_errors[i], has_earlier_error ? " after an earlier error" : "");
+                lex_result_destroy(&actual);
+            }
+
+            lex_result_destroy(&expected);
+        }
+    }
+}
+
+/// @brief Repeats `piece` until the text is at least `length` bytes, between a prefix and a suffix.
+static void expect_repeated_same_as_serial(const char* name, const char* prefix, const char* piece, int64_t length, const char* suffix) {
+    hbk_string text = NULL;
+    hbk_string_append_cstr(&text, prefix);
+    while (hbk_vector_count(text) < length) {
+        hbk_string_append_cstr(&text, piece);
+    }
+
+    hbk_string_append_cstr(&text, suffix);
+    expect_same_as_serial(name, hbk_string_as_view(text));
+    hbk_vector_free(text);
+}
+
+static uint64_t random_state;
+
+static uint32_t random_below(uint32_t n) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t)(random_state % n);
+}
+
+/// @brief Strings together random tokens, broken up bits of tokens and whitespace.
+static hbk_string random_source(int64_t length) {
+    static const char* pieces[] = {
+        "foo", "bar_1", "x", "if", "while", "local", "function", "123", "7", "(", ")", "{", "}", ";", ",",
+        "+=", "<<=", ">>", "==", "=>", "!", "~=", "/", "*", "-", "--", "$", "@", "#", " ", "  ", "\n", "\n\n", "\t",
+        "\"str\"", "\"multi\nline\nstring\"", "\"", "\"/*\"", "'a'", "'ab'", "''", "'", "'\n",
+        "// line comment \"quoted\n", "/* block */", "/* nested /* inner */ still */", "/*", "*/", "/*/", "/* line1\nline2\n*/",
+    };
+
+    hbk_string text = NULL;
+    while (hbk_vector_count(text) < length) {
+        hbk_string_append_cstr(&text, pieces[random_below(sizeof pieces / sizeof *pieces)]);
+        if (random_below(3) != 0) {
+            hbk_string_append_cstr(&text, random_below(4) != 0 ? " " : "\n");
+        }
+    }
+
+    return text;
+}
+
+int main(void) {
+    hbk_lex_init();
+
+    /// Single tokens many chunks long, so that every boundary is inside one.
+    expect_repeated_same_as_serial("long string", "local s = \"", "a string which goes on /* and on */ ", 2000, "\";\nlocal t = s;\n");
+    expect_repeated_same_as_serial("long block comment", "local a = 1; /*", " a comment \"which\" goes on // and on\n", 2000, "*/ local b = a;\n");
+    expect_repeated_same_as_serial("long nested comment", "local a = 1; /*", " /* a nested comment */ ", 2000, "*/ local b = a;\n");
+    expect_repeated_same_as_serial("long line comment", "local a = 1; //", " a comment which goes on /* and on \"", 2000, "\nlocal b = a;\n");
+    expect_repeated_same_as_serial("long identifier", "local ", "an_identifier_which_goes_on", 2000, " = 1;\n");
+
+    /// Literals which never end, so the rest of the source belongs to them.
+    expect_repeated_same_as_serial("unterminated string", "local s = 1;\nlocal t = \"", "never ending \\\" string\n", 2000, "");
+    expect_repeated_same_as_serial("unterminated block comment", "local s = 1;\n/*", " never ending comment \"\n", 2000, "");
+    expect_repeated_same_as_serial("unterminated character", "local s = 1;\nlocal c = '", "never ending character ", 2000, "");
+
+    /// Lots of short tokens which look like the start of something longer, and lots of errors.
+    expect_repeated_same_as_serial("string quotes", "", "\"\" \"a\" \"/*\" '\"' ", 2000, "");
+    expect_repeated_same_as_serial("comment markers", "", "/* */ / * */ /*/ // \n", 2000, "");
+    expect_repeated_same_as_serial("invalid characters", "", "local $ = @ # 'ab' '' ;\n", 2000, "");
+
+    for (int64_t seed = 1; seed <= RANDOM_SOURCE_COUNT; seed++) {
+        random_state = 0x9E3779B97F4A7C15ull * (uint64_t)seed;
+        hbk_string text = random_source(200 + random_below(8000));
+
+        char name[64];
+        snprintf(name, sizeof name, "random source %lld", (long long)seed);
+        expect_same_as_serial(name, hbk_string_as_view(text));
+        hbk_vector_free(text);
+    }
+
+    if (hbk_instrumentation_is_enabled()) {
+        HBK_TEST_EXPECT(lexed_chunk_count > 0, "no source was lexed in chunks");
+    }
+
+    return hbk_test_result("test_lex_chunks");
+}
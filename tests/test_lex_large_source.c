@@ -0,0 +1,50 @@
+#include "hbk_test.h"
+
+#include "hbk_lex.h"
+#include "hbk_os.h"
+
+/// Sources over 4 GiB don't fit the 32-bit token offsets, and get an error instead of tokens.
+/// The source is committed but untouched address space, so this doesn't need 4 GiB of memory.
+
+static void count_errors(hbk_state* state, hbk_diagnostic* diag, void* user_data) {
+    (void)state;
+    int64_t* count = user_data;
+    *count += diag->kind == HBK_DIAG_ERROR;
+}
+
+static void expect_too_big_source_rejected(int64_t length) {
+    /// The OS zeroes the pages, so the text is NUL-terminated like any other source.
+    size_t size = ((size_t)length + hbk_os_page_size()) & ~(hbk_os_page_size() - 1);
+    char* data = hbk_os_reserve(size);
+    if (data == NULL || !hbk_os_commit(data, size)) {
+        fprintf(stderr, "test_lex_large_source: skipped, could not reserve %zu bytes\n", size);
+        hbk_os_release(data, size);
+        return;
+    }
+
+    int64_t error_count = 0;
+    hbk_state* state = hbk_state_create();
+    hbk_state_set_diagnostic_sink(state, count_errors, &error_count);
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "huge.hibiku", data, length, HBK_SOURCE_BORROW);
+
+    hbk_token_buffer tokens = hbk_lex(state, source_id);
+    HBK_TEST_EXPECT(hbk_vector_count(tokens.kinds) == 0, "a %lld byte source was lexed into %lld tokens", (long long)length, (long long)hbk_vector_count(tokens.kinds));
+    HBK_TEST_EXPECT(error_count == 1, "a %lld byte source gave %lld errors instead of 1", (long long)length, (long long)error_count);
+    hbk_token_buffer_destroy(&tokens);
+
+    hbk_lexer lexer;
+    hbk_lexer_init(&lexer, state, source_id, 4);
+    hbk_token token = hbk_lexer_next(&lexer);
+    HBK_TEST_EXPECT(token.kind == HBK_TOKEN_EOF, "the first token of a %lld byte source wasn't EOF", (long long)length);
+    HBK_TEST_EXPECT(token.location.offset == 0, "the EOF token of a %lld byte source is at %lld", (long long)length, (long long)token.location.offset);
+    hbk_lexer_destroy(&lexer);
+
+    hbk_state_destroy(state);
+    hbk_os_release(data, size);
+}
+
+int main(void) {
+    expect_too_big_source_rejected((int64_t)UINT32_MAX + 1);
+    expect_too_big_source_rejected((int64_t)UINT32_MAX * 3);
+    return hbk_test_result("test_lex_large_source");
+}
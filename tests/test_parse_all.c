@@ -0,0 +1,73 @@
+#include "hbk_test.h"
+
+/// `hbk_state_parse_all` has to give the same diagnostics and syntax trees whatever the thread
+/// count, including where the error limit cuts them off, since workers don't see each other's errors.
+
+#define SOURCE_COUNT 60
+
+/// @brief Adds the sources, all with a few errors, some with none, and some with a lot.
+static void add_sources(hbk_state* state) {
+    for (int64_t i = 0; i < SOURCE_COUNT; i++) {
+        hbk_string text = NULL;
+        int64_t error_count = i % 7 == 3 ? 0 : i % 11 == 5 ? 40 : i % 4 + 1;
+        hbk_string_append_format(&text, "local a%lld = %lld;\n", (long long)i, (long long)i);
+        for (int64_t j = 0; j < error_count; j++) {
+            hbk_string_append_format(&text, "local b%lld = a%lld + ;\nfunction f%lld(p: int): int => p * p;\n", (long long)j, (long long)i, (long long)j);
+        }
+
+        char name[64];
+        snprintf(name, sizeof name, "source%lld.hibiku", (long long)i);
+        hbk_state_add_source_from_memory(state, name, text, hbk_vector_count(text), HBK_SOURCE_COPY);
+        hbk_vector_free(text);
+    }
+}
+
+/// @brief Parses the sources on the given number of threads, and returns every diagnostic and tree as text.
+static hbk_string parse_all(int64_t thread_count, int64_t max_errors) {
+    hbk_state* state = hbk_state_create();
+    hbk_state_set_enable_color(state, false);
+    hbk_state_set_max_errors(state, max_errors);
+    add_sources(state);
+
+    hbk_state_parse_all(state, thread_count);
+
+    if (hbk_instrumentation_is_enabled()) {
+        /// The tokens are lexed as the parser asks for them, which still counts as lexing, once per source.
+        hbk_instrumentation_stats stats = hbk_state_get_instrumentation_stats(state);
+        HBK_TEST_EXPECT(stats.passes[HBK_PASS_LEX].run_count == stats.passes[HBK_PASS_PARSE].run_count, "%lld sources were parsed but %lld lexed", (long long)stats.passes[HBK_PASS_PARSE].run_count, (long long)stats.passes[HBK_PASS_LEX].run_count);
+    }
+
+    FILE* file = tmpfile();
+    if (file == NULL) {
+        fprintf(stderr, "Could not create a temporary file for the output.\n");
+        exit(1);
+    }
+
+    hbk_state_render_diagnostics_to_file(state, file);
+    for (hbk_source_id i = 0; i < SOURCE_COUNT; i++) {
+        hbk_state_print_source_syntax_to_file(state, i, file);
+    }
+
+    hbk_string result = hbk_test_read_back(file);
+    fclose(file);
+    hbk_state_destroy(state);
+    return result;
+}
+
+int main(void) {
+    int64_t max_errors[] = {0, 1, 3, 7, 40, 41, 100};
+    int64_t thread_counts[] = {2, 3, 4, 8};
+
+    for (size_t i = 0; i < sizeof max_errors / sizeof *max_errors; i++) {
+        hbk_string expected = parse_all(1, max_errors[i]);
+        for (size_t j = 0; j < sizeof thread_counts / sizeof *thread_counts; j++) {
+            hbk_string actual = parse_all(thread_counts[j], max_errors[i]);
+            HBK_TEST_EXPECT(0 == strcmp(actual, expected), "with --max-errors=%lld, %lld threads printed %lld lines where one thread printed %lld", (long long)max_errors[i], (long long)thread_counts[j], (long long)hbk_test_count_lines(actual), (long long)hbk_test_count_lines(expected));
+            hbk_vector_free(actual);
+        }
+
+        hbk_vector_free(expected);
+    }
+
+    return hbk_test_result("test_parse_all");
+}
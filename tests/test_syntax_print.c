@@ -0,0 +1,96 @@
+#include "hbk_test.h"
+
+/// Syntax tree printing, and in particular that it doesn't recurse: every operand of a long
+/// chain of operators nests one level deeper than the last, which used to overflow the C stack.
+
+#define DEEP_OPERAND_COUNT 200000
+
+static void expect_printed(const char* source, const char* expected) {
+    hbk_state* state = hbk_state_create();
+    hbk_state_set_enable_color(state, false);
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "test.hibiku", source, (int64_t)strlen(source), HBK_SOURCE_COPY);
+
+    hbk_string printed = hbk_test_print_syntax(state, source_id);
+    HBK_TEST_EXPECT(0 == strcmp(printed, expected), "printing `%s` gave\n%s\ninstead of\n%s", source, printed, expected);
+
+    hbk_vector_free(printed);
+    hbk_state_destroy(state);
+}
+
+/// @brief Parses and prints `local x = a <op> a <op> a ...;` with DEEP_OPERAND_COUNT operands.
+/// Nodes nested that deep are printed with their depth rather than all of their tree lines.
+static void expect_deep_chain_printed(const char* operator, const char* deepest_line, const char* last_line) {
+    hbk_string source = NULL;
+    hbk_string_append_cstr(&source, "local x = a");
+    for (int64_t i = 1; i < DEEP_OPERAND_COUNT; i++) {
+        hbk_string_append_cstr(&source, " ");
+        hbk_string_append_cstr(&source, operator);
+        hbk_string_append_cstr(&source, " a");
+    }
+
+    hbk_string_append_cstr(&source, ";");
+
+    hbk_state* state = hbk_state_create();
+    hbk_state_set_enable_color(state, false);
+    hbk_source_id source_id = hbk_state_add_source_from_memory(state, "deep.hibiku", source, hbk_vector_count(source), HBK_SOURCE_COPY);
+
+    hbk_string printed = hbk_test_print_syntax(state, source_id);
+
+    /// The declaration, every operand, every operator, and the blank line after the tree.
+    int64_t expected_line_count = 1 + DEEP_OPERAND_COUNT + (DEEP_OPERAND_COUNT - 1) + 1;
+    int64_t line_count = hbk_test_count_lines(printed);
+    HBK_TEST_EXPECT(line_count == expected_line_count, "a chain of '%s' printed %lld lines instead of %lld", operator, (long long)line_count, (long long)expected_line_count);
+
+    HBK_TEST_EXPECT(strstr(printed, deepest_line) != NULL, "a chain of '%s' didn't print the deepest node as `%s`", operator, deepest_line);
+
+    size_t last_line_length = strlen(last_line);
+    size_t printed_length = (size_t)hbk_vector_count(printed);
+    HBK_TEST_EXPECT(printed_length >= last_line_length && 0 == strcmp(printed + printed_length - last_line_length, last_line), "a chain of '%s' printed the wrong last node", operator);
+
+    hbk_vector_free(printed);
+    hbk_state_destroy(state);
+    hbk_vector_free(source);
+}
+
+int main(void) {
+    expect_printed(
+        "function identity(a: int): int => a;",
+        "DECL_FUNCTION <6> [0:8] identity(a : int) : int\n"
+        "├─DECL_PARAMETER <2> [18:1] a : int\n"
+        "└─STMT_ARROW <5> [34:1]\n"
+        "  └─IDENTIFIER <4> [34:1] a\n"
+        "\n"
+    );
+
+    expect_printed(
+        "local x = a + b * c;",
+        "DECL_VARIABLE <6> [6:1] x\n"
+        "└─BINARY <5> [10:9] +\n"
+        "  ├─IDENTIFIER <1> [10:1] a\n"
+        "  └─BINARY <4> [14:5] *\n"
+        "    ├─IDENTIFIER <2> [14:1] b\n"
+        "    └─IDENTIFIER <3> [18:1] c\n"
+        "\n"
+    );
+
+    /// A binary expression spans both of its operands, and an arrow body spans its value.
+    expect_printed(
+        "function f(a: int): int => a = 1 + a;",
+        "DECL_FUNCTION <10> [0:8] f(a : int) : int\n"
+        "├─DECL_PARAMETER <2> [11:1] a : int\n"
+        "└─STMT_ARROW <9> [27:9]\n"
+        "  └─BINARY <8> [27:9] =\n"
+        "    ├─IDENTIFIER <4> [27:1] a\n"
+        "    └─BINARY <7> [31:5] +\n"
+        "      ├─INTEGER_LITERAL <5> [31:1] 1\n"
+        "      └─IDENTIFIER <6> [35:1] a\n"
+        "\n"
+    );
+
+    /// Left-associative operators nest down the left-hand sides, so the deepest node is the first operand.
+    expect_deep_chain_printed("+", "(200000) ├─IDENTIFIER <1> [10:1] a\n", "  └─IDENTIFIER <399998> [800006:1] a\n\n");
+    /// Assignments are right-associative, so they nest down the right-hand sides instead.
+    expect_deep_chain_printed("=", "(200000) └─IDENTIFIER <200000> [800006:1] a\n", "(200000) └─IDENTIFIER <200000> [800006:1] a\n\n");
+
+    return hbk_test_result("test_syntax_print");
+}